@@ -5,6 +5,9 @@ set(PICO_BOARD pico_w)
 # isEnabledForFile method of src/Utils/Trace.cpp
 set(TRACE_TO_STDIO "0")
 
+# Keep the temperature history across power losses by writing it to flash every 6 hours
+set(TEMPERATURE_HISTORY_IN_FLASH "1")
+
 add_compile_definitions(
     WIFI_SSID=\"\"
     WIFI_PASSWORD=\"\"
@@ -1,4 +1,5 @@
 #include "Bitmap.h"
+#include "PicoClockHw/Platform.h"
 #include "Utils/Trace.h"
 
 #include <map>
@@ -26,7 +27,7 @@ namespace
         }
     }
 
-    uint32_t rowMask(int left, int right)
+    uint32_t RAM_FUNC(rowMask)(int left, int right)
     {
         return (0xFFFFFFFF >> left) & (0xFFFFFFFF << (31 - right));
     }
@@ -43,26 +44,26 @@ void Bitmap::setDrawOrigin(int x, int y)
     m_drawOriginY = y;
 }
 
-void Bitmap::considerDrawOrigin(int &x, int &y)
+void RAM_FUNC(Bitmap::considerDrawOrigin)(int &x, int &y)
 {
     x += m_drawOriginX;
     y += m_drawOriginY;
 }
 
-void Bitmap::unconsiderDrawOrigin(int &x, int &y)
+void RAM_FUNC(Bitmap::unconsiderDrawOrigin)(int &x, int &y)
 {
     x -= m_drawOriginX;
     y -= m_drawOriginY;
 }
 
-bool Bitmap::pixel(int x, int y) const
+bool RAM_FUNC(Bitmap::pixel)(int x, int y) const
 {
     uint32_t mask = 1 << (31 - x%32);
 
     return m_frameBuffer[y] & mask;
 }
 
-void Bitmap::putPixel(int x, int y, bool on)
+void RAM_FUNC(Bitmap::putPixel)(int x, int y, bool on)
 {
     considerDrawOrigin(x, y);
 
@@ -76,7 +77,7 @@ void Bitmap::putPixel(int x, int y, bool on)
         m_frameBuffer[y] &= ~mask;
 }
 
-void Bitmap::putIndicator(Indicator i, bool on)
+void RAM_FUNC(Bitmap::putIndicator)(Indicator i, bool on)
 {
     uint32_t mask;
     int row = i;
@@ -107,7 +108,7 @@ void Bitmap::putIndicator(Indicator i, bool on)
         m_frameBuffer[row] &= ~mask;
 }
 
-void Bitmap::drawRectangle(int left, int top, int right, int bottom, bool on)
+void RAM_FUNC(Bitmap::drawRectangle)(int left, int top, int right, int bottom, bool on)
 {
     considerDrawOrigin(left, top);
     considerDrawOrigin(right, bottom);
@@ -122,7 +123,7 @@ void Bitmap::drawRectangle(int left, int top, int right, int bottom, bool on)
     }
 }
 
-void Bitmap::moveRectangle(int left, int top, int right, int bottom, int vertShift)
+void RAM_FUNC(Bitmap::moveRectangle)(int left, int top, int right, int bottom, int vertShift)
 {
     considerDrawOrigin(left, top);
     considerDrawOrigin(right, bottom);
@@ -147,7 +148,7 @@ void Bitmap::moveRectangle(int left, int top, int right, int bottom, int vertShi
     }
 }
 
-void Bitmap::copyRectangle(int left, int top, int right, int bottom, Bitmap &destBmp, int destTop)
+void RAM_FUNC(Bitmap::copyRectangle)(int left, int top, int right, int bottom, Bitmap &destBmp, int destTop)
 {
     considerDrawOrigin(left, top);
     considerDrawOrigin(right, bottom);
@@ -163,7 +164,7 @@ void Bitmap::copyRectangle(int left, int top, int right, int bottom, Bitmap &des
     }
 }
 
-void Bitmap::clear()
+void RAM_FUNC(Bitmap::clear)()
 {
     for(int i=0; i< Display::HEIGHT;i++)
     {
@@ -180,7 +181,7 @@ void Bitmap::setFont(const Font *font)
     buildIndex(m_currentFont->propChars, sortedFont.propCharsIndex);
 }
 
-int Bitmap::drawChar(int x, int y, char c)
+int RAM_FUNC(Bitmap::drawChar)(int x, int y, char c)
 {
     considerDrawOrigin(x, y);
 
@@ -223,7 +224,7 @@ int Bitmap::drawChar(int x, int y, char c)
     return m_currentFont->width;
 }
 
-int Bitmap::charWidth(char c) const
+int RAM_FUNC(Bitmap::charWidth)(char c) const
 {
     // Currently, fonts support only capital letters.
     c = toupper(c);
@@ -242,7 +243,7 @@ int Bitmap::charWidth(char c) const
     }
 }
 
-void Bitmap::draw2DigitsInt(int x, int y, int i)
+void RAM_FUNC(Bitmap::draw2DigitsInt)(int x, int y, int i)
 {
     // No need to call considerDrawOrigin as drawChar which is called below does it
 
@@ -252,7 +253,7 @@ void Bitmap::draw2DigitsInt(int x, int y, int i)
     drawChar(x + m_currentFont->width + 1, y, '0' + i % 10);
 }
 
-void Bitmap::draw2DigitsIntWithLeadingZero(int x, int y, int i)
+void RAM_FUNC(Bitmap::draw2DigitsIntWithLeadingZero)(int x, int y, int i)
 {
     // No need to call considerDrawOrigin as drawChar which is called below does it
 
@@ -260,7 +261,7 @@ void Bitmap::draw2DigitsIntWithLeadingZero(int x, int y, int i)
     drawChar(x + m_currentFont->width + 1, y, '0' + i % 10);
 }
 
-int Bitmap::drawText(int x, int y, const std::string &s)
+int RAM_FUNC(Bitmap::drawText)(int x, int y, const std::string &s)
 {
     // No need to call considerDrawOrigin as drawChar which is called below does it
 
@@ -275,7 +276,7 @@ int Bitmap::drawText(int x, int y, const std::string &s)
     return textWidth;
 }
 
-int Bitmap::textWidth(const std::string &s) const
+int RAM_FUNC(Bitmap::textWidth)(const std::string &s) const
 {
     int textWidth = -1; // So that the last spacing is not counted.
 
@@ -286,7 +287,7 @@ int Bitmap::textWidth(const std::string &s) const
     return textWidth;
 }
 
-void Bitmap::putWeekDay(int weekDay, bool on)
+void RAM_FUNC(Bitmap::putWeekDay)(int weekDay, bool on)
 {
     // Change draw origin to access indicators
     int saveDrawOriginX = m_drawOriginX;
@@ -304,7 +305,7 @@ void Bitmap::putWeekDay(int weekDay, bool on)
     setDrawOrigin(saveDrawOriginX, saveDrawOriginY);
 }
 
-void Bitmap::putWeekDays(uint8_t weekDayBits)
+void RAM_FUNC(Bitmap::putWeekDays)(uint8_t weekDayBits)
 {
     TRACE << "weekDayBits:" << weekDayBits;
 
@@ -327,7 +328,7 @@ void Bitmap::putWeekDays(uint8_t weekDayBits)
     setDrawOrigin(saveDrawOriginX, saveDrawOriginY);
 }
 
-void Bitmap::drawMiddleDots()
+void RAM_FUNC(Bitmap::drawMiddleDots)()
 {
     drawRectangle(10, 1, 11, 2, true);
     drawRectangle(10, 4, 11, 5, true);
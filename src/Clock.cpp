@@ -1,118 +1,533 @@
 #include "Clock.h"
 #include "Utils/Trace.h"
+#include "PicoClockHw/BootProfiler.h"
+#include "PicoClockHw/EventJournal.h"
+#include "PicoClockHw/Platform.h"
+#include "PicoClockHw/WarmRestart.h"
+#include "Utils/Trampoline.h"
 
-Clock::Clock(int tickPerSec) : 
-    m_tickCount(tickPerSec), m_rtc(std::make_unique<Rtc>()), m_ntp(std::make_unique<Ntp>())
+namespace
 {
-    // Initialize m_time and m_tm from the RTC. It will be used for displaying time 
-    // while waiting for the sync from the RTC to be finished.
-    tm rtcTime;
-    if (m_rtc->read(rtcTime))
-    {
-        setFromNonDstConsideringTm(rtcTime);
-        m_rtcSync = SyncingFromRtc;
+    // After a warm restart, wait before reading the RTC, to avoid I2C traffic during startup.
+    const uint32_t RTC_RESYNC_DELAY_MS = 30000;
+
+    // Minimum time between two NTP syncs to estimate the drift, so that the inaccuracy of NTP
+    // is small compared to the measured offset.
+    const time_t MIN_DRIFT_ESTIMATION_SEC = 60 * 60;
+    const int32_t MAX_DRIFT_CENTI_PPM = 20000; // 200 ppm
+
+    // Without edge of the 1 Hz output of the RTC for this long, it is not connected or not
+    // running, and its offset cannot be measured.
+    const int64_t RTC_SQUARE_WAVE_TIMEOUT_US = 2000000;
+
+    // Period of the syncs after the first NTP one, which also measure the drift of the RTC. Must
+    // be within the range of TimerWheel.
+    const uint32_t RESYNC_PERIOD_MS = 4 * 60 * 60 * 1000;
+
+    // A source worse than the one the clock was synced from replaces it only after this long,
+    // e.g. the RTC once NTP failed for a day.
+    const time_t HOLDOVER_SEC = 24 * 60 * 60;
+}
+
+Clock::Clock(int tickPerSec) : m_tickCount(tickPerSec)
+{
+    // Register the events that replace the evaluation of alarms and DST on every second. They
+    // will be scheduled when the clock is set for the first time.
+    using namespace std::placeholders;
+    m_alarmEvent = m_events.add(
+        std::bind(&Clock::nextAlarmTime, this, _1), std::bind(&Clock::onAlarmTimeReached, this, _1));
+    m_dstEvent = m_events.add(
+        std::bind(&Clock::nextDstTransition, this, _1), std::bind(&Clock::onDstTransition, this, _1));
+
+    addTimeSource(&m_rtcSource);
+    addTimeSource(&m_ntpSource);
+    m_rtcSource.setSecondCallback(std::bind(&Clock::onRtcSecond, this, _1));
+    EventJournal::setTimeSource(std::bind(&Clock::now, this));
+    bool warmRestart = restoreAfterWarmRestart();
+
+    // Nothing waits for the RTC, so that the display comes up immediately, with the restored time
+    // after a warm restart. Otherwise the time of the RTC is read once it answered the probe.
+    if (hasRtc() && !rtc()->probeAsync(std::bind(&Clock::onRtcProbed, this, !warmRestart, _1)))
+        m_rtcSource.disable();
+    EventJournal::log(EventJournal::Boot, warmRestart ? 1 : 0);
+    BootProfiler::mark(BootProfiler::ClockReady);
+}
+
+bool Clock::addTimeSource(TimeSource *source)
+{
+    if (m_sourceCount == MAX_TIME_SOURCES)
+        return false;
+
+    m_sources[m_sourceCount++] = source;
+    return true;
+}
 
-        TRACE << "Set m_lastRtcSec to be able to detect when the second changes in the RTC";
-        m_lastRtcSec = rtcTime.tm_sec;
+bool Clock::restoreAfterWarmRestart()
+{
+    WarmRestart::State state;
+    if (!WarmRestart::restore(state))
+        return false;
+
+    TRACE << "Warm restart, time restored without reading the RTC";
+    m_time = state.time;
+    updateDst();
+    setTmFromTime();
+    m_tickCount = static_cast<uint64_t>(state.phaseUs) * m_tickCount.wrapValue() / 1000000;
+    m_clockAdjusted = true;
+    BootProfiler::mark(BootProfiler::TimeKnown);
+
+    m_driftCentiPpm = state.driftCentiPpm;
+    if (state.minSinceNtpSync != WarmRestart::NO_NTP_SYNC)
+        m_lastNtpSyncTime = m_time - static_cast<time_t>(state.minSinceNtpSync) * 60;
+
+    m_rtcSync = SyncDone;
+    if (state.hasRtc)
+    {
+        // The RTC is still the reference in case the restored time is wrong, e.g. if the device
+        // stayed in BOOTSEL mode. Sync from it later in the background.
+        MAKE_TRAMPOLINE(Clock, startRtcResync, userPtrAtEnd);
+        TimerWheel::addInMs(RTC_RESYNC_DELAY_MS, startRtcResync, this);
     } else
+        m_rtcSource.disable();
+
+    return true;
+}
+
+void RAM_FUNC(Clock::saveForWarmRestart)() const
+{
+    WarmRestart::State state;
+    state.time = m_time;
+    state.phaseUs = static_cast<uint64_t>(m_tickCount) * 1000000 / m_tickCount.wrapValue();
+    state.driftCentiPpm = m_driftCentiPpm;
+    if (m_lastNtpSyncTime == -1)
+        state.minSinceNtpSync = WarmRestart::NO_NTP_SYNC;
+    else
+        state.minSinceNtpSync = 
+            std::min<time_t>((m_time - m_lastNtpSyncTime) / 60, WarmRestart::NO_NTP_SYNC - 1);
+    state.hasRtc = hasRtc();
+    WarmRestart::save(state);
+}
+
+void Clock::onRtcProbed(bool setTime, bool present)
+{
+    if (!hasRtc())
+        return;
+
+    if (!present)
     {
         TRACE << "No RTC available";
-        m_rtc.release();
+        m_rtcSource.disable();
+        return;
+    }
+
+    using namespace std::placeholders;
+    rtc()->readSnapshotAsync(std::bind(&Clock::onRtcSnapshot, this, setTime, _1, _2));
+}
+
+void Clock::onRtcSnapshot(bool setTime, bool ok, const Rtc::Snapshot &snapshot)
+{
+    restoreRtcAgingOffset();
+    if (!setTime)
+        return;
+
+    // Displayed while waiting for the sample of the best source, which is the RTC at its next
+    // second until NTP is up.
+    if (ok && !m_syncSource)
+    {
+        TRACE << "Time read from the RTC";
+        setFromNonDstConsideringTm(snapshot.dateTime);
+        BootProfiler::mark(BootProfiler::TimeKnown);
+    }
+    syncFromBestSource();
+}
+
+int64_t Clock::startRtcResync(TimerWheel::TimerId id)
+{
+    // Not needed if NTP was faster, as it is more accurate and was written to the RTC.
+    if (!m_syncedFromNtp)
+    {
+        TRACE << "Start resync";
+        syncFromBestSource();
+    }
+    return 0;
+}
+
+void Clock::onRtcSecond(uint64_t edgeUs)
+{
+    if (!hasRtc())
+        return;
+
+    writeRtcAgingOffset();
+
+    if (m_rtcSync == MeasuringRtc)
+    {
+        if (!m_rtcRequestPending)
+        {
+            using namespace std::placeholders;
+            m_rtcEdgeClockUs = clockUsAt(edgeUs);
+            m_rtcRequestPending = true;
+            if (!rtc()->readAsync(std::bind(&Clock::onRtcMeasured, this, _1, _2)))
+                m_rtcRequestPending = false;
+        }
+    } else if (m_rtcSync == SyncDone)
+    {
+        estimateDriftFromRtc(edgeUs);
+    } else
+    {
+        // The RTC is about to be set.
+        m_rtcDriftReferenceTime = -1;
+    }
+}
+
+void Clock::onRtcMeasured(bool ok, const tm &rtcTime)
+{
+    m_rtcRequestPending = false;
+    if (m_rtcSync != MeasuringRtc)
+        return;
+
+    bool afterWrite = m_measureRtcAfterWrite;
+    m_measureRtcAfterWrite = false;
+    if (!ok)
+    {
+        m_rtcSync = SyncingToRtc;
+        return;
+    }
+
+    // The RTC time is the one of the second starting at the edge.
+    tm rtcTm = rtcTime;
+    int64_t offsetUs = static_cast<int64_t>(mktime(&rtcTm)) * 1000000 - m_rtcEdgeClockUs;
+    TRACE << "RTC offset" << offsetUs << "us";
+
+    RtcCalibrator::Result result = m_rtcCalibrator.onOffsetMeasured(m_time, offsetUs);
+    if (result.agingChanged)
+    {
+        // Persisted once the RTC took it, so that the persisted offset is the one it runs with.
+        m_rtcAgingOffsetPending = true;
+        m_persistRtcCalibration = true;
+        writeRtcAgingOffset();
+    }
+
+    // Once set, the RTC is measured again to start a new period of the calibration. It is not
+    // set again from that measurement, in case it does not take the time.
+    if (result.writeTime && !afterWrite)
+    {
+        m_rtcSync = SyncingToRtc;
+        m_measureRtcAfterWrite = true;
+    } else
+    {
         m_rtcSync = SyncDone;
     }
 }
 
+// Time of the clock at the given time of Platform::timeUs(), shortly after the last tick, in us
+int64_t Clock::clockUsAt(uint64_t timeUs) const
+{
+    return 
+        static_cast<int64_t>(m_time) * 1000000 + 
+        static_cast<int64_t>(m_tickCount) * 1000000 / m_tickCount.wrapValue() + 
+        static_cast<int64_t>(timeUs - m_lastTickUs);
+}
+
+// The RTC is a reference for the drift until NTP provides a better one. As the time of the clock
+// is not corrected from the RTC, the drift is measured from the change of the phase between their
+// seconds.
+void Clock::estimateDriftFromRtc(uint64_t edgeUs)
+{
+    if (m_lastNtpSyncTime != -1)
+        return;
+
+    // Position of the clock in its second at the edge, within +-0.5 s
+    int64_t phaseUs = clockUsAt(edgeUs) % 1000000;
+    if (phaseUs > 500000)
+        phaseUs -= 1000000;
+    else if (phaseUs < -500000)
+        phaseUs += 1000000;
+
+    // Positive if the clock is behind the RTC. The correction not yet applied as whole ticks is
+    // already accounted, so that the measurement is not quantized by the ticks.
+    int64_t offsetUs = 
+        -phaseUs - m_driftCorrectionNs / 1000 - 
+        static_cast<int64_t>(m_tickCorrection) * 1000000 / m_tickCount.wrapValue();
+
+    if (m_rtcDriftReferenceTime == -1)
+    {
+        m_rtcDriftReferenceTime = m_time;
+        m_rtcDriftReferenceOffsetUs = offsetUs;
+        return;
+    }
+
+    time_t elapsed = m_time - m_rtcDriftReferenceTime;
+    if (elapsed < MIN_DRIFT_ESTIMATION_SEC)
+        return;
+
+    // As for NTP, the change of the offset is the drift left over by the current estimate.
+    int64_t drift = m_driftCentiPpm + (offsetUs - m_rtcDriftReferenceOffsetUs) * 100 / elapsed;
+    m_driftCentiPpm = 
+        std::max<int64_t>(-MAX_DRIFT_CENTI_PPM, std::min<int64_t>(drift, MAX_DRIFT_CENTI_PPM));
+    m_rtcDriftReferenceTime = m_time;
+    m_rtcDriftReferenceOffsetUs = offsetUs;
+    TRACE << "RTC offset" << offsetUs << "us, drift estimate" << m_driftCentiPpm << "x0.01 ppm";
+}
+
+void Clock::onRtcWritten(bool ok)
+{
+    m_rtcRequestPending = false;
+    if (ok)
+        m_rtcCalibrator.onRtcWritten();
+
+    // Retried on the next second if failed
+    if (ok && m_rtcSync == SyncingToRtc)
+        m_rtcSync = m_measureRtcAfterWrite ? MeasuringRtc : SyncDone;
+}
+
 void Clock::startSyncFromNtp()
 {
-    if (!m_ntp)
+    // Without NTP, the other sources are still synced from.
+    if (!m_ntpSource.init())
+        TRACE << "Will not use NTP";
+
+    startPeriodicSync();
+}
+
+void Clock::startPeriodicSync()
+{
+    syncFromBestSource();
+    if (m_resyncTimer != -1)
         return;
 
-    if (!m_ntp->init())
+    MAKE_TRAMPOLINE(Clock, resync, userPtrAtEnd);
+    m_resyncTimer = TimerWheel::addInMs(RESYNC_PERIOD_MS, resync, this);
+}
+
+int64_t Clock::resync(TimerWheel::TimerId id)
+{
+    syncFromBestSource();
+    return static_cast<int64_t>(RESYNC_PERIOD_MS) * 1000;
+}
+
+// After a failure, only the sources worse than the failed one are tried, so that each one is
+// tried at most once.
+void Clock::syncFromBestSource(const TimeSource *failedSource)
+{
+    TimeSource *best = nullptr;
+    for (int i = 0; i < m_sourceCount; i++)
+    {
+        TimeSource *source = m_sources[i];
+        if (!source->isAvailable() || (failedSource && !failedSource->isBetterThan(*source)))
+            continue;
+        if (!best || source->isBetterThan(*best))
+            best = source;
+    }
+
+    if (!best)
     {
-        // Will not use NTP.
-        m_ntp.release();
+        TRACE << "No time source left";
         return;
     }
 
+    TRACE << "Sync from" << best->name();
     using namespace std::placeholders;
-    m_ntp->setTimeCallback(std::bind(&Clock::onNtpTimeReceived, this, _1, _2));
-    m_ntp->startRequest();
+    if (!best->requestSample(std::bind(&Clock::onTimeSample, this, best, _1, _2)))
+        TRACE << "Sample not started";
 }
 
-void Clock::onNtpTimeReceived(time_t utcTime, uint32_t ms)
+void Clock::onTimeSample(TimeSource *source, bool ok, const TimeSource::Sample &sample)
 {
-    TRACE << "Received ntp time:" << utcTime <<", setting it";
-    m_time = utcTime + UTC_OFFSET * 60 * 60;
+    if (!ok)
+    {
+        TRACE << source->name() << "failed, falling back";
+        syncFromBestSource(source);
+        return;
+    }
+
+    if (!accepts(*source))
+    {
+        TRACE << "Ignore" << source->name() << "as the clock was synced from a better source";
+        return;
+    }
+
+    // Time now, the sample being valid when it was taken
+    uint64_t sinceUs = Platform::timeUs() - sample.timeUs + sample.us;
+    time_t time = sample.time + static_cast<time_t>(sinceUs / 1000000);
+    uint32_t us = sinceUs % 1000000;
+    TRACE << "Synchronized with" << source->name();
+
+    // A source better than the RTC is a reference for the drift and for the RTC.
+    if (source->isBetterThan(m_rtcSource))
+    {
+        int64_t correctionMs = 
+            static_cast<int64_t>(time - m_time) * 1000 + us / 1000 - 
+            static_cast<int64_t>(m_tickCount) * 1000 / m_tickCount.wrapValue();
+        correctionMs = std::max<int64_t>(std::min<int64_t>(correctionMs, INT32_MAX), INT32_MIN);
+        EventJournal::log(EventJournal::NtpSync, 0, correctionMs);
+        estimateDrift(time, us);
+        m_syncedFromNtp = true;
+        BootProfiler::mark(BootProfiler::NtpSync);
+
+        // Measure the offset of the RTC on its next second, which decides if it needs to be set.
+        m_rtcSync = MeasuringRtc;
+    } else
+    {
+        m_lastNtpSyncTime = -1; // No longer comparable with the next NTP sync
+        m_rtcDriftReferenceTime = -1;
+    }
+
+    m_time = time;
+    updateDst();
     setTmFromTime();
-    m_tickCount = ms * m_tickCount.wrapValue() / 1000;
+    m_tickCount = static_cast<uint64_t>(us) * m_tickCount.wrapValue() / 1000000;
     m_clockAdjusted = true;
+    m_syncSource = source;
+    m_syncTime = m_time;
+    BootProfiler::mark(BootProfiler::TimeKnown);
+}
 
-    // Now that we got the time from NTP, plan RTC sync at the next second change.
-    m_rtcSync = SyncingToRtc;
+bool Clock::accepts(const TimeSource &source) const
+{
+    return 
+        !m_syncSource || !m_syncSource->isBetterThan(source) || m_time - m_syncTime >= HOLDOVER_SEC;
 }
 
-void Clock::tick(bool &clockAdjusted, AlarmId &reachedAlarm, Settings &settings)
+void Clock::setRtcCalibration(const Settings::RtcCalibration &calibration)
 {
-    clockAdjusted = false;
-    reachedAlarm = NoAlarm;
+    m_rtcCalibrator.setCalibration(calibration);
+    m_hasRtcCalibration = true;
+    restoreRtcAgingOffset();
+}
 
-    m_tickCount.increment();
+// The aging offset is lost with the backup battery of the RTC. Checked once both the calibration
+// and a snapshot of the RTC are known, whichever comes last.
+void Clock::restoreRtcAgingOffset()
+{
+    Rtc::Snapshot snapshot;
+    int8_t agingOffset = m_rtcCalibrator.calibration().agingOffset;
+    if (m_hasRtcCalibration && hasRtc() && rtc()->lastSnapshot(snapshot) && 
+        snapshot.agingOffset != agingOffset)
+    {
+        TRACE << "Restore RTC aging offset" << agingOffset;
+        m_rtcAgingOffsetPending = true;
+        writeRtcAgingOffset();
+    }
+}
+
+// Retried on each second until the RTC took the current offset
+void Clock::writeRtcAgingOffset()
+{
+    if (!m_rtcAgingOffsetPending || m_rtcAgingOffsetWriting || !hasRtc())
+        return;
+
+    using namespace std::placeholders;
+    int8_t agingOffset = m_rtcCalibrator.calibration().agingOffset;
+    m_rtcAgingOffsetWriting = true;
+    if (!rtc()->writeAgingOffsetAsync(
+            agingOffset, std::bind(&Clock::onRtcAgingOffsetWritten, this, agingOffset, _1)))
+        m_rtcAgingOffsetWriting = false;
+}
 
-    if (m_rtc && m_rtcSync == SyncingFromRtc) // RTC available and synchronizing with it?
+void Clock::onRtcAgingOffsetWritten(int8_t agingOffset, bool ok)
+{
+    m_rtcAgingOffsetWriting = false;
+    if (!ok)
     {
-        TRACE << "Synchronizing with RTC";
-        tm rtcTime;
-        if (m_rtc->read(rtcTime))
-        {
-            if (rtcTime.tm_sec != m_lastRtcSec)
-            {
-                TRACE << "done";
-                // The second just changed in the RTC, synchronize.
-                setFromNonDstConsideringTm(rtcTime);
-                m_tickCount = 0;
-                m_rtcSync = SyncDone;
-            }
-        } else
-        {
-            // RTC read failed, give up with synchronization
-            m_rtcSync = SyncDone;
-        }
-    } else
+        TRACE << "Failed to write the RTC aging offset";
+        return;
+    }
+
+    // The offset may have changed again during the write.
+    if (agingOffset != m_rtcCalibrator.calibration().agingOffset)
+        return;
+
+    m_rtcAgingOffsetPending = false;
+    if (m_persistRtcCalibration && m_rtcCalibrationCallback)
+        m_rtcCalibrationCallback(m_rtcCalibrator.calibration());
+    m_persistRtcCalibration = false;
+}
+
+void Clock::estimateDrift(time_t referenceTime, uint32_t us)
+{
+    time_t lastSyncTime = m_lastNtpSyncTime;
+    m_lastNtpSyncTime = referenceTime;
+    if (lastSyncTime == -1)
+        return;
+
+    time_t elapsed = referenceTime - lastSyncTime;
+    if (elapsed < MIN_DRIFT_ESTIMATION_SEC)
+        return;
+
+    // The offset is the drift left over by the compensation of the current estimate.
+    int64_t offsetUs = 
+        (static_cast<int64_t>(referenceTime - m_time) * 1000000 + us) - 
+        static_cast<int64_t>(m_tickCount) * 1000000 / m_tickCount.wrapValue();
+    int64_t drift = m_driftCentiPpm + offsetUs * 100 / elapsed;
+    m_driftCentiPpm = 
+        std::max<int64_t>(-MAX_DRIFT_CENTI_PPM, std::min<int64_t>(drift, MAX_DRIFT_CENTI_PPM));
+    TRACE << "Offset" << offsetUs << "us, drift estimate" << m_driftCentiPpm << "x0.01 ppm";
+}
+
+// Called once per second
+void Clock::correctDrift()
+{
+    const int32_t tickNs = 1000000000 / m_tickCount.wrapValue();
+    m_driftCorrectionNs += m_driftCentiPpm * 10;
+    if (m_driftCorrectionNs >= tickNs)
     {
-        // Count time in the program. No longer read from the RTC. Update it if needed.
-        if (m_tickCount == 0)
-        {
-            m_time++;
-            setTmFromTime();
+        m_driftCorrectionNs -= tickNs;
+        m_tickCorrection = 1;
+    } else if (m_driftCorrectionNs <= -tickNs)
+    {
+        m_driftCorrectionNs += tickNs;
+        m_tickCorrection = -1;
+    }
+}
 
-            if (m_rtc && m_rtcSync == SyncingToRtc)
-            {
-                TRACE << "Set RTC";
+void RAM_FUNC(Clock::tick)(bool &clockAdjusted)
+{
+    clockAdjusted = false;
 
-                // To avoid ambiguity, save the time without DST consideration into the RTC. Thus,
-                // on the next start, m_dst will be able to determine if DST is active only by 
-                // looking at the time and date.
-                tm tm = *localtime(&m_time);
+    m_tickCount.increment();
+    m_lastTickUs = Platform::timeUs();
 
-                if (m_rtc->write(tm))
-                    m_rtcSync = SyncDone;
-            }
-        }
-    }   
+    // Apply drift corrections in the middle of the second, so that the second changes are not 
+    // affected. The events need to know that the clock moved relative to the hardware timer.
+    if (m_tickCorrection != 0 && m_tickCount == m_tickCount.wrapValue() / 2)
+    {
+        if (m_tickCorrection > 0)
+            m_tickCount.increment();
+        else
+            m_tickCount.decrement();
+        m_tickCorrection = 0;
+        m_clockAdjusted = true;
+    }
 
-    if (m_tickCount == 0 && m_tm.tm_sec == 0)
+    if (hasRtc() && m_rtcSync == MeasuringRtc && !m_rtcRequestPending &&
+        static_cast<int64_t>(m_lastTickUs - rtc()->lastSecondEdgeUs()) > RTC_SQUARE_WAVE_TIMEOUT_US)
     {
-        if (alarmReached(Alarm1))
-            reachedAlarm = Alarm1;
-        else if (alarmReached(Alarm2))
-            reachedAlarm = Alarm2;
+        // The offset cannot be measured without 1 Hz output, just set the RTC.
+        m_measureRtcAfterWrite = false;
+        m_rtcSync = SyncingToRtc;
+    }
+
+    // Count time in the program, also while a time source is sampled in the background. Update
+    // the RTC if needed.
+    if (m_tickCount == 0)
+    {
+        m_time++;
+        setTmFromTime();
+        correctDrift();
 
-        if (reachedAlarm != NoAlarm && settings.get().skipNextAlarm)
+        if (hasRtc() && m_rtcSync == SyncingToRtc && !m_rtcRequestPending)
         {
-            // This alarm must be skipped. Disable the "skip next alarm" function and do not report 
-            // that an alarm was reached
-            settings.modify().skipNextAlarm = false;
-            reachedAlarm = NoAlarm;
+            TRACE << "Set RTC";
+
+            // To avoid ambiguity, save the time without DST consideration into the RTC. Thus,
+            // on the next start, m_dst will be able to determine if DST is active only by 
+            // looking at the time and date.
+            tm tm = *localtime(&m_time);
+
+            using namespace std::placeholders;
+            m_rtcRequestPending = true;
+            if (!rtc()->writeAsync(tm, std::bind(&Clock::onRtcWritten, this, _1)))
+                m_rtcRequestPending = false;
         }
     }
 
@@ -120,24 +535,124 @@ void Clock::tick(bool &clockAdjusted, AlarmId &reachedAlarm, Settings &settings)
     {
         m_clockAdjusted = false;
         clockAdjusted = true;
+
+        // As the time jumped, let the events recompute their deadlines and tell them when the 
+        // current second started.
+        m_events.setReference(
+            m_timeConsideringDst, 
+            Platform::timeUs() - static_cast<uint64_t>(m_tickCount) * 1000000 / m_tickCount.wrapValue());
+
+        if (m_events.deadline(m_alarmEvent) != m_snapshotAlarmDeadline)
+        {
+            updateAlarmSummary();
+            m_snapshot.sequence++;
+        }
     } 
+
+    saveForWarmRestart();
 }
 
 void Clock::setTmFromTime()
 {
-    time_t timeConsideringDst = m_dst.considerDst(m_time);
-    m_tm = *localtime(&timeConsideringDst);
+    m_timeConsideringDst = m_time + m_dstOffset;
+    m_tm = *localtime(&m_timeConsideringDst);
     TRACE << "It is" << m_tm;
+
+    updateSnapshot();
+}
+
+void Clock::updateSnapshot()
+{
+    m_snapshot.hour24 = m_tm.tm_hour;
+    m_snapshot.morning = m_tm.tm_hour < 12;
+    m_snapshot.hour12 = m_snapshot.morning ? m_tm.tm_hour : m_tm.tm_hour - 12;
+    if (m_snapshot.hour12 == 0)
+        m_snapshot.hour12 = 12;
+    m_snapshot.min = m_tm.tm_min;
+    m_snapshot.sec = m_tm.tm_sec;
+    m_snapshot.weekday = m_tm.tm_wday;
+    m_snapshot.barWidth = m_tm.tm_sec / 3;
+    m_snapshot.barPhase = m_tm.tm_sec % 3;
+    m_snapshot.month = m_tm.tm_mon + 1;
+    m_snapshot.day = m_tm.tm_mday;
+    if (m_snapshot.year != m_tm.tm_year + 1900)
+    {
+        m_snapshot.year = m_tm.tm_year + 1900;
+        int year = m_snapshot.year;
+        for (int i = 3; i >= 0; i--, year /= 10)
+            m_snapshot.yearDigits[i] = '0' + year % 10;
+    }
+
+    // The alarm event is rescheduled when an alarm is reached or modified, so the summary only 
+    // needs to be rebuilt when its deadline changed.
+    if (m_events.deadline(m_alarmEvent) != m_snapshotAlarmDeadline)
+        updateAlarmSummary();
+
+    m_snapshot.sequence++;
+}
+
+void Clock::updateAlarmSummary()
+{
+    m_snapshotAlarmDeadline = m_events.deadline(m_alarmEvent);
+
+    m_snapshot.nextAlarm = AlarmSummary();
+    m_snapshot.alarmAfterNext = AlarmSummary();
+    if (m_snapshotAlarmDeadline == TimeEvents::NO_DEADLINE)
+        return;
+
+    auto summarize = [](time_t t, AlarmSummary &summary)
+    {
+        tm alarmTm = *localtime(&t);
+        summary.valid = true;
+        summary.weekday = alarmTm.tm_wday;
+        summary.hour = alarmTm.tm_hour;
+        summary.min = alarmTm.tm_min;
+    };
+    summarize(m_snapshotAlarmDeadline, m_snapshot.nextAlarm);
+
+    time_t afterNext = nextAlarmTime(m_snapshotAlarmDeadline);
+    if (afterNext != TimeEvents::NO_DEADLINE)
+        summarize(afterNext, m_snapshot.alarmAfterNext);
+}
+
+void Clock::updateDst()
+{
+    m_dstOffset = m_dst.considerDst(m_time) - m_time;
+}
+
+time_t Clock::nextDstTransition(time_t now)
+{
+    time_t transition = m_dst.nextTransition(now - m_dstOffset);
+    if (transition == -1)
+        return TimeEvents::NO_DEADLINE;
+
+    // The transition happens when the time without DST reaches it, i.e. with the current offset.
+    return transition + m_dstOffset;
+}
+
+void Clock::onDstTransition(time_t deadline)
+{
+    TRACE << "DST transition";
+    updateDst();
+    setTmFromTime();
+    m_clockAdjusted = true;
 }
 
 void Clock::set(const tm &tm)
 {
     TRACE << "Set clock to" << tm;
+    time_t previousTime = m_time;
     m_tm = tm;
 
     // If DST is active, unapply it so that the time stays as it was set by the user, as the DST 
     // offset will be readded each time setTmFromTime() is called.
     m_time = m_dst.unconsiderDst(mktime(&m_tm));
+    EventJournal::log(EventJournal::TimeSet, 0, m_time - previousTime);
+    updateDst();
+    setTmFromTime();
+    m_lastNtpSyncTime = -1; // No longer comparable with the next NTP sync
+    m_rtcDriftReferenceTime = -1;
+    m_syncSource = nullptr; // The user is the reference now
 
     m_clockAdjusted = true;
 }
@@ -146,7 +661,10 @@ void Clock::set(const tm &tm)
 void Clock::setFromNonDstConsideringTm(tm tm)
 {
     m_time = mktime(&tm);
+    updateDst();
     setTmFromTime();
+    m_lastNtpSyncTime = -1; // No longer comparable with the next NTP sync
+    m_rtcDriftReferenceTime = -1;
 
     m_clockAdjusted = true;
 }
@@ -154,85 +672,85 @@ void Clock::setFromNonDstConsideringTm(tm tm)
 void Clock::setAlarm(AlarmId id, const Settings::Alarm &al)
 {
     m_alarm[id] = al;
+    m_events.update(m_alarmEvent);
+
+    updateAlarmSummary();
+    m_snapshot.sequence++;
 }
 
-bool Clock::nextAlarm(int &weekday, int &hour, int &min, const Settings::Values &settings) const
+time_t Clock::nextAlarmTime(time_t now) const
 {
-    // Figure out what is the next alarm after now
-    Time time;
-    if (!nextAlarmAfter(m_tm.tm_wday, {m_tm.tm_hour, m_tm.tm_min}, weekday, time))
-        return false; // No alarm enabled
-
-    // If this alarm will be skipped, get the next alarm after it
-    if (settings.skipNextAlarm)
+    time_t earliest = TimeEvents::NO_DEADLINE;
+    for (int id = Alarm1; id < AlarmCount; id++)
     {
-        if (!nextAlarmAfter(weekday, time, weekday, time))
-            return false; // No other alarm enabled (cannot happen for the moment, but may change)
+        time_t t = nextTimeOfAlarm(static_cast<AlarmId>(id), now);
+        if (t != TimeEvents::NO_DEADLINE && (earliest == TimeEvents::NO_DEADLINE || t < earliest))
+            earliest = t;
     }
-
-    // deliver the result
-    hour = time.hour;
-    min = time.min;
-    return true;
+    return earliest;
 }
 
-bool Clock::nextAlarmAfter(
-        int startWeekday, const Time &startTime, int &weekday, Time &time) const
+time_t Clock::nextTimeOfAlarm(AlarmId id, time_t now) const
 {
-    // Check if there is an alarm later on the start day
-    Time t1 = alarmTimeAtDay(Alarm1, startWeekday);
-    if (t1 <= startTime)
-        t1 = Time(); // Alarm already passed
-    Time t2 = alarmTimeAtDay(Alarm2, startWeekday);
-    if (t2 <= startTime)
-        t2 = Time(); // Alarm already passed
-
-    // Return the earliest reacheable alarm on the start day if one was found.
-    time = std::min(t1, t2);
-    if (time.isValid())
-    {
-        weekday = startWeekday;
-        return true;
-    }
+    const Settings::Alarm &al = m_alarm[id];
+    if (al.mode == Settings::AlarmMode::Off)
+        return TimeEvents::NO_DEADLINE;
+
+    // Start searching today if the alarm time is still ahead, otherwise tomorrow.
+    tm dayTm = *localtime(&now);
+    if (!(Time{dayTm.tm_hour, dayTm.tm_min} < Time{al.hour, al.min}))
+        dayTm.tm_mday++;
+    dayTm.tm_hour = al.hour;
+    dayTm.tm_min = al.min;
+    dayTm.tm_sec = 0;
+    mktime(&dayTm); // Normalize, also computes tm_yday and tm_wday
+
+    // Skip days on which the alarm is disabled and holidays in one go
+    int days = m_holidays.daysUntilAllowedDay(dayTm, al.weekDayBits);
+    if (days == -1)
+        return TimeEvents::NO_DEADLINE;
+
+    dayTm.tm_mday += days;
+    return mktime(&dayTm);
+}
 
-    // Check the following 7 weekdays, wrapping around to the same weekday in 7 days
-    CyclicCounter currentWeekDay{7, startWeekday};
-    for (int i = 0; i < 7; i++)
-    {
-        currentWeekDay.increment();
-        t1 = alarmTimeAtDay(Alarm1, currentWeekDay);
-        t2 = alarmTimeAtDay(Alarm2, currentWeekDay);
+void Clock::onAlarmTimeReached(time_t deadline)
+{
+    tm deadlineTm = *localtime(&deadline);
 
-        // Return the earliest reacheable alarm on this day if one was found.
-        time = std::min(t1, t2);
-        if (time.isValid())
-        {
-            weekday = currentWeekDay;
-            return true;
-        }
-    }
+    AlarmId reachedAlarm = NoAlarm;
+    if (alarmReached(Alarm1, deadlineTm))
+        reachedAlarm = Alarm1;
+    else if (alarmReached(Alarm2, deadlineTm))
+        reachedAlarm = Alarm2;
 
-    // No next alarm found
-    return false;
+    if (reachedAlarm != NoAlarm && m_alarmCallback)
+        m_alarmCallback(reachedAlarm);
 }
 
-Clock::Time Clock::alarmTimeAtDay(AlarmId alarmId, int weekday) const
+bool Clock::nextAlarm(int &weekday, int &hour, int &min, const Settings::Values &settings) const
 {
-    if (m_alarm[alarmId].mode != Settings::AlarmMode::Off &&
-        m_alarm[alarmId].enabledOnWeekDay(weekday))
-        return {m_alarm[alarmId].hour, m_alarm[alarmId].min};
-    else
-        return Time();
+    // If the next alarm will be skipped, deliver the one after it
+    const AlarmSummary &alarm = 
+        settings.skipNextAlarm ? m_snapshot.alarmAfterNext : m_snapshot.nextAlarm;
+    if (!alarm.valid)
+        return false; // No alarm enabled
+
+    weekday = alarm.weekday;
+    hour = alarm.hour;
+    min = alarm.min;
+    return true;
 }
 
-bool Clock::alarmReached(AlarmId id) const
+bool Clock::alarmReached(AlarmId id, const tm &tm) const
 {
     const Settings::Alarm &al = m_alarm[id];
     return 
-        m_tm.tm_min == al.min && 
-        m_tm.tm_hour == al.hour && 
-        al.enabledOnWeekDay(m_tm.tm_wday) && 
-        al.mode != Settings::AlarmMode::Off;
+        tm.tm_min == al.min && 
+        tm.tm_hour == al.hour && 
+        al.enabledOnWeekDay(tm.tm_wday) && 
+        al.mode != Settings::AlarmMode::Off &&
+        !m_holidays.isHoliday(tm.tm_year, tm.tm_yday);
 }
 
 bool Clock::Time::operator <(const Time &other) const
@@ -243,14 +761,3 @@ bool Clock::Time::operator <(const Time &other) const
         return false;
     return min < other.min;
 }
-
-bool Clock::Time::operator <=(const Time &other) const
-{
-    return !(other < *this);
-}
-
-bool Clock::Time::isValid() const
-{
-    return hour >= 0 && hour < 24 && min >= 0 && min < 60;
-}
-
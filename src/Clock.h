@@ -1,12 +1,16 @@
 #pragma once
 
 #include "DaylightSavingTime.h"
-#include "PicoClockHw/Rtc.h"
-#include "PicoClockHw/Ntp.h"
+#include "HolidayCalendar.h"
+#include "NtpTimeSource.h"
+#include "RtcCalibrator.h"
+#include "RtcTimeSource.h"
+#include "PicoClockHw/TimerWheel.h"
 #include "Settings.h"
+#include "TimeEvents.h"
 #include "Utils/CyclicCounter.h"
 
-#include <memory>
+#include <functional>
 #include <time.h>
 
 class Clock
@@ -20,16 +24,85 @@ public:
         AlarmCount
     };
 
+    struct AlarmSummary
+    {
+        bool valid = false;
+        int weekday = -1;
+        int hour = -1;
+        int min = -1;
+    };
+
+    // Values derived from the current time that the functions need for rendering. They are built
+    // once when the time changes instead of being recomputed by every function on every frame.
+    struct TimeSnapshot
+    {
+        uint32_t sequence = 0; // Incremented each time the snapshot changes
+        int hour24 = 0;
+        int hour12 = 12; // 1 to 12
+        bool morning = true;
+        int min = 0;
+        int sec = 0;
+        int weekday = 0;
+        int barWidth = 0; // Full 3-pixel steps of the seconds progress bar
+        int barPhase = 0; // Seconds within the current step
+        int year = 1970;
+        int month = 1; // 1 to 12
+        int day = 1; // Of the month
+        char yearDigits[5] = "1970"; // Formatted when the year changes, not on every frame
+
+        // Taken from the scheduled alarm event
+        AlarmSummary nextAlarm;
+        AlarmSummary alarmAfterNext;
+
+        // Date and time to be modified by the user and passed to Clock::set()
+        tm dateTime() const
+        {
+            tm dateTime = {};
+            dateTime.tm_year = year - 1900;
+            dateTime.tm_mon = month - 1;
+            dateTime.tm_mday = day;
+            dateTime.tm_hour = hour24;
+            dateTime.tm_min = min;
+            dateTime.tm_sec = sec;
+            dateTime.tm_wday = weekday;
+            return dateTime;
+        }
+    };
+
+    static const int MAX_TIME_SOURCES = 4;
+
     Clock(int tickPerSec);
 
+    // The RTC and NTP are added by the clock. Others, e.g. GPS, may be added before the first
+    // sync. Return false if there are too many sources.
+    bool addTimeSource(TimeSource *source);
+
+    // Sync from the best source now, then periodically. Called at startup, by startSyncFromNtp()
+    // once the network is up or directly without network. A later call only syncs now, e.g. when
+    // NTP became available.
+    void startPeriodicSync();
     void startSyncFromNtp();
     void startSyncToRtc()
     {
         m_rtcSync = SyncingToRtc;
     }
     
-    void tick(bool &clockAdjusted, AlarmId &reachedAlarm, Settings &settings);
+    void tick(bool &clockAdjusted);
     void setAlarm(AlarmId id, const Settings::Alarm &al);
+
+    // Calibration of the RTC as persisted. The callback is called from interrupt context when it
+    // changed and needs to be persisted again.
+    void setRtcCalibration(const Settings::RtcCalibration &calibration);
+    void setRtcCalibrationCallback(std::function<void(const Settings::RtcCalibration &)> c)
+    {
+        m_rtcCalibrationCallback = c;
+    }
+
+    // The callback is called from interrupt context when an alarm time is reached.
+    void setAlarmCallback(std::function<void(AlarmId id)> c)
+    {
+        m_alarmCallback = c;
+    }
     bool nextAlarm(int &weekday, int &hour, int &min, const Settings::Values &settings) const;
 
     bool isAlarmOn() const
@@ -46,61 +119,129 @@ public:
     {
         m_tickCount = 0;
     }
-    const tm &get() const
+    const TimeSnapshot &snapshot() const
     {
-        return m_tm;
+        return m_snapshot;
+    }
+
+    // Current time as unix time considering DST, in the base used by events().
+    time_t now() const
+    {
+        return m_timeConsideringDst;
+    }
+
+    TimeEvents &events()
+    {
+        return m_events;
     }
     void set(const tm &tm);
     
     bool hasRtc() const
     {
-        return m_rtc.operator bool();
+        return m_rtcSource.isAvailable();
     }
 
     Rtc *rtc()
     {
-        return m_rtc.get();
+        return m_rtcSource.rtc();
     }
 
 private:
     struct Time
     {
-        // Initialize with too high values, so that isValid returns false by default, and another
-        // object with valid time is regarded as smaller.
-        int hour = 99;
-        int min = 99;
+        int hour;
+        int min;
 
         bool operator <(const Time &other) const;
-        bool operator <=(const Time &other) const;
-        bool isValid() const;
     };
 
-    void onNtpTimeReceived(time_t utcTime, uint32_t ms);
-    bool alarmReached(AlarmId id) const;
-    bool nextAlarmAfter(
-        int startWeekday, const Time &startTime, int &weekday, Clock::Time &time) const;
-    Time alarmTimeAtDay(AlarmId alarmId, int weekday) const;
+    bool restoreAfterWarmRestart();
+    void saveForWarmRestart() const;
+    void onRtcProbed(bool setTime, bool present);
+    void onRtcSnapshot(bool setTime, bool ok, const Rtc::Snapshot &snapshot);
+    void restoreRtcAgingOffset();
+    void writeRtcAgingOffset();
+    void onRtcAgingOffsetWritten(int8_t agingOffset, bool ok);
+    int64_t startRtcResync(TimerWheel::TimerId id);
+    void onRtcWritten(bool ok);
+    void onRtcSecond(uint64_t edgeUs);
+    void onRtcMeasured(bool ok, const tm &rtcTime);
+    int64_t clockUsAt(uint64_t timeUs) const;
+    int64_t resync(TimerWheel::TimerId id);
+    void syncFromBestSource(const TimeSource *failedSource = nullptr);
+    void onTimeSample(TimeSource *source, bool ok, const TimeSource::Sample &sample);
+    bool accepts(const TimeSource &source) const;
+    void estimateDriftFromRtc(uint64_t edgeUs);
+    void estimateDrift(time_t referenceTime, uint32_t us);
+    void correctDrift();
+    bool alarmReached(AlarmId id, const tm &tm) const;
+    time_t nextAlarmTime(time_t now) const;
+    time_t nextTimeOfAlarm(AlarmId id, time_t now) const;
+    void onAlarmTimeReached(time_t deadline);
+    time_t nextDstTransition(time_t now);
+    void onDstTransition(time_t deadline);
+    void updateDst();
     void setTmFromTime();
+    void updateSnapshot();
+    void updateAlarmSummary();
     void setFromNonDstConsideringTm(tm tm); 
 
+    // Maintenance of the RTC once the clock is synced from a better source
     enum RtcSync
     {
-        SyncingFromRtc,
+        MeasuringRtc, // Measuring the offset of the RTC after an NTP sync
         SyncingToRtc,
         SyncDone
     };
 
     CyclicCounter m_tickCount;
-    std::unique_ptr<Rtc> m_rtc; // As unique_ptr so that it can be easily disabled
-    std::unique_ptr<Ntp> m_ntp;
-    RtcSync m_rtcSync = SyncingFromRtc;
-    int m_lastRtcSec;
+    RtcTimeSource m_rtcSource;
+    NtpTimeSource m_ntpSource;
+    TimeSource *m_sources[MAX_TIME_SOURCES] = {};
+    int m_sourceCount = 0;
+    const TimeSource *m_syncSource = nullptr; // Source of the current time, null if unknown
+    time_t m_syncTime = 0; // When it was synced, in the base of m_time
+
+    RtcSync m_rtcSync = SyncDone;
+    bool m_rtcRequestPending = false; // Waiting for the end of an RTC read or write
+    int64_t m_rtcEdgeClockUs = 0; // Time of the clock at the edge at which the RTC is read
+    bool m_measureRtcAfterWrite = false;
+    RtcCalibrator m_rtcCalibrator;
+    bool m_hasRtcCalibration = false; // Set from the settings
+    bool m_rtcAgingOffsetPending = false; // The RTC does not run with the calibrated offset yet
+    bool m_rtcAgingOffsetWriting = false;
+    bool m_persistRtcCalibration = false; // Once the aging offset is written
+    std::function<void(const Settings::RtcCalibration &)> m_rtcCalibrationCallback;
+    uint64_t m_lastTickUs = 0; // As returned by Platform::timeUs()
     Settings::Alarm m_alarm[AlarmCount];
 
     DaylightSavingTime m_dst;
+    HolidayCalendar m_holidays;
+    time_t m_dstOffset = 0; // Offset currently applied for DST, updated on DST transitions
     
     time_t m_time = 0; // Current time as unix time, local (not UTC), not considering DST
+    time_t m_timeConsideringDst = 0;
     tm m_tm = {}; // Current time as tm, considering DST
+    TimeSnapshot m_snapshot;
+    time_t m_snapshotAlarmDeadline = TimeEvents::NO_DEADLINE;
 
     bool m_clockAdjusted = true;
+
+    // Drift of the tick source measured between NTP syncs, compensated by occasionally moving 
+    // m_tickCount by one tick. Positive if the clock would run slow.
+    int32_t m_driftCentiPpm = 0; // In 0.01 ppm
+    int32_t m_driftCorrectionNs = 0; // Not yet compensated correction
+    int m_tickCorrection = 0; // Tick correction to apply at the middle of the current second
+    time_t m_lastNtpSyncTime = -1; // In the base of m_time, -1 if unknown
+    bool m_syncedFromNtp = false;
+    TimerWheel::TimerId m_resyncTimer = -1;
+
+    // Start of the drift measurement against the 1 Hz output of the RTC
+    time_t m_rtcDriftReferenceTime = -1; // In the base of m_time, -1 if not started
+    int64_t m_rtcDriftReferenceOffsetUs = 0;
+
+    TimeEvents m_events{std::bind(&Clock::now, this)};
+    int m_alarmEvent = -1;
+    int m_dstEvent = -1;
+    std::function<void(AlarmId id)> m_alarmCallback;
 };
\ No newline at end of file
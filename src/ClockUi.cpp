@@ -2,8 +2,15 @@
 #include "Utils/Trace.h"
 #include "UiTexts.h"
 
+#include "PicoClockHw/BootProfiler.h"
 #include "PicoClockHw/Display.h"
+#include "PicoClockHw/EventJournal.h"
 #include "PicoClockHw/Platform.h"
+#include "PicoClockHw/TimerWheel.h"
+#include "PicoClockHw/Crc32.h"
+#include "PicoClockHw/Flash.h"
+#include "PicoClockHw/FlashLayout.h"
+#include "PicoClockHw/I2cBus.h"
 
 #include "Functions/Action.h"
 #include "Functions/Alarm.h"
@@ -16,8 +23,14 @@
 #include "Functions/Submenu.h"
 #include "Functions/Time.h"
 #include "Functions/Temperature.h"
+#include "Functions/TemperatureTrend.h"
 #include "Functions/WifiStatus.h"
 
+#include <hardware/sync.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <iomanip>
 
@@ -29,6 +42,7 @@ namespace
     const float BRIGHTNESS_BOOST_PERCENT = 20;
     const int STOP_RINGING_AFTER_SEC = 60 * 5; // Stop ringing after 5 minutes
     const int AUTO_SCROLL_DELAY_SEC = 20;
+    const int64_t FRAME_US = 1000000 / Display::FRAME_RATE;
 }
 
 // Make m_clock tick at the display frame rate, so that calculations are simpler.
@@ -36,6 +50,24 @@ ClockUi::ClockUi() : m_clock(Display::FRAME_RATE)
 {
     TRACE << "Constructor";
 
+    // Consider the construction as the last user input, so that the brightness boost and auto 
+    // scroll delay apply after power up.
+    m_lastUserInputUs = Platform::timeUs();
+
+    // Register callbacks for what happens at given times instead of checking it on every second.
+    using namespace std::placeholders;
+    m_clock.setAlarmCallback(std::bind(&ClockUi::onAlarmReached, this, _1));
+    m_ringingEvent = m_clock.events().add(
+        std::bind(&ClockUi::nextRingingStep, this, _1), std::bind(&ClockUi::onRingingStep, this, _1));
+    m_hourlyChimeEvent = m_clock.events().add(
+        std::bind(&ClockUi::nextHourlyChime, this, _1), std::bind(&ClockUi::onHourlyChime, this, _1));
+    m_autoScrollEvent = m_clock.events().add(
+        std::bind(&ClockUi::nextAutoScrollStep, this, _1), 
+        std::bind(&ClockUi::onAutoScrollStep, this, _1));
+    m_temperatureSampleEvent = m_clock.events().add(
+        std::bind(&ClockUi::nextTemperatureSample, this, _1), 
+        std::bind(&ClockUi::onTemperatureSample, this, _1));
+
     // Bind buttons callbacks to handlers
     m_setButton.setPressedCallback(std::bind(&ClockUi::onSetButtonPressed, this));
     m_upButton.setPressedCallback(std::bind(&ClockUi::onUpOrDownButtonPressed, this, AbstractFunction::Up));
@@ -50,6 +82,11 @@ ClockUi::ClockUi() : m_clock(Display::FRAME_RATE)
     initHorizScrolling(); // If the selected function needs to scroll
     m_clock.setAlarm(Clock::Alarm1, m_settings.get().alarm1);
     m_clock.setAlarm(Clock::Alarm2, m_settings.get().alarm2);
+    m_clock.setRtcCalibration(m_settings.get().rtcCalibration);
+    m_clock.setRtcCalibrationCallback([this](const Settings::RtcCalibration &calibration)
+    {
+        m_settings.modify()->rtcCalibration = calibration;
+    });
 
     TRACE << "Add root level functions";
     addFunction<Time>(Time::HourMinSec);
@@ -57,6 +94,7 @@ ClockUi::ClockUi() : m_clock(Display::FRAME_RATE)
     addFunction<Time>(Time::HourMin);
     m_dateFuncIdx = addFunction<Date>();
     m_temperatureFuncIdx = addFunction<Temperature>();
+    addFunction<TemperatureTrend>(&m_temperatureHistory);
     Submenu *alarmSubmenu =
         addFunctionAndReturnPtr<AlarmSubmenu>(&m_rootMenu);
     Submenu *countdownSubmenu = 
@@ -65,6 +103,8 @@ ClockUi::ClockUi() : m_clock(Display::FRAME_RATE)
         addFunctionAndReturnPtr<Submenu>(uiText(TextId::Stopwatch), &m_rootMenu);
     addFunction<WifiStatus>();
     addFunction<Options>();
+    if (m_rootMenu.size() != Settings::FUNCTION_COUNT)
+        TRACE << "Settings::FUNCTION_COUNT should be" << m_rootMenu.size();
 
     TRACE << "Add functions of the alarm submenu";
     alarmSubmenu->addFunction<SkipNextAlarm>(this);
@@ -94,6 +134,7 @@ ClockUi::ClockUi() : m_clock(Display::FRAME_RATE)
     adjustBrightness();
 
     TRACE << "Constructed";
+    BootProfiler::mark(BootProfiler::UiReady);
 }
 
 template <class FunctionType, typename... CtorParams>
@@ -116,88 +157,168 @@ FunctionType *ClockUi::addFunctionAndReturnPtr(CtorParams... ctorParams)
     return rawPtr;
 }
 
-void ClockUi::onFrameCallback()
+void RAM_FUNC(ClockUi::onFrameCallback)()
 {
-    // Make the clock and some functions tick
+    // Frames are missed while interrupts are disabled, e.g. for about 45 ms when a flash sector is
+    // erased. Only gaps of more than one and a half frame count, so that jitter does not, and at
+    // most a second is caught up, to bound the time spent here.
+    uint64_t nowUs = Platform::timeUs();
+    int frames = 1;
+    int64_t elapsedUs = nowUs - m_lastFrameUs;
+    if (m_lastFrameUs != 0 && elapsedUs > FRAME_US * 3 / 2)
+        frames = std::min<int64_t>((elapsedUs + FRAME_US / 2) / FRAME_US, Display::FRAME_RATE);
+    m_lastFrameUs = nowUs;
+
+    // Make the clock and some functions tick, also for the missed frames
     bool clockAdjusted = false;
-    Clock::AlarmId reachedAlarm = Clock::NoAlarm;
-    m_clock.tick(clockAdjusted, reachedAlarm, m_settings);
-    m_countdownFunc->tick();
-    m_stopwatchFunc->tick();
+    for (int i = 0; i < frames; i++)
+    {
+        bool adjusted;
+        m_clock.tick(adjusted);
+        clockAdjusted = clockAdjusted || adjusted;
+        m_countdownFunc->tick();
+        m_stopwatchFunc->tick();
+    }
 
     // Make the display get refreshed if time did not just advance normally.
     if (clockAdjusted)
         m_forceRefresh = true;
+
+    adjustBrightness();
+
+#ifdef SIMULATE_BUTTONS_FROM_STDIO
+    handleSimulatedButton();
+#endif
+    renderFrame();
+
+    // The time functions are refreshed on the frame after the clock was set.
+    BootProfiler::mark(BootProfiler::FirstFrame);
+    if (BootProfiler::reached(BootProfiler::UiReady) && 
+        BootProfiler::reached(BootProfiler::TimeKnown))
+        BootProfiler::mark(BootProfiler::FirstCorrectFrame);
+}
+
+void ClockUi::onAlarmReached(Clock::AlarmId id)
+{
+    if (m_settings.get().skipNextAlarm)
+    {
+        // This alarm must be skipped. Disable the "skip next alarm" function and do not ring.
+        EventJournal::log(EventJournal::AlarmFired, id, 1);
+        m_settings.modify()->skipNextAlarm = false;
+        return;
+    }
+    EventJournal::log(EventJournal::AlarmFired, id);
+
+    // Start ringing with a first beep now, then continue on every second.
+    m_alarmRinging = 
+        id == Clock::Alarm1 ? m_settings.get().alarm1.mode : m_settings.get().alarm2.mode;
+    m_ringingForSecs = 0;
+    onRingingStep(m_clock.now());
+    m_clock.events().update(m_ringingEvent);
+}
+
+time_t ClockUi::nextRingingStep(time_t now) const
+{
+    if (m_alarmRinging == Settings::AlarmMode::Off)
+        return TimeEvents::NO_DEADLINE;
+
+    return now + 1;
+}
+
+void ClockUi::onRingingStep(time_t deadline)
+{
+    if (m_alarmRinging == Settings::AlarmMode::Off)
+        return;
+
+    m_ringingForSecs++;
     
-    // Start ringing if an alarm was reached.
-    if (reachedAlarm != Clock::NoAlarm)
+    if (m_alarmRinging == Settings::AlarmMode::Gradual)
+        m_buzzer.beepForMs(m_ringingForSecs);
+    else
+        m_buzzer.beepForMs(500);
+
+    if (m_ringingForSecs >= STOP_RINGING_AFTER_SEC)
+        m_alarmRinging = Settings::AlarmMode::Off;
+}
+
+time_t ClockUi::nextHourlyChime(time_t now) const
+{
+    return now - now % 3600 + 3600;
+}
+
+void ClockUi::onHourlyChime(time_t deadline)
+{
+    if (m_alarmRinging == Settings::AlarmMode::Off && hourlyChimeActive())
     {
-        m_alarmRinging = 
-            reachedAlarm == Clock::Alarm1 ? 
-            m_settings.get().alarm1.mode : m_settings.get().alarm2.mode;
-        m_ringingForSecs = 0;
+        TRACE << "Hourly chime";
+        m_buzzer.beepForMs(100);
     }
+}
 
-    adjustBrightness();
+time_t ClockUi::nextTemperatureSample(time_t now) const
+{
+    if (!m_clock.hasRtc())
+        return TimeEvents::NO_DEADLINE;
+
+    return now - now % 60 + 60;
+}
+
+void ClockUi::onTemperatureSample(time_t deadline)
+{
+    Rtc *rtc = m_clock.rtc();
+    if (rtc == nullptr)
+        return;
+
+    float temp = rtc->temperature();
+    if (!std::isnan(temp))
+        m_temperatureHistory.addMinuteSample(deadline, std::lround(temp * 4));
+}
 
-    if (m_clock.tickCount() == 0)
+time_t ClockUi::nextAutoScrollStep(time_t now) const
+{
+    return now - now % AUTO_SCROLL_DELAY_SEC + AUTO_SCROLL_DELAY_SEC;
+}
+
+void ClockUi::onAutoScrollStep(time_t deadline)
+{
+    // Autoscroll if enabled, not editing something, the user is in the root menu and has not 
+    // touched any button for a while.
+    if (!m_settings.get().autoScroll || 
+        m_editedValueIndex != NoEditing || 
+        m_currentMenu != &m_rootMenu ||
+        secondsWithoutUserInput() < AUTO_SCROLL_DELAY_SEC)
+        return;
+
+    switch(deadline % 60)
     {
-        if (m_alarmRinging != Settings::AlarmMode::Off)
-        {
-            m_ringingForSecs++;
-            
-            if (m_alarmRinging == Settings::AlarmMode::Gradual)
-                m_buzzer.beepForMs(m_ringingForSecs);
-            else
-                m_buzzer.beepForMs(500);
+        case 0:
+            m_curFuncIdx = m_lastUsedTimeFunction;
+            startVertScrolling(-1);
+            break;
 
-            if (m_ringingForSecs >= STOP_RINGING_AFTER_SEC)
-                m_alarmRinging = Settings::AlarmMode::Off;
-        }
-        else if (hourlyChimeActive() && m_clock.get().tm_min == 0 && m_clock.get().tm_sec == 0)
-        {
-            TRACE << "Hourly chime";
-            m_buzzer.beepForMs(100);
-        }
+        case AUTO_SCROLL_DELAY_SEC:
+            m_curFuncIdx = m_dateFuncIdx;
+            startVertScrolling(-1);
+            break;
 
-        // Autoscroll if enabled, not editing something, the user is in the root menu and has not 
-        // touched any button for a while.
-        m_secondsWithoutUserInput++;
-        if (m_settings.get().autoScroll && 
-            m_editedValueIndex == NoEditing && 
-            m_currentMenu == &m_rootMenu &&
-            m_secondsWithoutUserInput >= AUTO_SCROLL_DELAY_SEC)
-        {
-            switch(m_clock.get().tm_sec)
-            {
-                case 0:
-                    m_curFuncIdx = m_lastUsedTimeFunction;
-                    startVertScrolling(-1);
-                    break;
-
-                case AUTO_SCROLL_DELAY_SEC:
-                    m_curFuncIdx = m_dateFuncIdx;
-                    startVertScrolling(-1);
-                    break;
-
-                case AUTO_SCROLL_DELAY_SEC * 2:
-                    // Show the temperature if the RTC is available, otherwise go back to time.
-                    if (m_clock.rtc() != nullptr)
-                       m_curFuncIdx = m_temperatureFuncIdx;
-                    else
-                        m_curFuncIdx = m_lastUsedTimeFunction;
-
-                    startVertScrolling(-1);
-                    break;
-            }
-        }
+        case AUTO_SCROLL_DELAY_SEC * 2:
+            // Show the temperature if the RTC is available, otherwise go back to time.
+            if (m_clock.rtc() != nullptr)
+                m_curFuncIdx = m_temperatureFuncIdx;
+            else
+                m_curFuncIdx = m_lastUsedTimeFunction;
+
+            startVertScrolling(-1);
+            break;
     }
+}
 
-    handleControlFromConsole();
-    renderFrame();
+int ClockUi::secondsWithoutUserInput() const
+{
+    return (Platform::timeUs() - m_lastUserInputUs) / 1000000;
 }
 
-void ClockUi::renderFrame()
+void RAM_FUNC(ClockUi::renderFrame)()
 {
     // If vertically scroling, update m_vertScrollPos at the right frequency.
     if (m_vertScrollDir != 0 && m_vertScrollFrameCounter.increment())
@@ -293,7 +414,7 @@ void ClockUi::renderFrame()
     m_forceRefresh = false;
 }
 
-void ClockUi::renderIndicators()
+void RAM_FUNC(ClockUi::renderIndicators)()
 {
     // Render simple indicators
     m_frameBuffer.putIndicator(Bitmap::MoveOn, m_settings.get().autoScroll);
@@ -305,7 +426,7 @@ void ClockUi::renderIndicators()
     if (m_clock.isAlarmOn())
     {
         if (m_settings.get().skipNextAlarm)
-            alarmOnIndicator = m_clock.get().tm_sec % 2 != 0;
+            alarmOnIndicator = m_clock.snapshot().sec % 2 != 0;
         else
             alarmOnIndicator = true;
     } else
@@ -313,14 +434,38 @@ void ClockUi::renderIndicators()
     m_frameBuffer.putIndicator(Bitmap::AlarmOn, alarmOnIndicator);
 }
 
+#ifdef SIMULATE_BUTTONS_FROM_STDIO
+// Called on each frame, so that the keys received by the main loop are handled in the same 
+// context as the buttons. Enter triggers SET and the arrow keys trigger UP and DOWN.
+void ClockUi::handleSimulatedButton()
+{
+    // The main loop cannot run during this interrupt, so the key is not lost between the two
+    // accesses.
+    int key = m_simulatedButtonKey;
+    m_simulatedButtonKey = -1;
+    switch (key)
+    {
+        case 66: // Upwards Arrow
+            onUpOrDownButtonPressed(AbstractFunction::Down);
+            break;
+        case 65: // Downwards Arrow
+            onUpOrDownButtonPressed(AbstractFunction::Up);
+            break;
+        case 13: // Enter
+            onSetButtonPressed();
+            break;
+    }
+}
+#endif
+
 void ClockUi::handleControlFromConsole()
 {
     // This method allows interacting with the program via the serial I/O, for example using Tera Term.
     // It even works if the Pico is not in the Pico Clock Green device.
 
-    // Enable this section to display all pixels on the standard output in ASCII.
+    // Enable this section to display all pixels on the standard output in ASCII, on each run of
+    // the main loop.
 #if 0
-    if (m_clock.tickCount() % 4 == 0)
     {
         for (int y = 0; y < Display::HEIGHT; y++)
         {
@@ -338,23 +483,187 @@ void ClockUi::handleControlFromConsole()
     }
 #endif
 
-    // Enable this section to simulate the three buttons using the standard input. Enter triggers SET
-    // and the arrow keys trigger UP and DOWN.
-#ifdef SIMULATE_BUTTONS_FROM_STDIO
-    int c = Platform::getCharNonBlocking();
+    int c;
+    while ((c = Platform::getCharNonBlocking()) >= 0)
+        handleConsoleCommand(c);
+}
+
+void ClockUi::handleConsoleCommand(int c)
+{
     switch (c)
     {
-        case 66: // Upwards Arrow
-            onUpOrDownButtonPressed(AbstractFunction::Down);
+        // Enable this section to simulate the three buttons using the standard input.
+#ifdef SIMULATE_BUTTONS_FROM_STDIO
+        case 66:
+        case 65:
+        case 13:
+            m_simulatedButtonKey = c;
             break;
-        case 65: // Downwards Arrow
-            onUpOrDownButtonPressed(AbstractFunction::Up);
+#endif
+
+        // Diagnostic commands
+        case 't':
+        {
+            TimerWheel::Stats stats = TimerWheel::stats();
+            std::cout << "Timers: active " << stats.activeTimers 
+                      << ", max active " << stats.maxActiveTimers 
+                      << ", max callback latency " << stats.maxCallbackLatencyUs << " us" << std::endl;
+            TimerWheel::resetStats();
             break;
-        case 13: // Enter
-            onSetButtonPressed();
+        }
+        case 'r': // Software reset, to check the warm restart
+            Platform::reboot();
+            break;
+        case 'c':
+            printCrcBenchmark();
+            break;
+        case 'f':
+        {
+            Flash::Stats stats = Flash::stats();
+            std::cout << "Flash: " << stats.commits << " commits, " << stats.erases << " erases, "
+                      << stats.pagePrograms << " page programs, interrupts blocked max " 
+                      << stats.maxBlockedUs << " us (last commit " 
+                      << stats.lastCommitMaxBlockedUs << " us)" << std::endl;
+            break;
+        }
+        case 's':
+        {
+            Settings::Stats stats = m_settings.stats();
+            std::cout << "Settings: " << stats.modifyCalls << " modifications, " << stats.commits 
+                      << " commits (" << stats.changedFields << " fields), " 
+                      << stats.avoidedWrites << " writes avoided" << std::endl;
+            break;
+        }
+        case 'w':
+        {
+            // Parsed by tools/flash_wear.py, which projects the remaining life of the sectors.
+            uint32_t interrupts = save_and_disable_interrupts();
+            Flash::Wear wear = Flash::wear();
+            Flash::Stats stats = Flash::stats();
+            time_t now = m_clock.now();
+            restore_interrupts(interrupts);
+            std::cout << "Flash wear: time " << now << ", sectors " 
+                      << FlashLayout::SETTINGS_SECTOR_COUNT << ", erases " << wear.erases 
+                      << ", page programs " << wear.pagePrograms << ", skipped writes " 
+                      << wear.skippedWrites << ", blocked " << wear.blockedMs << " ms, max erase "
+                      << stats.maxEraseUs << " us, max program " << stats.maxProgramUs << " us" 
+                      << std::endl;
+            break;
+        }
+        case 'j':
+        {
+            // Records as hex, to be decoded by tools/journal_decode.py
+            EventJournal::forEach([](const EventJournal::Record &record)
+            {
+                auto bytes = reinterpret_cast<const uint8_t *>(&record);
+                std::cout << "J ";
+                for (size_t i = 0; i < sizeof(record); i++)
+                    std::cout << std::hex << std::setw(2) << std::setfill('0') << int(bytes[i]);
+                std::cout << std::dec << std::endl;
+            });
+            EventJournal::Stats stats = EventJournal::stats();
+            std::cout << "Journal: " << stats.staged << " staged, " << stats.dropped << " dropped, "
+                      << stats.pagePrograms << " page programs, " << stats.erases << " erases" 
+                      << std::endl;
+            break;
+        }
+        case 'x':
+        {
+            // Hit rate of the XIP cache since the last 'x', to check that the code running on 
+            // every frame stays out of the flash.
+            Platform::XipCacheStats stats = Platform::xipCacheStats();
+            std::cout << "XIP cache: " << stats.hits << " hits / " << stats.accesses << " accesses";
+            if (stats.accesses != 0)
+                std::cout << " (" << (uint64_t)stats.hits * 1000 / stats.accesses / 10.0 << " %)";
+            std::cout << std::endl;
+            Platform::resetXipCacheStats();
+            break;
+        }
+        case 'a':
+        {
+            // The calibration may be updated from interrupts meanwhile.
+            Settings::RtcCalibration calibration = m_settings.snapshot().rtcCalibration;
+            std::cout << "RTC calibration: aging offset " << int(calibration.agingOffset) << ", "
+                      << calibration.adjustments << " adjustments, last at " 
+                      << calibration.lastAdjustmentTime << ", drift history";
+            for (int16_t drift : calibration.driftHistory)
+                std::cout << " " << drift / 100.0 << " ppm";
+            std::cout << std::endl;
             break;
+        }
+        case 'i':
+        {
+            // Latencies include the wait in the queue, as upper bounds of power of 2 buckets.
+            for (int kind = 0; kind < Rtc::TransactionCount; kind++)
+            {
+                I2cBus::Stats stats = I2cBus::stats(kind);
+                std::cout << "I2C " << Rtc::transactionName(static_cast<Rtc::Transaction>(kind)) 
+                          << ": " << stats.transfers << " transfers, " << stats.nacks << " NACKs, "
+                          << stats.timeouts << " timeouts, " << stats.aborts << " aborts, "
+                          << "latency p50 " << I2cBus::latencyPercentileUs(stats, 50) << " us, p90 " 
+                          << I2cBus::latencyPercentileUs(stats, 90) << " us, p99 " 
+                          << I2cBus::latencyPercentileUs(stats, 99) << " us, max " 
+                          << stats.maxLatencyUs << " us" << std::endl;
+            }
+            I2cBus::Health health = I2cBus::health();
+            std::cout << "I2C bus: " << health.recoveries << " recoveries (" << health.stuckSda 
+                      << " with SDA held low), " << health.consecutiveFailures 
+                      << " consecutive failures" << std::endl;
+            break;
+        }
+        case 'b':
+        {
+            // Timeline since reset, with the time since the previous stage reached
+            uint64_t previousUs = 0;
+            for (int i = 0; i < BootProfiler::StageCount; i++)
+            {
+                auto stage = static_cast<BootProfiler::Stage>(i);
+                std::cout << "Boot " << BootProfiler::stageName(stage) << ": ";
+                uint64_t stageUs = BootProfiler::stageUs(stage);
+                if (stageUs == 0)
+                {
+                    std::cout << "not reached" << std::endl;
+                    continue;
+                }
+                std::cout << stageUs << " us";
+                if (stageUs >= previousUs)
+                    std::cout << " (+" << stageUs - previousUs << ")";
+                std::cout << std::endl;
+                previousUs = stageUs;
+            }
+            break;
+        }
+    }
+}
+
+void ClockUi::printCrcBenchmark()
+{
+    // Cost of verifying the settings at boot depending on their size. This runs from the main
+    // loop, so the frame interrupt and the timers may preempt a measurement: the shortest of
+    // several runs is kept. The first run also warms the XIP cache for both methods.
+    const int RUNS = 8;
+    const uint8_t *content = FlashLayout::content(FlashLayout::SETTINGS_OFFSET);
+    for (size_t size = 64; size <= FLASH_SECTOR_SIZE; size *= 2)
+    {
+        uint32_t dmaCrc = 0, softwareCrc = 0;
+        uint64_t dmaUs = UINT64_MAX, softwareUs = UINT64_MAX;
+        for (int run = 0; run < RUNS; run++)
+        {
+            uint64_t start = Platform::timeUs();
+            dmaCrc = Crc32::compute(content, size);
+            uint64_t us = Platform::timeUs() - start;
+            if (run > 0)
+                dmaUs = std::min(dmaUs, us);
+
+            start = Platform::timeUs();
+            softwareCrc = Crc32::computeBySoftware(content, size);
+            us = Platform::timeUs() - start;
+            if (run > 0)
+                softwareUs = std::min(softwareUs, us);
+        }
+        std::cout << "CRC of " << size << " bytes: DMA " << dmaUs << " us, software " 
+                  << softwareUs << " us" << (dmaCrc == softwareCrc ? "" : ", mismatch!") << std::endl;
     }
-#endif
 }
 
 bool ClockUi::hourlyChimeActive() const
@@ -371,7 +680,7 @@ bool ClockUi::hourlyChimeActive() const
     return false;
 }
 
-void ClockUi::adjustBrightness()
+void RAM_FUNC(ClockUi::adjustBrightness)()
 {
     float ambientLight = m_display.ambientLight();
 
@@ -392,7 +701,7 @@ void ClockUi::adjustBrightness()
                 m_settings.get().brightnessDark + ambientLight * (m_settings.get().brightnessDim - m_settings.get().brightnessDark) / DIM_AMBIENT_LIGHT;
 
             if (
-                m_secondsWithoutUserInput < BRIGHTNESS_BOOST_AFTER_USER_INPUT_FOR_SEC &&
+                secondsWithoutUserInput() < BRIGHTNESS_BOOST_AFTER_USER_INPUT_FOR_SEC &&
                 m_currentMenu->at(m_curFuncIdx)->allowsBrightnessBoost(m_editedValueIndex))
             {
                 // Temporarily increase brightness after user input
@@ -561,7 +870,7 @@ void ClockUi::onUpOrDownButtonPressed(AbstractFunction::Direction direction)
         // restored on the next power up.
         if (m_currentMenu == &m_rootMenu)
         {
-            m_settings.modify().function = m_curFuncIdx;
+            m_settings.modify()->function = m_curFuncIdx;
 
             // Also remember the last used time function is case auto scroll is enabled
             if (m_currentMenu->at(m_curFuncIdx)->isTimeFunction())
@@ -640,7 +949,7 @@ void ClockUi::bringHorizScrollingToRight()
 
 bool ClockUi::onAnyButtonTouched()
 {
-    m_secondsWithoutUserInput = 0;
+    m_lastUserInputUs = Platform::timeUs();
 
     if (m_alarmRinging != Settings::AlarmMode::Off)
     {
@@ -7,6 +7,7 @@
 #include "Bitmap.h"
 #include "Clock.h"
 #include "Settings.h"
+#include "TemperatureHistory.h"
 #include "Functions/AbstractFunction.h"
 
 class Countdown;
@@ -24,6 +25,14 @@ public:
     {
         m_clock.startSyncFromNtp();
     }
+    void startSyncWithoutNetwork()
+    {
+        m_clock.startPeriodicSync();
+    }
+
+    // Execute the commands received from the console. To be called from the main loop, as the
+    // diagnostics take too long for the frame interrupt.
+    void handleControlFromConsole();
 
 private:
     enum EditValue
@@ -42,10 +51,21 @@ private:
     Button m_downButton{K0};
     Buzzer m_buzzer;
     Settings m_settings;
-    int m_secondsWithoutUserInput = 0;
+    TemperatureHistory m_temperatureHistory;
+    uint64_t m_lastUserInputUs = 0;
+    uint64_t m_lastFrameUs = 0; // 0 before the first frame
     bool m_dayLight = false;
     Settings::AlarmMode m_alarmRinging = Settings::AlarmMode::Off;
     int m_ringingForSecs = 0;
+#ifdef SIMULATE_BUTTONS_FROM_STDIO
+    volatile int m_simulatedButtonKey = -1; // Received by the main loop, -1 if none
+#endif
+
+    // Time events, see Clock::events()
+    int m_ringingEvent = -1;
+    int m_hourlyChimeEvent = -1;
+    int m_autoScrollEvent = -1;
+    int m_temperatureSampleEvent = -1;
 
     // Menu and functions
     std::vector<std::unique_ptr<AbstractFunction>> *m_currentMenu = &m_rootMenu;
@@ -85,6 +105,16 @@ private:
     FunctionType *addFunctionAndReturnPtr(CtorParams... ctorParams);
 
     void onFrameCallback();
+    void onAlarmReached(Clock::AlarmId id);
+    time_t nextRingingStep(time_t now) const;
+    void onRingingStep(time_t deadline);
+    time_t nextHourlyChime(time_t now) const;
+    void onHourlyChime(time_t deadline);
+    time_t nextAutoScrollStep(time_t now) const;
+    void onAutoScrollStep(time_t deadline);
+    time_t nextTemperatureSample(time_t now) const;
+    void onTemperatureSample(time_t deadline);
+    int secondsWithoutUserInput() const;
     void renderFrame();
     void onSetButtonPressed();
     void onUpOrDownButtonPressed(AbstractFunction::Direction direction);
@@ -102,6 +132,8 @@ private:
     void startVertScrolling(int dir);
     bool hourlyChimeActive() const;
     void adjustBrightness();
-    void handleControlFromConsole();
+    void handleConsoleCommand(int c);
+    void handleSimulatedButton();
+    void printCrcBenchmark();
     void renderIndicators();
 };
\ No newline at end of file
@@ -33,6 +33,31 @@ time_t DaylightSavingTime::unconsiderDst(time_t time)
         return time;
 }
 
+time_t DaylightSavingTime::nextTransition(time_t time)
+{
+    if (DST_LOCATION != Europe)
+        return -1;
+
+    // Make sure that DST start and end are determined for the year of the given time.
+    isDstActive(time);
+    if (time < m_dstStart)
+        return m_dstStart;
+    if (time < m_dstEnd)
+        return m_dstEnd;
+
+    // Both transitions of this year are passed, so the next one is the DST start of next year.
+    tm nextYearTm = *localtime(&time);
+    nextYearTm.tm_sec = 0;
+    nextYearTm.tm_min = 0;
+    nextYearTm.tm_hour = 0;
+    nextYearTm.tm_mday = 1;
+    nextYearTm.tm_mon = 0;
+    nextYearTm.tm_year++;
+    m_yearStart = 0; // Force the determination, as the check for a year change is approximate
+    isDstActive(mktime(&nextYearTm));
+    return m_dstStart;
+}
+
 bool DaylightSavingTime::isDstActive(time_t time)
 {
     if (DST_LOCATION != Europe)
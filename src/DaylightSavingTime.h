@@ -14,6 +14,10 @@ public:
     time_t considerDst(time_t time);
     time_t unconsiderDst(time_t time);
 
+    // Return the next DST start or end strictly after the given time (both without DST 
+    // consideration), or -1 if DST is not observed.
+    time_t nextTransition(time_t time);
+
 private:
     bool isDstActive(time_t time);
 
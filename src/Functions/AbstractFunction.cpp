@@ -10,7 +10,7 @@ const Settings::Values &AbstractFunction::settings() const
     return m_clockUi->m_settings.get();
 }
 
-Settings::Values &AbstractFunction::modifySettings()
+Settings::Modification AbstractFunction::modifySettings()
 {
     return m_clockUi->m_settings.modify();
 }
@@ -41,7 +41,7 @@ void AbstractFunction::convertHour(int hour24, int &displayedHour, bool &morning
 
 void AbstractFunction::putWeekDay(Bitmap &frame)
 {
-    frame.putWeekDay(clock().get().tm_wday, true);
+    frame.putWeekDay(clock().snapshot().weekday, true);
 }
 
 void AbstractFunction::putAmPmIndicators(Bitmap &frame, bool morning)
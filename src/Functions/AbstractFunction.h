@@ -76,7 +76,7 @@ protected:
 
     // Method to access ClockUi
     const Settings::Values &settings() const;
-    Settings::Values &modifySettings();
+    Settings::Modification modifySettings();
     const Clock &clock() const;
     Clock &clock();
     void convertHour(int hour24, int &displayedHour, bool &morning) const;
@@ -4,6 +4,7 @@
 #include "fonts.h"
 #include "Bitmap.h"
 #include "Clock.h"
+#include "PicoClockHw/Platform.h"
 
 namespace
 {
@@ -28,7 +29,7 @@ namespace
     }
 }
 
-void Alarm::renderFrame(
+void RAM_FUNC(Alarm::renderFrame)(
     Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     std::string prefix = 
@@ -134,12 +135,12 @@ const Settings::Alarm &Alarm::alarmSettings() const
         return settings().alarm2;
 }
 
-Settings::Alarm &Alarm::modifyAlarmSettings()
+Settings::Alarm &Alarm::alarmIn(Settings::Values &values) const
 {
     if (m_alarmId == Alarm1)
-        return modifySettings().alarm1;
+        return values.alarm1;
     else
-        return modifySettings().alarm2;
+        return values.alarm2;
 }
 
 void Alarm::modifyValue(int valueIndex, Direction direction)
@@ -147,17 +148,15 @@ void Alarm::modifyValue(int valueIndex, Direction direction)
     switch(valueIndex)
     {
     case EditingAlarmMode:
-        adjustEnum(modifyAlarmSettings().mode, direction);
+        adjustEnum(alarmIn(*modifySettings()).mode, direction);
         break;
 
     case EditingAlarmHour:
-        adjustField(
-            direction, Hour, m_alarmId == Alarm1 ? modifySettings().alarm1.hour : modifySettings().alarm2.hour);
+        adjustField(direction, Hour, alarmIn(*modifySettings()).hour);
         break;
 
     case EditingAlarmMinute:
-        adjustField(
-            direction, Minute, m_alarmId == Alarm1 ? modifySettings().alarm1.min : modifySettings().alarm2.min);
+        adjustField(direction, Minute, alarmIn(*modifySettings()).min);
         break;
     
     case EditingAlarmWeekDays:
@@ -168,7 +167,7 @@ void Alarm::modifyValue(int valueIndex, Direction direction)
         } else
         {
             // Bottom button toggle the selected weekday
-            modifyAlarmSettings().weekDayBits ^= 1 << m_editedAlarmWeekDay;
+            alarmIn(*modifySettings()).weekDayBits ^= 1 << m_editedAlarmWeekDay;
         }
         break;
     }
@@ -176,7 +175,8 @@ void Alarm::modifyValue(int valueIndex, Direction direction)
 
 void Alarm::finishEditing()
 {
-    auto &alarm = modifyAlarmSettings();
+    Settings::Modification modification = modifySettings();
+    Settings::Alarm &alarm = alarmIn(*modification);
 
     // If no week days were selected, disable the alarm to avoid confusion.
     if (alarm.weekDayBits == 0)
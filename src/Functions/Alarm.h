@@ -25,7 +25,7 @@ private:
     void finishEditing() override;
 
     const Settings::Alarm &alarmSettings() const;
-    Settings::Alarm &modifyAlarmSettings();
+    Settings::Alarm &alarmIn(Settings::Values &values) const; // This alarm in the given values
 
     enum EditableValue
     {
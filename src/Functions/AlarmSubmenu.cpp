@@ -1,6 +1,7 @@
 #include "AlarmSubmenu.h"
 #include "UiTexts.h"
 #include "Clock.h"
+#include "PicoClockHw/Platform.h"
 
 AlarmSubmenu::AlarmSubmenu(
     ClockUi *clockUi, 
@@ -34,7 +35,7 @@ void AlarmSubmenu::onSelect()
     setName(text);
 }
 
-void AlarmSubmenu::renderFrame(
+void RAM_FUNC(AlarmSubmenu::renderFrame)(
     Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     Submenu::renderFrame(frame, editedValueIndex, blinkingCounter, fullRefresh);
@@ -1,6 +1,7 @@
 #include "Countdown.h"
 #include "Utils/Trace.h"
 #include "PicoClockHw/Buzzer.h"
+#include "PicoClockHw/Platform.h"
 
 namespace
 {
@@ -15,7 +16,7 @@ Countdown::Countdown(ClockUi *clockUi, std::vector<std::unique_ptr<AbstractFunct
     TRACE << "m_sec:" << m_sec;
 }
 
-void Countdown::tick()
+void RAM_FUNC(Countdown::tick)()
 {
     if (m_state == Running)
     {
@@ -104,7 +105,7 @@ void Countdown::initCount()
     m_tick = 0;
 }
 
-void Countdown::renderFrame(
+void RAM_FUNC(Countdown::renderFrame)(
     Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     if (editedValueIndex != NoEditing && 
@@ -134,11 +135,11 @@ void Countdown::modifyValue(int valueIndex, Direction direction)
     switch(valueIndex)
     {
         case EditingMin:
-            adjustField(direction, Minute, modifySettings().countdownStartMin);
+            adjustField(direction, Minute, modifySettings()->countdownStartMin);
             break;
 
         case EditingSec:
-            adjustField(direction, Second, modifySettings().countdownStartSec);
+            adjustField(direction, Second, modifySettings()->countdownStartSec);
             break;
     }
 
@@ -146,9 +147,9 @@ void Countdown::modifyValue(int valueIndex, Direction direction)
     if (settings().countdownStartMin == 0 && settings().countdownStartSec == 0)
     {
         if (valueIndex == EditingMin || direction == Up || direction == RepeatedUp)
-            modifySettings().countdownStartSec = 1;
+            modifySettings()->countdownStartSec = 1;
         else 
-            modifySettings().countdownStartSec = 59;
+            modifySettings()->countdownStartSec = 59;
     }
 
     initCount();
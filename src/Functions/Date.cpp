@@ -1,6 +1,7 @@
 #include "Date.h"
 #include "Bitmap.h"
 #include "Clock.h"
+#include "PicoClockHw/Platform.h"
 
 namespace 
 {
@@ -27,10 +28,17 @@ namespace
     }
 }
 
-void Date::renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
+void RAM_FUNC(Date::renderFrame)(
+    Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
+    // Only rendered again when the date changed, not on each change of the snapshot.
+    const Clock::TimeSnapshot &now = clock().snapshot();
+    int date = (now.year * 100 + now.month) * 100 + now.day;
+    bool dateChanged = date != m_renderedDate;
+    m_renderedDate = date;
+
     if (fullRefresh || 
-        (clock().tickCount() == 0 && clock().get().tm_hour == 0 && clock().get().tm_min == 0 && clock().get().tm_sec == 0) ||
+        dateChanged ||
         blinkingCounter == 0 ||
         blinkingCounter == BLINKING_DISAPPEAR_FRAME)
     {
@@ -40,20 +48,20 @@ void Date::renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter,
         if (editedValueIndex == EditingYear)
         {
             if (blinkingCounter < BLINKING_DISAPPEAR_FRAME)
-                frame.drawText(1, 0, std::to_string(clock().get().tm_year + 1900));
+                frame.drawText(1, 0, now.yearDigits);
         } 
         else
         {
             if (editedValueIndex != EditingDay || blinkingCounter<BLINKING_DISAPPEAR_FRAME)
             {
-                frame.draw2DigitsIntWithLeadingZero(0, 0, clock().get().tm_mday);
+                frame.draw2DigitsIntWithLeadingZero(0, 0, now.day);
             }
 
             frame.drawRectangle(10, 3, 11, 3, true);
 
             if (editedValueIndex != EditingMonth || blinkingCounter<BLINKING_DISAPPEAR_FRAME)
             {
-                frame.draw2DigitsIntWithLeadingZero(13, 0, clock().get().tm_mon + 1);
+                frame.draw2DigitsIntWithLeadingZero(13, 0, now.month);
             }
         }
 
@@ -73,7 +81,7 @@ void Date::startEditingValue(int valueIndex)
 
 void Date::modifyValue(int valueIndex, Direction direction)
 {
-    tm tm = clock().get();
+    tm tm = clock().snapshot().dateTime();
 
     switch (valueIndex)
     {
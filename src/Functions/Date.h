@@ -29,4 +29,6 @@ private:
     void startEditingValue(int valueIndex) override;
     void modifyValue(int valueIndex, Direction direction) override;
     void finishEditing() override;
+
+    int m_renderedDate = -1; // As yyyymmdd
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "Options.h"
 #include "UiTexts.h"
 #include "Utils/Trace.h"
+#include "PicoClockHw/Platform.h"
 
 namespace
 {
@@ -10,7 +11,8 @@ namespace
     }
 }
 
-void Options::renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
+void RAM_FUNC(Options::renderFrame)(
+    Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     switch(editedValueIndex)
     {
@@ -102,34 +104,34 @@ void Options::modifyValue(int valueIndex, Direction direction)
     switch(valueIndex)
     {
         case EditingAutoScroll:
-            toggleBool(modifySettings().autoScroll);
+            toggleBool(modifySettings()->autoScroll);
             break;
 
         case EditingFormat:
-            toggleBool(modifySettings().format24h);
+            toggleBool(modifySettings()->format24h);
             break;
 
         case EditingHourlyChime:
-            adjustEnum(modifySettings().hourlyChime, direction);
+            adjustEnum(modifySettings()->hourlyChime, direction);
             break;
 
         case EditingAutoLight:
-            toggleBool(modifySettings().autoLight);
+            toggleBool(modifySettings()->autoLight);
             break;
 
         case EditingManualBrightness:
             if (settings().autoLight)
-                adjustField(direction, AutoBrightnessPoint, modifySettings().brightnessDark);
+                adjustField(direction, AutoBrightnessPoint, modifySettings()->brightnessDark);
             else
-                adjustField(direction, ManualBrightness, modifySettings().manualBrightness);
+                adjustField(direction, ManualBrightness, modifySettings()->manualBrightness);
             break;
 
         case EditingBrightnessDim:
-            adjustField(direction, AutoBrightnessPoint, modifySettings().brightnessDim);
+            adjustField(direction, AutoBrightnessPoint, modifySettings()->brightnessDim);
             break;
 
         case EditingBrightnessBright:
-            adjustField(direction, AutoBrightnessPoint, modifySettings().brightnessBright);
+            adjustField(direction, AutoBrightnessPoint, modifySettings()->brightnessBright);
             break;
     }
 }
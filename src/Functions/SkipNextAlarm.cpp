@@ -1,13 +1,15 @@
 #include "SkipNextAlarm.h"
 #include "UiTexts.h"
 #include "Clock.h"
+#include "PicoClockHw/Platform.h"
 
 bool SkipNextAlarm::isAvailable() const
 {
     return clock().isAlarmOn();
 }
 
-void SkipNextAlarm::renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
+void RAM_FUNC(SkipNextAlarm::renderFrame)(
+    Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     std::string state = settings().skipNextAlarm ? uiText(TextId::On) : uiText(TextId::Off);
     renderScrollingText(frame, fullRefresh, uiText(TextId::SkipNextAlarmColon) + state);
@@ -15,6 +17,6 @@ void SkipNextAlarm::renderFrame(Bitmap &frame, int editedValueIndex, int blinkin
 
 void SkipNextAlarm::activate()
 {
-    modifySettings().skipNextAlarm = !settings().skipNextAlarm;
+    modifySettings()->skipNextAlarm = !settings().skipNextAlarm;
     bringScrollingToRight();
 }
@@ -1,4 +1,5 @@
 #include "Stopwatch.h"
+#include "PicoClockHw/Platform.h"
 
 void Stopwatch::reset()
 {
@@ -10,7 +11,7 @@ void Stopwatch::reset()
     select();
 }
 
-void Stopwatch::tick()
+void RAM_FUNC(Stopwatch::tick)()
 {
     if (!m_running)
         return;
@@ -22,7 +23,7 @@ void Stopwatch::tick()
         m_min.increment();
 }
 
-void Stopwatch::renderFrame(
+void RAM_FUNC(Stopwatch::renderFrame)(
     Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     if (!fullRefresh && !m_running)
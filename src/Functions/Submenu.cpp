@@ -1,6 +1,7 @@
 #include "Submenu.h"
 #include "Action.h"
 #include "UiTexts.h"
+#include "PicoClockHw/Platform.h"
 
 void Submenu::activate()
 {
@@ -16,7 +17,7 @@ void Submenu::activate()
     setCurrentMenu(&m_functions);
 }
 
-void Submenu::renderFrame(
+void RAM_FUNC(Submenu::renderFrame)(
     Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     renderScrollingText(frame, fullRefresh, m_name);
@@ -1,6 +1,7 @@
 #include "Temperature.h"
 #include "Utils/Trace.h"
 #include "Clock.h"
+#include "PicoClockHw/Platform.h"
 
 #include <cmath>
 
@@ -12,11 +13,12 @@ bool Temperature::isAvailable() const
 void Temperature::activate()
 {
     // Toggle the temperature format and refresh
-    modifySettings().useCelsius = !settings().useCelsius;
+    modifySettings()->useCelsius = !settings().useCelsius;
     forceRefresh();
 }
 
-void Temperature::renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
+void RAM_FUNC(Temperature::renderFrame)(
+    Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     if ((!fullRefresh && clock().tickCount() != 0) || clock().rtc() == nullptr) return;
 
@@ -0,0 +1,123 @@
+#include "TemperatureTrend.h"
+#include "Utils/Trace.h"
+#include "Clock.h"
+#include "PicoClockHw/Platform.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Difference between the last two columns from which the temperature is considered changing,
+    // in 0.25°C
+    const int TREND_THRESHOLD = 2;
+
+    // Seconds of each cycle during which the sparkline is shown, then the minimum and maximum
+    const int CYCLE_SEC = 6;
+    const int SPARKLINE_SEC = 4;
+
+    int toDisplayed(int16_t quarterDegrees, bool useCelsius)
+    {
+        float temp = quarterDegrees / 4.0f;
+        if (!useCelsius)
+            temp = temp * 9 / 5 + 32;
+
+        // Room temperatures, on two digits
+        return std::max(0, std::min<int>(std::lround(temp), 99));
+    }
+}
+
+bool TemperatureTrend::isAvailable() const
+{
+    return clock().hasRtc();
+}
+
+void TemperatureTrend::activate()
+{
+    // Toggle between the last 24 hours and the last 30 days
+    if (m_range == TemperatureHistory::Day)
+        m_range = TemperatureHistory::Month;
+    else
+        m_range = TemperatureHistory::Day;
+    m_upToDate = false;
+    forceRefresh();
+}
+
+void TemperatureTrend::updateColumns()
+{
+    if (m_upToDate && m_sequence == m_history->sequence())
+        return;
+
+    TemperatureHistory::Summary summary;
+    m_history->summary(m_range, summary);
+    m_upToDate = true;
+    m_sequence = summary.sequence;
+    m_columnCount = summary.columnCount;
+    if (m_columnCount == 0)
+        return;
+
+    // The lowest temperature has one pixel, so that the line is visible when it is flat.
+    m_min = summary.min;
+    m_max = summary.max;
+    int range = std::max(m_max - m_min, 1);
+    for (int i = 0; i < m_columnCount; i++)
+        m_columnHeights[i] = 1 + (summary.columns[i] - m_min) * (Display::MATRIX_HEIGHT - 1) / range;
+
+    m_trend = Steady;
+    if (m_columnCount >= 2)
+    {
+        int change = summary.columns[m_columnCount - 1] - summary.columns[m_columnCount - 2];
+        if (change >= TREND_THRESHOLD)
+            m_trend = Rising;
+        else if (change <= -TREND_THRESHOLD)
+            m_trend = Falling;
+    }
+    TRACE << "Temperature trend:" << m_columnCount << "columns, min" << m_min << "max" << m_max;
+}
+
+void RAM_FUNC(TemperatureTrend::renderFrame)(
+    Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
+{
+    if (!fullRefresh && clock().tickCount() != 0) return;
+
+    updateColumns();
+
+    frame.clear();
+    frame.setFont(&classicFont);
+    frame.putIndicator(settings().useCelsius ? Bitmap::C : Bitmap::F, true);
+    if (m_columnCount == 0)
+    {
+        // Nothing recorded yet
+        frame.drawRectangle(10, 3, 11, 3, true);
+        return;
+    }
+
+    if (clock().snapshot().sec % CYCLE_SEC < SPARKLINE_SEC)
+    {
+        // Right aligned, the newest column next to the arrow
+        int left = SPARKLINE_WIDTH - m_columnCount;
+        for (int i = 0; i < m_columnCount; i++)
+        {
+            int x = left + i;
+            frame.drawRectangle(
+                x, Display::MATRIX_HEIGHT - m_columnHeights[i], x, Display::MATRIX_HEIGHT - 1, true);
+        }
+
+        // Arrow on the last 3 columns
+        int x = SPARKLINE_WIDTH + 1;
+        if (m_trend == Steady)
+            frame.drawRectangle(x - 1, 3, x + 1, 3, true);
+        else
+        {
+            int barb = m_trend == Rising ? 1 : Display::MATRIX_HEIGHT - 2;
+            frame.drawRectangle(x, 0, x, Display::MATRIX_HEIGHT - 1, true);
+            frame.putPixel(x - 1, barb, true);
+            frame.putPixel(x + 1, barb, true);
+        }
+    } else
+    {
+        frame.draw2DigitsInt(0, 0, toDisplayed(m_min, settings().useCelsius));
+        frame.drawRectangle(10, 3, 11, 3, true);
+        frame.draw2DigitsInt(13, 0, toDisplayed(m_max, settings().useCelsius));
+    }
+}
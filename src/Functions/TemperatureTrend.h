@@ -0,0 +1,47 @@
+#pragma once
+
+#include "AbstractFunction.h"
+#include "TemperatureHistory.h"
+
+// Sparkline of the temperature over the last 24 hours or 30 days, with an arrow for the trend,
+// alternating with the minimum and maximum over the same range.
+class TemperatureTrend : public AbstractFunction
+{
+public:
+    TemperatureTrend(ClockUi *clockUi, const TemperatureHistory *history) :
+        AbstractFunction(clockUi), m_history(history)
+    {}
+
+private:
+    static const int SPARKLINE_WIDTH = TemperatureHistory::COLUMN_COUNT;
+    static_assert(SPARKLINE_WIDTH + 3 == Display::MATRIX_WIDTH, "The arrow uses the rest");
+
+    enum Trend
+    {
+        Falling,
+        Steady,
+        Rising
+    };
+
+    bool isAvailable() const override;
+    void renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh) override;
+    void activate() override;
+    int valueCount() const override
+    {
+        return 1; // Nothing to edit, only the history
+    }
+
+    void updateColumns();
+
+    const TemperatureHistory *m_history;
+    TemperatureHistory::Range m_range = TemperatureHistory::Day;
+
+    // Scaled from the summary of the history when it or the range changes
+    bool m_upToDate = false;
+    uint32_t m_sequence = 0;
+    int m_columnCount = 0;
+    int8_t m_columnHeights[SPARKLINE_WIDTH];
+    int16_t m_min = 0; // In 0.25°C
+    int16_t m_max = 0;
+    Trend m_trend = Steady;
+};
@@ -2,9 +2,16 @@
 #include "fonts.h"
 #include "Bitmap.h"
 #include "Clock.h"
+#include "PicoClockHw/Platform.h"
 
-void Time::renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
+void RAM_FUNC(Time::renderFrame)(
+    Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
+    // Most of the rendering only needs to be done when the snapshot of the time changed.
+    uint32_t sequence = clock().snapshot().sequence;
+    m_timeChanged = sequence != m_renderedSequence;
+    m_renderedSequence = sequence;
+
     switch(m_style)
     {
     case HourMinSec:
@@ -37,7 +44,9 @@ void Time::finishEditing()
 void Time::renderHourMinSec(
     Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
-    if (clock().tickCount() == 0 || 
+    const Clock::TimeSnapshot &now = clock().snapshot();
+
+    if (m_timeChanged || 
         (editedValueIndex != NoEditing && blinkingCounter == 0) ||
         fullRefresh)
     {
@@ -55,8 +64,8 @@ void Time::renderHourMinSec(
         frame.setFont(&narrowFont);
         frame.drawChar(3, 0, '0' + displayedHour % 10);
 
-        frame.draw2DigitsIntWithLeadingZero(7, 0, clock().get().tm_min);
-        frame.draw2DigitsIntWithLeadingZero(15, 0, clock().get().tm_sec);
+        frame.draw2DigitsIntWithLeadingZero(7, 0, now.min);
+        frame.draw2DigitsIntWithLeadingZero(15, 0, now.sec);
 
         putWeekDay(frame);
     }
@@ -64,7 +73,7 @@ void Time::renderHourMinSec(
     // Hide blinking digits at the half of the blinking cycle, or if it was just displayed
     // above and it is not the time to be visible
     if (blinkingCounter == BLINKING_DISAPPEAR_FRAME || 
-        (clock().tickCount() == 0 && blinkingCounter >= BLINKING_DISAPPEAR_FRAME))
+        (m_timeChanged && blinkingCounter >= BLINKING_DISAPPEAR_FRAME))
     {
         switch (editedValueIndex)
         {
@@ -77,10 +86,11 @@ void Time::renderHourMinSec(
         }
     } 
 
-    // Blinking of double dots. Also redraw at the beginning of blinking cycle, as the full buffer was 
-    // cleared above.
+    // Blinking of double dots. Also redraw at the beginning of blinking cycle or if the time changed
+    // in the second half of a second, as the full buffer was cleared above.
     if (clock().tickCount() == Display::FRAME_RATE / 2 || 
-        (editedValueIndex != NoEditing && blinkingCounter == 0 && clock().tickCount() >= Display::FRAME_RATE / 2) || 
+        ((m_timeChanged || (editedValueIndex != NoEditing && blinkingCounter == 0)) && 
+            clock().tickCount() >= Display::FRAME_RATE / 2) || 
         fullRefresh)
     {
         frame.putPixel(6, 2, true);
@@ -93,9 +103,10 @@ void Time::renderHourMinSec(
 void Time::renderHourMinProgressBar(
     Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
-    int barWidth = clock().get().tm_sec / 3;
+    const Clock::TimeSnapshot &now = clock().snapshot();
+    int barWidth = now.barWidth;
 
-    if ((clock().get().tm_sec == 0 && clock().tickCount() == 0) || 
+    if ((now.sec == 0 && m_timeChanged) || 
         (editedValueIndex != NoEditing && blinkingCounter == 0) || 
         fullRefresh)
     {
@@ -105,7 +116,7 @@ void Time::renderHourMinProgressBar(
         frame.setFont(&shortFont);
 
         frame.draw2DigitsInt(0, 0, putAmPmAndConvertCurrentHour(frame));
-        frame.draw2DigitsIntWithLeadingZero(12, 0, clock().get().tm_min);
+        frame.draw2DigitsIntWithLeadingZero(12, 0, now.min);
 
         frame.putPixel(10, 1, true);
         frame.putPixel(10, 3, true);
@@ -126,9 +137,9 @@ void Time::renderHourMinProgressBar(
         }
     }
 
-    if (clock().tickCount() == 0 || fullRefresh)
+    if (m_timeChanged || fullRefresh)
     {
-        switch(clock().get().tm_sec % 3)
+        switch(now.barPhase)
         {
             case 0:
                 if (barWidth != 0)
@@ -158,7 +169,9 @@ void Time::renderHourMin(
         (blinkingCounter == 0 || blinkingCounter == BLINKING_DISAPPEAR_FRAME))
         fullRefresh = true;
 
-    if (fullRefresh || (clock().get().tm_sec == 0 && clock().tickCount() == 0))
+    const Clock::TimeSnapshot &now = clock().snapshot();
+
+    if (fullRefresh || (now.sec == 0 && m_timeChanged))
     {
         frame.clear();
         frame.setFont(&classicFont);
@@ -168,13 +181,13 @@ void Time::renderHourMin(
             frame.draw2DigitsInt(0, 0, displayedHour);
 
         if (editedValueIndex != EditingMinute || blinkingCounter < BLINKING_DISAPPEAR_FRAME)
-            frame.draw2DigitsIntWithLeadingZero(13, 0, clock().get().tm_min);
+            frame.draw2DigitsIntWithLeadingZero(13, 0, now.min);
 
     }
 
-    if (fullRefresh || clock().tickCount() == 0)
+    if (fullRefresh || m_timeChanged)
     {
-        bool dotVisible = clock().get().tm_sec % 2 != 0;
+        bool dotVisible = now.sec % 2 != 0;
         frame.drawRectangle(10, 1, 11, 2, dotVisible);
         frame.drawRectangle(10, 4, 11, 5, dotVisible);
 
@@ -184,17 +197,15 @@ void Time::renderHourMin(
 
 int Time::putAmPmAndConvertCurrentHour(Bitmap &frame)
 {
-    int displayedHour;
-    bool morning;
-    convertHour(clock().get().tm_hour, displayedHour, morning);
-    putAmPmIndicators(frame, morning);
+    const Clock::TimeSnapshot &now = clock().snapshot();
+    putAmPmIndicators(frame, now.morning);
 
-    return displayedHour;
+    return settings().format24h ? now.hour24 : now.hour12;
 }
 
 void Time::modifyValue(int valueIndex, Direction direction)
 {
-    tm tm = clock().get();
+    tm tm = clock().snapshot().dateTime();
 
     switch(valueIndex)
     {
@@ -49,4 +49,6 @@ private:
     int putAmPmAndConvertCurrentHour(Bitmap &frame);
 
     const Style m_style;
+    uint32_t m_renderedSequence = 0;
+    bool m_timeChanged = true;
 };
\ No newline at end of file
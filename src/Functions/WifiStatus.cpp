@@ -1,6 +1,7 @@
 #include "WifiStatus.h"
 #include "UiTexts.h"
 #include "PicoClockHw/Wifi.h"
+#include "PicoClockHw/Platform.h"
 #include <string>
 
 bool WifiStatus::isAvailable() const
@@ -8,7 +9,8 @@ bool WifiStatus::isAvailable() const
     return Wifi::linkStatus() != Wifi::NotAvailable;
 }
 
-void WifiStatus::renderFrame(Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
+void RAM_FUNC(WifiStatus::renderFrame)(
+    Bitmap &frame, int editedValueIndex, int blinkingCounter, bool fullRefresh)
 {
     std::string text = 
         uiText(TextId::WifiColon) + 
@@ -0,0 +1,224 @@
+#include "HolidayCalendar.h"
+#include "Utils/Trace.h"
+#include "PicoClockHw/FlashLayout.h"
+
+#include <cstring>
+
+namespace
+{
+    const int DAYS_BEFORE_MONTH[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    const int DAYS_IN_MONTH[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    bool isLeapYear(int year)
+    {
+        return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    }
+
+    int daysInYear(int year)
+    {
+        return isLeapYear(year) ? 366 : 365;
+    }
+
+    int daysInMonth(int year, int month)
+    {
+        return DAYS_IN_MONTH[month - 1] + (month == 2 && isLeapYear(year) ? 1 : 0);
+    }
+
+    // 0-based day of the year, month and day are 1-based
+    int dayOfYear(int year, int month, int day)
+    {
+        return DAYS_BEFORE_MONTH[month - 1] + day - 1 + (month > 2 && isLeapYear(year) ? 1 : 0);
+    }
+
+    // Weekday of January 1st, 0 for Sunday
+    int weekdayOfYearStart(int year)
+    {
+        int y = year - 1;
+        return (1 + 5 * (y % 4) + 4 * (y % 100) + 6 * (y % 400)) % 7;
+    }
+
+    // Day of the year of Easter Sunday in the Gregorian calendar (anonymous algorithm)
+    int easterDayOfYear(int year)
+    {
+        int a = year % 19;
+        int b = year / 100;
+        int c = year % 100;
+        int d = b / 4;
+        int e = b % 4;
+        int f = (b + 8) / 25;
+        int g = (b - f + 1) / 3;
+        int h = (19 * a + b - d - g + 15) % 30;
+        int i = c / 4;
+        int k = c % 4;
+        int l = (32 + 2 * e + 2 * i - h - k) % 7;
+        int m = (a + 11 * h + 22 * l) / 451;
+        int month = (h + l - 7 * m + 114) / 31;
+        int day = (h + l - 7 * m + 114) % 31 + 1;
+        return dayOfYear(year, month, day);
+    }
+
+    void setBit(uint32_t *bits, int day)
+    {
+        bits[day / 32] |= 1u << (day % 32);
+    }
+
+    // 32 consecutive days starting at the given weekday, with the bits of the days that are on 
+    // one of the given weekdays set.
+    uint32_t weekdayPattern(uint8_t weekDayBits, int startWeekday)
+    {
+        uint32_t rotated = 
+            ((weekDayBits >> startWeekday) | (weekDayBits << (7 - startWeekday))) & 0x7F;
+        return rotated | rotated << 7 | rotated << 14 | rotated << 21 | rotated << 28;
+    }
+
+    uint32_t hash(const uint8_t *data, size_t size)
+    {
+        // Calculate djb2 hash, same as for the settings
+        uint32_t hash = 5381;
+        while (size != 0)
+        {
+            hash = (hash << 5) + hash + *data;
+            data++;
+            size--;
+        }
+        return hash;        
+    }
+}
+
+HolidayCalendar::HolidayCalendar()
+{
+    const uint8_t *content = FlashLayout::content(FlashLayout::HOLIDAYS_OFFSET);
+    auto header = reinterpret_cast<const Header *>(content);
+    if (header->magic != MAGIC || header->version != VERSION)
+    {
+        TRACE << "No holiday calendar";
+        return;
+    }
+
+    size_t dataSize = header->yearCount * sizeof(Year) + header->ruleCount * sizeof(Rule);
+    if (sizeof(Header) + dataSize > FLASH_SECTOR_SIZE || 
+        header->hash != hash(content + sizeof(Header), dataSize))
+    {
+        TRACE << "Invalid holiday calendar";
+        return;
+    }
+
+    m_years = reinterpret_cast<const Year *>(content + sizeof(Header));
+    m_rules = reinterpret_cast<const Rule *>(m_years + header->yearCount);
+    m_yearCount = header->yearCount;
+    m_ruleCount = header->ruleCount;
+    m_present = true;
+    TRACE << "Holiday calendar with" << m_yearCount << "years and" << m_ruleCount << "rules";
+}
+
+bool HolidayCalendar::isHoliday(int year, int yday) const
+{
+    if (!m_present)
+        return false;
+
+    return (bitsOfYear(year + 1900)[yday / 32] >> (yday % 32)) & 1;
+}
+
+int HolidayCalendar::daysUntilAllowedDay(const tm &start, uint8_t weekDayBits) const
+{
+    weekDayBits &= 0x7F;
+    if (weekDayBits == 0)
+        return -1;
+
+    int year = start.tm_year + 1900;
+    int yday = start.tm_yday;
+    int yearStartWeekday = ((start.tm_wday - yday) % 7 + 7) % 7;
+    int daysFromStart = 0;
+
+    // Search the rest of the start year and the two following years, which is enough to cross
+    // any realistic holiday period.
+    for (int i = 0; i < 3; i++)
+    {
+        int days = daysInYear(year);
+        const uint32_t *holidays = m_present ? bitsOfYear(year) : nullptr;
+
+        for (int word = yday / 32; word * 32 < days; word++)
+        {
+            uint32_t allowed = weekdayPattern(weekDayBits, (yearStartWeekday + word * 32) % 7);
+            if (holidays)
+                allowed &= ~holidays[word];
+            if (word == yday / 32)
+                allowed &= ~0u << (yday % 32); // Days before the start
+            if (days - word * 32 < 32)
+                allowed &= (1u << (days - word * 32)) - 1; // Days after the end of the year
+
+            if (allowed != 0)
+                return daysFromStart + word * 32 + __builtin_ctz(allowed) - yday;
+        }
+
+        daysFromStart += days - yday;
+        yearStartWeekday = (yearStartWeekday + days) % 7;
+        yday = 0;
+        year++;
+    }
+
+    return -1;
+}
+
+const uint32_t *HolidayCalendar::bitsOfYear(int year) const
+{
+    CachedYear &cached = m_cache[year & 1];
+    if (cached.year != year)
+    {
+        buildYear(year, cached.bits);
+        cached.year = year;
+    }
+    return cached.bits;
+}
+
+void HolidayCalendar::buildYear(int year, uint32_t *bits) const
+{
+    memset(bits, 0, WORDS_PER_YEAR * sizeof(uint32_t));
+
+    for (int i = 0; i < m_yearCount; i++)
+    {
+        if (m_years[i].year == year)
+        {
+            for (int word = 0; word < WORDS_PER_YEAR; word++)
+                bits[word] |= m_years[i].dayBits[word];
+        }
+    }
+
+    for (int i = 0; i < m_ruleCount; i++)
+    {
+        const Rule &rule = m_rules[i];
+        if (rule.type != EasterOffset && (rule.month < 1 || rule.month > 12))
+            continue;
+
+        int day = -1;
+        switch (rule.type)
+        {
+            case FixedDate:
+                if (rule.day >= 1 && rule.day <= daysInMonth(year, rule.month))
+                    day = dayOfYear(year, rule.month, rule.day);
+                break;
+
+            case NthWeekday:
+            {
+                if (rule.day > 6)
+                    break;
+                int monthStart = dayOfYear(year, rule.month, 1);
+                int monthDays = daysInMonth(year, rule.month);
+                int firstWeekday = (weekdayOfYearStart(year) + monthStart) % 7;
+                int first = (rule.day - firstWeekday + 7) % 7; // First matching day in month
+                int count = (monthDays - 1 - first) / 7 + 1; // Matching days in month
+                int n = rule.param > 0 ? rule.param : count + 1 + rule.param;
+                if (n >= 1 && n <= count)
+                    day = monthStart + first + (n - 1) * 7;
+                break;
+            }
+
+            case EasterOffset:
+                day = easterDayOfYear(year) + rule.param;
+                break;
+        }
+
+        if (day >= 0 && day < daysInYear(year))
+            setBit(bits, day);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <time.h>
+
+// Days on which the alarms do not ring, e.g. public holidays. The calendar is stored in a 
+// dedicated flash sector written by tools/holiday_import.py. It consists of a set of days per 
+// year and of recurring rules. Both are merged into a bit set per year when a year is first
+// accessed, so that a lookup is O(1) and the next allowed day can be searched 32 days at a time.
+//
+// If no calendar is present in flash, there are no holidays.
+class HolidayCalendar
+{
+public:
+    static const int MAX_DAYS_PER_YEAR = 366;
+    static const int WORDS_PER_YEAR = (MAX_DAYS_PER_YEAR + 31) / 32;
+
+    HolidayCalendar();
+
+    bool isPresent() const
+    {
+        return m_present;
+    }
+
+    // yday and year as in tm, i.e. 0-based and years since 1900
+    bool isHoliday(int year, int yday) const;
+
+    // Return the number of days from the given day (included) to the first day that is on one of
+    // the given weekdays (bit 0 for Sunday) and is not a holiday. Return -1 if there is no such 
+    // day within two years.
+    int daysUntilAllowedDay(const tm &start, uint8_t weekDayBits) const;
+
+    // Layout in flash, shared with the importer. All values are little endian.
+    static const uint32_t MAGIC = 0x494C4F48; // "HOLI"
+    static const uint16_t VERSION = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t yearCount;
+        uint16_t ruleCount;
+        uint16_t reserved;
+        uint32_t hash; // djb2 hash of the years and rules following the header
+    };
+
+    struct Year
+    {
+        uint16_t year; // E.g. 2024
+        uint16_t reserved;
+        uint32_t dayBits[WORDS_PER_YEAR]; // Bit n for the 0-based day n of the year
+    };
+
+    enum RuleType : uint8_t
+    {
+        FixedDate = 1, // month, day
+        NthWeekday = 2, // month, day = weekday (0 for Sunday), param = n (negative from the end)
+        EasterOffset = 3 // param = days after Easter Sunday
+    };
+
+    struct Rule
+    {
+        RuleType type;
+        uint8_t month; // 1 to 12
+        uint8_t day;
+        int8_t param;
+    };
+
+private:
+    const uint32_t *bitsOfYear(int year) const;
+    void buildYear(int year, uint32_t *bits) const;
+
+    bool m_present = false;
+    const Year *m_years = nullptr;
+    const Rule *m_rules = nullptr;
+    int m_yearCount = 0;
+    int m_ruleCount = 0;
+
+    // Merged bits of the two last accessed years, typically the current and the next one. 
+    // Indexed by the parity of the year.
+    struct CachedYear
+    {
+        int year = -1;
+        uint32_t bits[WORDS_PER_YEAR];
+    };
+    mutable CachedYear m_cache[2];
+};
@@ -0,0 +1,86 @@
+#include "NtpTimeSource.h"
+#include "PicoClockHw/Platform.h"
+#include "Utils/Trace.h"
+
+#include <hardware/sync.h>
+
+namespace
+{
+    // Assumed until the server tells its stratum, as for a public pool server
+    const int DEFAULT_SERVER_STRATUM = 2;
+
+    // The response has a resolution of 1 ms and its network delay is not compensated.
+    const uint32_t PRECISION_US = 10000;
+}
+
+NtpTimeSource::NtpTimeSource()
+{
+    using namespace std::placeholders;
+    m_ntp.setTimeCallback(std::bind(&NtpTimeSource::onTimeReceived, this, _1, _2));
+    m_ntp.setFailCallback(std::bind(&NtpTimeSource::onFailed, this, _1));
+}
+
+bool NtpTimeSource::init()
+{
+    if (!m_available)
+        m_available = m_ntp.init();
+    return m_available;
+}
+
+int NtpTimeSource::stratum() const
+{
+    if (m_ntp.serverStratum() == 0)
+        return DEFAULT_SERVER_STRATUM + 1;
+    return m_ntp.serverStratum() + 1;
+}
+
+uint32_t NtpTimeSource::precisionUs() const
+{
+    return PRECISION_US;
+}
+
+// May be called from the main loop while the network callbacks are running.
+bool NtpTimeSource::requestSample(SampleCallback callback)
+{
+    if (!m_available)
+        return false;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    bool started = !m_sampleCallback;
+    if (started)
+        m_sampleCallback = callback;
+    restore_interrupts(interrupts);
+
+    // May fail and call back before returning, e.g. if DNS is not reachable.
+    if (started)
+        m_ntp.startRequest();
+    return started;
+}
+
+void NtpTimeSource::onTimeReceived(time_t utcTime, uint32_t ms)
+{
+    TRACE << "Received ntp time:" << utcTime;
+    if (!m_sampleCallback)
+        return;
+
+    Sample sample;
+    sample.time = utcTime + UTC_OFFSET * 60 * 60;
+    sample.us = ms * 1000;
+    sample.timeUs = Platform::timeUs();
+
+    // Cleared before calling, so that the callback can request the next sample.
+    SampleCallback callback = std::move(m_sampleCallback);
+    m_sampleCallback = nullptr;
+    callback(true, sample);
+}
+
+void NtpTimeSource::onFailed(Ntp::State reason)
+{
+    TRACE << "NTP request failed:" << reason;
+    if (!m_sampleCallback)
+        return;
+
+    SampleCallback callback = std::move(m_sampleCallback);
+    m_sampleCallback = nullptr;
+    callback(false, Sample());
+}
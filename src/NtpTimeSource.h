@@ -0,0 +1,34 @@
+#pragma once
+
+#include "TimeSource.h"
+#include "PicoClockHw/Ntp.h"
+
+// NTP server, available once the network is up
+class NtpTimeSource : public TimeSource
+{
+public:
+    NtpTimeSource();
+
+    // Return false if there is no network, the source stays unavailable then.
+    bool init();
+
+    const char *name() const override
+    {
+        return "NTP";
+    }
+    int stratum() const override;
+    uint32_t precisionUs() const override;
+    bool isAvailable() const override
+    {
+        return m_available;
+    }
+    bool requestSample(SampleCallback callback) override;
+
+private:
+    void onTimeReceived(time_t utcTime, uint32_t ms);
+    void onFailed(Ntp::State reason);
+
+    Ntp m_ntp;
+    bool m_available = false;
+    SampleCallback m_sampleCallback; // Set while a sample is pending
+};
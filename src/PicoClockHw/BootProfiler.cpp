@@ -0,0 +1,13 @@
+#include "BootProfiler.h"
+
+volatile uint64_t BootProfiler::m_stageUs[StageCount] = {};
+
+const char *BootProfiler::stageName(Stage stage)
+{
+    static const char *names[StageCount] =
+    {
+        "main", "stdio", "journal", "clock ready", "UI ready", "time known", "first frame",
+        "first correct frame", "first temperature", "Wi-Fi init", "Wi-Fi connected", "NTP sync"
+    };
+    return names[stage];
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+
+// Time of each stage of the startup since reset, as returned by Platform::timeUs(), to find what
+// delays the first correct frame. Only the first time a stage is reached is kept, so the stages
+// can be marked from code that runs repeatedly, including interrupts.
+class BootProfiler
+{
+public:
+    enum Stage
+    {
+        Main, // Entry of main(), after the boot ROM and the runtime initialization
+        StdIo,
+        Journal,
+        ClockReady, // Time restored or RTC probe queued
+        UiReady,
+        TimeKnown, // From the warm restart, the RTC or NTP
+        FirstFrame,
+        FirstCorrectFrame, // Rendered with the UI ready and the time known
+        FirstTemperature,
+        WifiInit,
+        WifiConnected,
+        NtpSync,
+        StageCount
+    };
+
+    static void mark(Stage stage)
+    {
+        if (m_stageUs[stage] == 0)
+            m_stageUs[stage] = Platform::timeUs();
+    }
+
+    static bool reached(Stage stage)
+    {
+        return m_stageUs[stage] != 0;
+    }
+
+    // 0 if not reached yet
+    static uint64_t stageUs(Stage stage)
+    {
+        return m_stageUs[stage];
+    }
+
+    static const char *stageName(Stage stage);
+
+private:
+    static volatile uint64_t m_stageUs[StageCount];
+};
@@ -1,4 +1,5 @@
 #include "Button.h"
+#include "Platform.h"
 #include "Utils/Trace.h"
 #include "Utils/Trampoline.h"
 
@@ -8,7 +9,7 @@ namespace {
     const int DEBOUNCE_DELAY_MS = 10;
 }
 
-std::map<unsigned int, Button *> Button::m_buttonByGpio;
+Button *Button::m_buttonByGpio[MAX_GPIOS] = {};
 
 Button::Button(unsigned int gpio) : m_gpio(gpio)
 {
@@ -17,15 +18,15 @@ Button::Button(unsigned int gpio) : m_gpio(gpio)
     gpio_pull_up(gpio);
     gpio_set_irq_enabled_with_callback(gpio, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true, dispatcher);
 
-    m_buttonByGpio.insert(std::make_pair(gpio, this));
+    m_buttonByGpio[gpio] = this;
 }
 
 Button::~Button()
 {
-    m_buttonByGpio.erase(m_gpio);
+    m_buttonByGpio[m_gpio] = nullptr;
     
-    cancel_alarm(m_repeatAlarm);
-    cancel_alarm(m_debounceAlarm);
+    TimerWheel::cancel(m_repeatAlarm);
+    TimerWheel::cancel(m_debounceAlarm);
 }
 
 void Button::setPressedCallback(std::function<void()> f)
@@ -39,28 +40,26 @@ void Button::setRepeatCallback(std::function<void()> f, int delayMs)
     m_repeatDelay = delayMs;
 }
 
-void Button::dispatcher(unsigned int gpio, uint32_t events)
+void RAM_FUNC(Button::dispatcher)(unsigned int gpio, uint32_t events)
 {
-    auto it = m_buttonByGpio.find(gpio);
-
-    if (it == m_buttonByGpio.end())
+    if (gpio >= MAX_GPIOS || m_buttonByGpio[gpio] == nullptr)
         return;
 
-    Button &obj = *it->second;
+    Button &obj = *m_buttonByGpio[gpio];
 
-    // To debounce, delay the actual processing using an alarm.
-    if (obj.m_debounceAlarm != -1) // Note: calling cancel_alarm with -1 would crash
+    // To debounce, delay the actual processing using a timer. Cancelling and adding it again on
+    // every bounce is cheap, as the timer wheel does not allocate anything.
+    if (obj.m_debounceAlarm != -1)
     {
         TRACE << "Cancel alarm " << obj.m_debounceAlarm;
-        cancel_alarm(obj.m_debounceAlarm);
+        TimerWheel::cancel(obj.m_debounceAlarm);
     }
     MAKE_TRAMPOLINE(Button, debounceCallback, userPtrAtEnd);
-    obj.m_debounceAlarm = 
-        add_alarm_in_ms(DEBOUNCE_DELAY_MS, debounceCallback, &obj, true /* fire if past*/);
+    obj.m_debounceAlarm = TimerWheel::addInMs(DEBOUNCE_DELAY_MS, debounceCallback, &obj);
     TRACE <<"End of dispatcher\n";
 }
 
-int64_t Button::debounceCallback(alarm_id_t id)
+int64_t Button::debounceCallback(TimerWheel::TimerId id)
 {
     if (!gpio_get(m_gpio))
     {
@@ -73,7 +72,7 @@ int64_t Button::debounceCallback(alarm_id_t id)
         {
             TRACE << "Current repeat alarm: " << m_repeatAlarm;
             MAKE_TRAMPOLINE(Button, repeatCallback, userPtrAtEnd)
-            m_repeatAlarm = add_alarm_in_ms(m_repeatDelay, repeatCallback, this, false);
+            m_repeatAlarm = TimerWheel::addInMs(m_repeatDelay, repeatCallback, this);
         }
     } else
     { 
@@ -81,8 +80,8 @@ int64_t Button::debounceCallback(alarm_id_t id)
         TRACE << "Repeat alarm to cancel: " << m_repeatAlarm;
         if (m_repeatAlarm != -1)
         {
-            bool ok = cancel_alarm(m_repeatAlarm);
-            TRACE <<"Result of cancel_alarm: "<<ok;
+            bool ok = TimerWheel::cancel(m_repeatAlarm);
+            TRACE <<"Result of cancel: "<<ok;
         }
         m_repeatAlarm = -1;
     }
@@ -92,7 +91,7 @@ int64_t Button::debounceCallback(alarm_id_t id)
     return 0; 
 }
 
-int64_t Button::repeatCallback(alarm_id_t id)
+int64_t Button::repeatCallback(TimerWheel::TimerId id)
 {
     if (gpio_get(m_gpio))
     { 
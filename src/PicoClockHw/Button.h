@@ -1,9 +1,9 @@
 #pragma once
 
-#include <map>
+#include "TimerWheel.h"
+
 #include <functional>
 #include <cstdint>
-#include <pico/time.h>
 
 class Button
 {
@@ -15,17 +15,20 @@ public:
     void setRepeatCallback(std::function<void()> f, int delayMs);
 
 private:
+    static const unsigned int MAX_GPIOS = 30; // Number of user GPIOs of the RP2040
+
     static void dispatcher(unsigned int gpio, uint32_t events);
-    int64_t debounceCallback(alarm_id_t id);
-    int64_t repeatCallback(alarm_id_t id);
+    int64_t debounceCallback(TimerWheel::TimerId id);
+    int64_t repeatCallback(TimerWheel::TimerId id);
 
     unsigned int m_gpio;
-    static std::map<unsigned int, Button *> m_buttonByGpio;
+    // Looked up by the GPIO interrupt, hence an array rather than a map
+    static Button *m_buttonByGpio[MAX_GPIOS];
 
     std::function<void()> m_pressedCallback;
     std::function<void()> m_repeatCallback;
 
     int m_repeatDelay = 0;
-    alarm_id_t m_repeatAlarm = -1;
-    alarm_id_t m_debounceAlarm = -1;
+    TimerWheel::TimerId m_repeatAlarm = -1;
+    TimerWheel::TimerId m_debounceAlarm = -1;
 };
@@ -13,7 +13,7 @@ Buzzer::Buzzer()
 Buzzer::~Buzzer()
 {
     if (m_stopBeepAlarm != -1)
-        cancel_alarm(m_stopBeepAlarm);
+        TimerWheel::cancel(m_stopBeepAlarm);
 }
 
 void Buzzer::beepForMs(int delay)
@@ -21,13 +21,13 @@ void Buzzer::beepForMs(int delay)
     gpio_put(BUZZ, true);
 
     if (m_stopBeepAlarm != -1)
-        cancel_alarm(m_stopBeepAlarm);
+        TimerWheel::cancel(m_stopBeepAlarm);
 
     MAKE_TRAMPOLINE(Buzzer, stopBeep, userPtrAtEnd);
-    m_stopBeepAlarm = add_alarm_in_ms(delay, stopBeep, this, true /* fire if past*/);
+    m_stopBeepAlarm = TimerWheel::addInMs(delay, stopBeep, this);
 }
 
-int64_t Buzzer::stopBeep(alarm_id_t id)
+int64_t Buzzer::stopBeep(TimerWheel::TimerId id)
 {
     gpio_put(BUZZ, false);
 
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <pico/time.h>
+#include "TimerWheel.h"
+
 #include <cstdint>
 
 class Buzzer
@@ -12,7 +13,7 @@ public:
     void beepForMs(int delay);
 
 private:
-    int64_t stopBeep(alarm_id_t id);
+    int64_t stopBeep(TimerWheel::TimerId id);
 
-    alarm_id_t m_stopBeepAlarm = -1;
+    TimerWheel::TimerId m_stopBeepAlarm = -1;
 };
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "Crc32.h"
+
+#include <hardware/dma.h>
+#include <hardware/sync.h>
+
+namespace
+{
+    // Below this size, setting up the DMA costs more than it saves.
+    const size_t MIN_DMA_SIZE = 16;
+
+    int g_channel = -2; // -2 if not claimed yet, -1 if no channel is available
+    bool g_busy = false;
+
+    uint32_t bitReverse(uint32_t value)
+    {
+        uint32_t result = 0;
+        for (int i = 0; i < 32; i++)
+        {
+            result = (result << 1) | (value & 1);
+            value >>= 1;
+        }
+        return result;
+    }
+}
+
+uint32_t Crc32::compute(const uint8_t *data, size_t size, uint32_t crc)
+{
+    if (size < MIN_DMA_SIZE)
+        return computeBySoftware(data, size, crc);
+
+    // Take the sniffer, which is shared by all channels
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (g_channel == -2)
+        g_channel = dma_claim_unused_channel(false);
+    bool available = g_channel >= 0 && !g_busy;
+    if (available)
+        g_busy = true;
+    restore_interrupts(interrupts);
+
+    if (!available)
+        return computeBySoftware(data, size, crc);
+
+    // The sniffer computes the CRC on bit-reversed data, so its accumulator holds the bit-reversed
+    // state of the usual reflected algorithm. The output is reversed and inverted when read.
+    dma_sniffer_enable(g_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_set_data_accumulator(bitReverse(~crc));
+
+    // Only the sniffer needs the data, so always write to the same dummy location.
+    static uint8_t dummy;
+    dma_channel_config config = dma_channel_get_default_config(g_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_sniff_enable(&config, true);
+    dma_channel_configure(g_channel, &config, &dummy, data, size, true);
+    dma_channel_wait_for_finish_blocking(g_channel);
+
+    crc = dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+
+    g_busy = false;
+    return crc;
+}
+
+uint32_t Crc32::computeBySoftware(const uint8_t *data, size_t size, uint32_t crc)
+{
+    // Processed by nibbles to keep the table small
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+        0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Standard CRC-32 (as used by zlib and Ethernet). It is computed by the sniffer of a DMA channel
+// doing a memory to memory pass, which is much faster than the software implementation, 
+// especially when reading from flash. The software implementation is used if no DMA channel is
+// available or if the sniffer is already in use, e.g. when called from an interrupt handler.
+class Crc32
+{
+public:
+    // Continue a previous CRC by passing it in crc
+    static uint32_t compute(const uint8_t *data, size_t size, uint32_t crc = 0);
+    static uint32_t computeBySoftware(const uint8_t *data, size_t size, uint32_t crc = 0);
+};
@@ -1,4 +1,5 @@
 #include "Display.h"
+#include "Platform.h"
 #include "Utils/Trace.h"
 #include "gpio.h"
 #include "Utils/Trampoline.h"
@@ -207,7 +208,7 @@ void Display::initDma()
     dma_channel_start(m_dataChannel);
 }
 
-void Display::onDmaTransferredFrame()
+void RAM_FUNC(Display::onDmaTransferredFrame)()
 {
     if (m_instance->m_frameCallback)
         m_instance->m_frameCallback(*m_instance);
@@ -218,7 +219,7 @@ void Display::onDmaTransferredFrame()
 
 #else // DISPLAY_PIO
 
-bool Display::rowScan()
+bool RAM_FUNC(Display::rowScan)()
 {
     // Send all pixels for the current row.
     uint32_t rowBits = m_frameBuffer[m_currentRow];
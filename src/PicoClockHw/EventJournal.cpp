@@ -0,0 +1,271 @@
+#include "EventJournal.h"
+#include "FlashLayout.h"
+#include "TimerWheel.h"
+#include "Utils/Trace.h"
+
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// The records are written one after the other into a ring of sectors, without header. The write
+// position is found at boot as the slot after the record with the highest sequence number. When
+// the write position reaches the beginning of a sector, this sector is erased, dropping the oldest
+// records. A page may be programmed several times as records are added to it, which is possible
+// as programming only clears the bits that are 0 in the written data, and the slots not written
+// are filled with 0xFF.
+namespace
+{
+    using Record = EventJournal::Record;
+
+    const int SECTOR_COUNT = FlashLayout::JOURNAL_SECTOR_COUNT;
+    const int RECORDS_PER_PAGE = FLASH_PAGE_SIZE / sizeof(Record);
+    const int RECORDS_PER_SECTOR = FLASH_SECTOR_SIZE / sizeof(Record);
+    const int SLOT_COUNT = SECTOR_COUNT * RECORDS_PER_SECTOR;
+    static_assert(SECTOR_COUNT >= 2, "Erasing a sector must not drop all records");
+
+    const int STAGING_SIZE = 2 * RECORDS_PER_PAGE;
+
+    // Delay before a partially filled page is written, a full page is written immediately.
+    const uint32_t FLUSH_DELAY_MS = 60 * 1000;
+
+    // Delay between the flash operations of a flush
+    const uint32_t STEP_DELAY_MS = 5;
+
+    std::function<time_t()> g_timeSource;
+    bool g_initialized = false;
+    int g_nextSlot = 0; // Slot where the next record is written
+    uint32_t g_nextSequence = 0;
+
+    Record g_staging[STAGING_SIZE];
+    int g_stagingHead = 0; // Oldest staged record
+    int g_stagedCount = 0;
+    TimerWheel::TimerId g_flushTimer = -1;
+    bool g_flushSoon = false; // g_flushTimer is not the delayed one
+
+    EventJournal::Stats g_stats = {};
+
+    int64_t flush(TimerWheel::TimerId id, void *userData);
+
+    uint8_t checksum(const Record &record)
+    {
+        auto bytes = reinterpret_cast<const uint8_t *>(&record);
+        uint8_t sum = 0;
+        for (size_t i = 0; i < offsetof(Record, check); i++)
+            sum += bytes[i];
+        return ~sum;
+    }
+
+    uint32_t slotOffset(int slot)
+    {
+        return FlashLayout::JOURNAL_OFFSET + slot * sizeof(Record);
+    }
+
+    const Record &slotRecord(int slot)
+    {
+        return *reinterpret_cast<const Record *>(FlashLayout::content(slotOffset(slot)));
+    }
+
+    bool isValid(const Record &record)
+    {
+        return record.sequence != 0xFFFFFFFF && record.check == checksum(record);
+    }
+
+    bool isErased(int firstSlot, int count)
+    {
+        const uint8_t *content = FlashLayout::content(slotOffset(firstSlot));
+        return std::all_of(
+            content, content + count * sizeof(Record), [](uint8_t byte) { return byte == 0xFF; });
+    }
+
+    // Called with interrupts disabled
+    void scheduleFlush()
+    {
+        if (!g_initialized || g_stagedCount == 0)
+            return;
+
+        bool pageFull = g_stagedCount >= RECORDS_PER_PAGE - g_nextSlot % RECORDS_PER_PAGE;
+        if (g_flushTimer != -1 && (g_flushSoon || !pageFull))
+            return;
+
+        if (g_flushTimer != -1)
+            TimerWheel::cancel(g_flushTimer);
+
+        g_flushTimer = TimerWheel::addInMs(pageFull ? 0 : FLUSH_DELAY_MS, flush, nullptr);
+        g_flushSoon = pageFull;
+    }
+
+    // Run a flash operation with interrupts disabled, as code running from flash cannot execute
+    // meanwhile.
+    template <typename Operation>
+    void runFlashOperation(Operation operation)
+    {
+        uint32_t interrupts = save_and_disable_interrupts();
+        operation();
+        restore_interrupts(interrupts);
+    }
+
+    // Write the staged records of the page at the write position, one flash operation per call.
+    int64_t flush(TimerWheel::TimerId id, void *userData)
+    {
+        int slot = g_nextSlot;
+        int count = std::min(g_stagedCount, RECORDS_PER_PAGE - slot % RECORDS_PER_PAGE);
+        if (!isErased(slot, count))
+        {
+            if (slot % RECORDS_PER_SECTOR == 0)
+            {
+                // Make room by dropping the oldest records.
+                uint32_t offset = slotOffset(slot);
+                runFlashOperation([offset] { flash_range_erase(offset, FLASH_SECTOR_SIZE); });
+                g_stats.erases++;
+                TRACE << "Erased journal sector at slot" << slot;
+            } else
+            {
+                // Damaged by a power loss while programming, continue in the next page.
+                g_nextSlot = (slot - slot % RECORDS_PER_PAGE + RECORDS_PER_PAGE) % SLOT_COUNT;
+            }
+            return STEP_DELAY_MS * 1000;
+        }
+
+        uint8_t page[FLASH_PAGE_SIZE];
+        memset(page, 0xFF, sizeof(page));
+        for (int i = 0; i < count; i++)
+        {
+            memcpy(
+                page + (slot % RECORDS_PER_PAGE + i) * sizeof(Record),
+                &g_staging[(g_stagingHead + i) % STAGING_SIZE],
+                sizeof(Record));
+        }
+
+        uint32_t offset = slotOffset(slot - slot % RECORDS_PER_PAGE);
+        runFlashOperation([offset, &page] { flash_range_program(offset, page, FLASH_PAGE_SIZE); });
+        g_stats.pagePrograms++;
+
+        uint32_t interrupts = save_and_disable_interrupts();
+        g_stagingHead = (g_stagingHead + count) % STAGING_SIZE;
+        g_stagedCount -= count;
+        g_nextSlot = (slot + count) % SLOT_COUNT;
+
+        bool more = g_stagedCount > 0;
+        if (!more)
+            g_flushTimer = -1;
+        restore_interrupts(interrupts);
+
+        return more ? STEP_DELAY_MS * 1000 : 0;
+    }
+}
+
+void EventJournal::init()
+{
+    // The newest sector starts with the highest sequence number.
+    int newestSector = -1;
+    for (int sector = 0; sector < SECTOR_COUNT; sector++)
+    {
+        const Record &first = slotRecord(sector * RECORDS_PER_SECTOR);
+        if (!isValid(first))
+            continue;
+
+        if (newestSector == -1 || 
+            static_cast<int32_t>(first.sequence - slotRecord(newestSector * RECORDS_PER_SECTOR).sequence) > 0)
+            newestSector = sector;
+    }
+
+    // Continue after the newest record of that sector. Records damaged by a power loss are
+    // skipped.
+    int nextSlot = 0;
+    uint32_t sequence = 0;
+    if (newestSector != -1)
+    {
+        int firstSlot = newestSector * RECORDS_PER_SECTOR;
+        int lastSlot = firstSlot;
+        for (int slot = firstSlot + 1; slot < firstSlot + RECORDS_PER_SECTOR; slot++)
+        {
+            const Record &record = slotRecord(slot);
+            if (isValid(record) && 
+                static_cast<int32_t>(record.sequence - slotRecord(lastSlot).sequence) > 0)
+                lastSlot = slot;
+        }
+        nextSlot = (lastSlot + 1) % SLOT_COUNT;
+        sequence = slotRecord(lastSlot).sequence + 1;
+    }
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    g_nextSlot = nextSlot;
+
+    // Number the events logged before after the ones in flash.
+    for (int i = 0; i < g_stagedCount; i++)
+    {
+        Record &record = g_staging[(g_stagingHead + i) % STAGING_SIZE];
+        record.sequence = sequence++;
+        record.check = checksum(record);
+    }
+    g_nextSequence = sequence;
+
+    g_initialized = true;
+    scheduleFlush();
+    restore_interrupts(interrupts);
+
+    TRACE << "Journal next slot" << nextSlot << "sequence" << sequence;
+}
+
+void EventJournal::setTimeSource(std::function<time_t()> timeSource)
+{
+    g_timeSource = timeSource;
+}
+
+void EventJournal::log(Event type, uint8_t arg, int32_t value)
+{
+    Record record;
+    record.time = g_timeSource ? g_timeSource() : 0;
+    record.value = value;
+    record.type = type;
+    record.arg = arg;
+    record.reserved = 0xFF;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (g_stagedCount == STAGING_SIZE)
+    {
+        g_stats.dropped++;
+    } else
+    {
+        record.sequence = g_nextSequence++;
+        record.check = checksum(record);
+        g_staging[(g_stagingHead + g_stagedCount) % STAGING_SIZE] = record;
+        g_stagedCount++;
+        scheduleFlush();
+    }
+    restore_interrupts(interrupts);
+}
+
+void EventJournal::forEach(std::function<void(const Record &record)> function)
+{
+    // Take the staged records first. The ones flushed meanwhile are then found in flash, and the
+    // records logged and flushed after this copy are skipped, so that each record is given once.
+    Record staged[STAGING_SIZE];
+    uint32_t interrupts = save_and_disable_interrupts();
+    int count = g_stagedCount;
+    for (int i = 0; i < count; i++)
+        staged[i] = g_staging[(g_stagingHead + i) % STAGING_SIZE];
+    int nextSlot = g_nextSlot;
+    uint32_t endSequence = g_nextSequence - count; // Sequence of the first staged record
+    restore_interrupts(interrupts);
+
+    // The slots after the write position contain the oldest records.
+    for (int i = 0; i < SLOT_COUNT; i++)
+    {
+        Record record = slotRecord((nextSlot + i) % SLOT_COUNT);
+        if (isValid(record) && static_cast<int32_t>(record.sequence - endSequence) < 0)
+            function(record);
+    }
+
+    for (int i = 0; i < count; i++)
+        function(staged[i]);
+}
+
+EventJournal::Stats EventJournal::stats()
+{
+    Stats stats = g_stats;
+    stats.staged = g_stagedCount;
+    return stats;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+
+// Journal of notable events kept in a ring of flash sectors, so that it survives resets and power
+// losses and helps diagnosing problems in the field. Events are first put in a RAM staging buffer,
+// which is written to flash by whole pages when full, or after a delay.
+class EventJournal
+{
+public:
+    enum Event : uint8_t
+    {
+        Boot = 1, // arg: 1 if reset by the watchdog or software
+        NtpSync = 2, // value: correction of the clock in ms
+        NtpFailed = 3, // arg: Ntp::State
+        RtcError = 4, // arg: RtcOperation
+        AlarmFired = 5, // arg: alarm id, value: 1 if skipped
+        TimeSet = 6, // value: correction of the clock in s
+        I2cRecovery = 7 // arg: 1 if SDA was held low
+    };
+
+    enum RtcOperation : uint8_t
+    {
+        RtcRead = 0,
+        RtcWrite = 1,
+        RtcTemperature = 2
+    };
+
+    // Stored as is in flash, decoded by tools/journal_decode.py.
+    struct Record
+    {
+        uint32_t sequence; // 0xFFFFFFFF in erased slots
+        uint32_t time; // Time considering DST, 0 if unknown
+        int32_t value;
+        uint8_t type;
+        uint8_t arg;
+        uint8_t reserved;
+        uint8_t check; // Inverted sum of the previous bytes
+    };
+    static_assert(sizeof(Record) == 16, "Records must not straddle pages");
+
+    struct Stats
+    {
+        uint32_t staged; // Records waiting in RAM
+        uint32_t dropped; // Records lost because the staging buffer was full
+        uint32_t pagePrograms;
+        uint32_t erases;
+    };
+
+    // Find the end of the journal in flash. Events logged before are kept in RAM.
+    static void init();
+
+    // Used to timestamp the events, e.g. Clock::now().
+    static void setTimeSource(std::function<time_t()> timeSource);
+
+    // Only copies the event into the staging buffer, can be called from interrupt context.
+    static void log(Event type, uint8_t arg = 0, int32_t value = 0);
+
+    // Call the function for each record, oldest first, including the staged ones. Meant for the
+    // main loop, as it reads the whole journal: records logged or written to flash by interrupts
+    // meanwhile are neither given twice nor missed, the ones logged after the call started are
+    // left out.
+    static void forEach(std::function<void(const Record &record)> function);
+
+    static Stats stats();
+};
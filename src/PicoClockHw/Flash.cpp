@@ -1,62 +1,263 @@
 #include "Flash.h"
 #include "Utils/Trace.h"
 #include "Display.h"
+#include "FlashLayout.h"
+#include "Crc32.h"
 
 #include <hardware/flash.h>
 #include <hardware/sync.h>
+#include <pico/time.h>
 #include <vector>
 #include <cstring>
 #include <algorithm>
+#include <cstddef>
 
+// The data block is stored as a log of records over a ring of sectors. A sector starts with a
+// snapshot record of the whole block, followed by delta records containing only the bytes that
+// changed. Each record starts at a page boundary and is padded with 0xFF, so that a typical
+// change costs one page program. When the current sector is full, the log continues in the next
+// sector of the ring, which is erased and starts with a new snapshot. The newest record wins,
+// as identified by its sequence number.
+//
+// A delta record replaces bytes at fixed offsets, so it is only written if the size of the data
+// block did not change since the last record, and if it fits in one page. Otherwise the record is
+// a snapshot, which takes more pages for a large block and fills the sector faster. The owner of
+// the block should therefore keep its size stable, e.g. with fixed size fields for the values that
+// change on every write.
+//
+// The sector being erased is never the one holding the current records, so a power loss at any
+// time leaves either the new or the previous content readable. At boot, only the headers of the
+// first records of the sectors are checked to find the newest snapshot, the payload is only 
+// verified for that candidate.
 namespace
 {
-    // Offset at the end of the flash with enough room for one sector
-    const uint32_t FLASH_TARGET_OFFSET = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
+    const int SECTOR_COUNT = FlashLayout::SETTINGS_SECTOR_COUNT;
+    const int PAGES_PER_SECTOR = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+    const uint16_t RECORD_MAGIC = 0x5E78;
+    static_assert(SECTOR_COUNT >= 2, "The current sector must not be erased when compacting");
 
-    // Corresponding address
-    const uint8_t *g_flashTargetContent = 
-        reinterpret_cast<const uint8_t *>(XIP_BASE + FLASH_TARGET_OFFSET);
+    enum RecordType : uint8_t
+    {
+        Snapshot = 1, // Payload is the whole data block
+        Delta = 2 // Payload is a list of (offset: uint16, size: uint8, bytes)
+    };
 
-    // Delay before the modified memory block gets written to flash.
-    const uint32_t WRITE_DELAY_MS = 60 * 1000;
+    struct RecordHeader
+    {
+        uint16_t magic;
+        RecordType type;
+        uint8_t reserved;
+        uint16_t payloadSize;
+        uint16_t reserved2;
+        uint32_t sequence;
+        uint32_t payloadCrc; // CRC-32 of the payload
+        uint32_t headerCrc; // CRC-32 of the header up to this field
+    };
 
-    const uint8_t HEADER_VERSION = 1;
+    const size_t DELTA_ENTRY_HEADER_SIZE = 3;
+    const size_t MAX_DELTA_ENTRY_SIZE = 255;
 
-    struct Header
+    // Format written by previous versions into a single sector, only read for migration
+    const uint8_t LEGACY_HEADER_VERSION = 1;
+    struct LegacyHeader
     {
         uint8_t version; // Version of the header (not of the data)
         size_t dataSize;
         uint32_t dataHash;
     };
 
-    uint32_t hash(const uint8_t *data, size_t size)
+    // Delay between the steps of a commit
+    const uint32_t STEP_DELAY_MS = 5;
+
+    // State of the log
+    int g_sector = -1; // Sector containing the newest record, -1 if none
+    int g_nextPage = 0; // Page after the newest record
+    uint32_t g_sequence = 0; // Sequence number of the newest record
+    std::vector<uint8_t> g_persisted; // Content of the data block as stored in flash
+
+    // Commit of a record in progress, done in steps
+    struct Commit
+    {
+        bool active = false;
+        bool writeAgain = false; // The data was modified during the commit
+        int sector;
+        int page; // First page of the record
+        bool erase; // The sector needs to be erased first
+        std::vector<uint8_t> pages; // Record padded to pages
+        int programmedPages;
+        std::vector<uint8_t> data; // Data block as written by the commit
+        uint32_t maxBlockedUs;
+    };
+    Commit g_commit;
+
+    Flash::Stats g_stats = {};
+    Flash::Wear g_wear = {};
+    uint32_t g_blockedUsRemainder = 0; // Not yet counted in g_wear.blockedMs
+
+    uint32_t sectorOffset(int sector)
+    {
+        return FlashLayout::SETTINGS_OFFSET + sector * FLASH_SECTOR_SIZE;
+    }
+
+    const uint8_t *pageContent(int sector, int page)
+    {
+        return FlashLayout::content(sectorOffset(sector) + page * FLASH_PAGE_SIZE);
+    }
+
+    int pagesOfRecord(size_t payloadSize)
+    {
+        return (sizeof(RecordHeader) + payloadSize + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    }
+
+    uint32_t headerCrc(const RecordHeader &header)
+    {
+        return Crc32::compute(
+            reinterpret_cast<const uint8_t *>(&header), offsetof(RecordHeader, headerCrc));
+    }
+
+    // Return the record header at the given page, or nullptr if there is no valid one. The
+    // payload is not checked.
+    const RecordHeader *validHeader(int sector, int page)
+    {
+        auto header = reinterpret_cast<const RecordHeader *>(pageContent(sector, page));
+        if (header->magic != RECORD_MAGIC ||
+            page + pagesOfRecord(header->payloadSize) > PAGES_PER_SECTOR ||
+            header->headerCrc != headerCrc(*header))
+            return nullptr;
+
+        return header;
+    }
+
+    bool hasValidPayload(const RecordHeader &header)
+    {
+        auto payload = reinterpret_cast<const uint8_t *>(&header + 1);
+        return header.payloadCrc == Crc32::compute(payload, header.payloadSize);
+    }
+
+    // Return the record starting at the given page, or nullptr if it is missing or invalid.
+    const RecordHeader *validRecord(int sector, int page)
+    {
+        const RecordHeader *header = validHeader(sector, page);
+        if (header == nullptr || !hasValidPayload(*header))
+            return nullptr;
+
+        return header;
+    }
+
+    bool isErased(int sector, int firstPage, int pageCount)
     {
+        const uint8_t *content = pageContent(sector, firstPage);
+        for (size_t i = 0; i < pageCount * FLASH_PAGE_SIZE; i++)
+        {
+            if (content[i] != 0xFF)
+                return false;
+        }
+        return true;
+    }
+
+    void applyRecord(const RecordHeader &header, uint8_t *data, size_t size)
+    {
+        auto payload = reinterpret_cast<const uint8_t *>(&header + 1);
+        if (header.type == Snapshot)
+        {
+            // Can be shorter than the data block if it was written by an old version of the
+            // program, or longer if it was written by a newer version.
+            memcpy(data, payload, std::min<size_t>(header.payloadSize, size));
+            return;
+        }
+
+        size_t pos = 0;
+        while (pos + DELTA_ENTRY_HEADER_SIZE <= header.payloadSize)
+        {
+            size_t offset = payload[pos] | (payload[pos + 1] << 8);
+            size_t entrySize = payload[pos + 2];
+            pos += DELTA_ENTRY_HEADER_SIZE;
+            if (pos + entrySize > header.payloadSize)
+                break;
+            if (offset + entrySize <= size)
+                memcpy(data + offset, payload + pos, entrySize);
+            pos += entrySize;
+        }
+    }
+
+    // Append the bytes that differ from the persisted content as delta entries.
+    void makeDelta(const uint8_t *data, size_t size, std::vector<uint8_t> &payload)
+    {
+        size_t pos = 0;
+        while (pos < size)
+        {
+            if (data[pos] == g_persisted[pos])
+            {
+                pos++;
+                continue;
+            }
+
+            // Extend the run while bytes differ. Short runs of equal bytes are included, as
+            // they cost less than the header of a new entry.
+            size_t end = pos + 1;
+            while (end < size && end - pos < MAX_DELTA_ENTRY_SIZE)
+            {
+                if (data[end] != g_persisted[end])
+                    end++;
+                else if (end + DELTA_ENTRY_HEADER_SIZE <= size &&
+                         memcmp(data + end, g_persisted.data() + end, DELTA_ENTRY_HEADER_SIZE) != 0)
+                    end++;
+                else
+                    break;
+            }
+
+            payload.push_back(pos & 0xFF);
+            payload.push_back(pos >> 8);
+            payload.push_back(end - pos);
+            payload.insert(payload.end(), data + pos, data + end);
+            pos = end;
+        }
+    }
+
+    // Read the format of previous versions from its single sector.
+    int readLegacy(uint8_t *data, size_t size)
+    {
+        const uint8_t *content = FlashLayout::content(FlashLayout::LEGACY_SETTINGS_OFFSET);
+        auto *header = reinterpret_cast<const LegacyHeader *>(content);
+        if (header->version != LEGACY_HEADER_VERSION ||
+            header->dataSize > FLASH_SECTOR_SIZE - sizeof(LegacyHeader))
+        {
+            TRACE << "No legacy data";
+            return -1;
+        }
+
         // Calculate djb2 hash
         uint32_t hash = 5381;
-        while (size != 0)
+        for (size_t i = 0; i < header->dataSize; i++)
+            hash = (hash << 5) + hash + content[sizeof(LegacyHeader) + i];
+        if (hash != header->dataHash)
         {
-            hash = (hash << 5) + hash + *data;
-            data++;
-            size--;
+            TRACE << "Invalid hash";
+            return -1;
         }
-        return hash;        
+
+        size_t bytesToRead = std::min(header->dataSize, size);
+        memcpy(data, content + sizeof(LegacyHeader), bytesToRead);
+        return bytesToRead;
     }
 }
 
 uint8_t *Flash::m_data = nullptr;
+size_t Flash::m_capacity = 0;
 size_t Flash::m_size = 0;
-alarm_id_t Flash::m_writeAlarm = -1;
+TimerWheel::TimerId Flash::m_writeAlarm = -1;
 
-bool Flash::attach(uint8_t *data, size_t size)
+bool Flash::attach(uint8_t *data, size_t capacity)
 {
-    if (sizeof(Header) + size > FLASH_SECTOR_SIZE)
+    if (pagesOfRecord(capacity) > PAGES_PER_SECTOR || capacity > 0xFFFF)
     {
         TRACE << "Total data size bigger than a sector not supported";
         return false;
     }
 
     m_data = data;
-    m_size = size;
+    m_capacity = capacity;
+    m_size = 0;
     return true;
 }
 
@@ -68,66 +269,220 @@ int Flash::read()
         return -1;
     }
 
-    auto *header = reinterpret_cast<const Header *>(g_flashTargetContent);
-    if (header->version != HEADER_VERSION)
+    // The state of the log is reloaded, so a commit in progress would be based on an old state.
+    g_commit.active = false;
+
+    // Order the sectors starting with a snapshot by sequence number, newest first, only looking at
+    // the headers.
+    const RecordHeader *headers[SECTOR_COUNT];
+    int sectors[SECTOR_COUNT];
+    int candidateCount = 0;
+    for (int sector = 0; sector < SECTOR_COUNT; sector++)
     {
-        TRACE << "Unsupported header version or unexpected content";
-        return -1;
+        const RecordHeader *header = validHeader(sector, 0);
+        if (header == nullptr || header->type != Snapshot)
+            continue;
+
+        int i = candidateCount++;
+        while (i > 0 && static_cast<int32_t>(header->sequence - headers[i - 1]->sequence) > 0)
+        {
+            headers[i] = headers[i - 1];
+            sectors[i] = sectors[i - 1];
+            i--;
+        }
+        headers[i] = header;
+        sectors[i] = sector;
     }
-    if (header->dataSize > FLASH_SECTOR_SIZE - sizeof(Header))
+
+    // Take the newest snapshot with a valid payload. Older ones are only used if the newest one
+    // was damaged, e.g. by a power loss while writing it.
+    g_sector = -1;
+    for (int i = 0; i < candidateCount && g_sector == -1; i++)
     {
-        TRACE << "Invalid size";
-        return -1;
+        if (hasValidPayload(*headers[i]))
+        {
+            g_sector = sectors[i];
+            g_sequence = headers[i]->sequence;
+        } else
+            TRACE << "Invalid snapshot in sector" << sectors[i];
     }
-    if (header->dataHash != hash(g_flashTargetContent + sizeof(Header), header->dataSize))
+
+    int bytesRead;
+    if (g_sector == -1)
     {
-        TRACE << "Invalid hash";
-        return -1;
-    }
+        TRACE << "No log found, trying the legacy format";
+        bytesRead = readLegacy(m_data, m_capacity);
+    } else
+    {
+        // Replay the records of the sector until the first one missing or invalid, e.g. because
+        // the power was lost while writing it.
+        const RecordHeader *header = validHeader(g_sector, 0);
+        applyRecord(*header, m_data, m_capacity);
+        bytesRead = std::min<size_t>(header->payloadSize, m_capacity);
+        g_nextPage = pagesOfRecord(header->payloadSize);
 
-    // Data present in the flash can be shorter than the attached data block if it was written by an
-    // old version of the program. It can also be longer if it was written by a newer version.
-    size_t bytesToRead = std::min(header->dataSize, m_size);
+        while (g_nextPage < PAGES_PER_SECTOR)
+        {
+            header = validRecord(g_sector, g_nextPage);
+            if (header == nullptr || header->sequence != g_sequence + 1)
+                break;
 
-    memcpy(m_data, g_flashTargetContent + sizeof(Header), bytesToRead);
+            applyRecord(*header, m_data, bytesRead);
+            g_sequence = header->sequence;
+            g_nextPage += pagesOfRecord(header->payloadSize);
+        }
+        TRACE << "Log in sector" << g_sector << "sequence" << g_sequence << "next page" << g_nextPage;
 
-    return bytesToRead;
+        if (g_sector != sectors[0])
+        {
+            // Continue with a snapshot newer than the damaged one, which will be erased.
+            g_sequence = headers[0]->sequence;
+            g_nextPage = PAGES_PER_SECTOR;
+        }
+    }
+
+    // Used to compute deltas. If nothing could be read, the first write will be a snapshot.
+    if (bytesRead >= 0)
+        m_size = bytesRead;
+    if (bytesRead >= 0 && g_sector != -1)
+        g_persisted.assign(m_data, m_data + m_size);
+
+    return bytesRead;
 }
 
-void Flash::scheduleWrite()
+void Flash::startWrite(size_t size)
 {
-    TRACE << "Data size:" << m_size;
+    TRACE << "Data size:" << size;
     if (m_data)
     {
-        if (m_writeAlarm != -1)
-            cancel_alarm(m_writeAlarm);
+        // The commit in progress, if any, works on its own copy of the data.
+        m_size = std::min(size, m_capacity);
+
+        if (g_commit.active)
+        {
+            // Do not interrupt the commit, write again when it is finished.
+            g_commit.writeAgain = true;
+            return;
+        }
 
-        m_writeAlarm = add_alarm_in_ms(WRITE_DELAY_MS, &Flash::write, nullptr, false);
+        if (m_writeAlarm == -1)
+            m_writeAlarm = TimerWheel::addInMs(0, &Flash::write, nullptr);
     } else
         TRACE << "No data attached";
 }
 
-int64_t Flash::write(alarm_id_t id, void *user_data)
+Flash::Stats Flash::stats()
 {
-    if (m_size == reinterpret_cast<const Header *>(g_flashTargetContent)->dataSize &&
-        memcmp(m_data, g_flashTargetContent + sizeof(Header), m_size) == 0)
+    return g_stats;
+}
+
+Flash::Wear Flash::wear()
+{
+    return g_wear;
+}
+
+void Flash::restoreWear(const Wear &wear)
+{
+    g_wear = wear;
+}
+
+void Flash::countSkippedWrite()
+{
+    g_wear.skippedWrites++;
+}
+
+int64_t Flash::write(TimerWheel::TimerId id, void *user_data)
+{
+    if (!g_commit.active && !startCommit())
     {
-        TRACE << "Data did not change, no need to flash.";
+        // Do not reschedule
         m_writeAlarm = -1;
-        return 0;        
+        return 0;
     }
 
-    // Prepare header
-    Header header;
-    header.version = HEADER_VERSION;
-    header.dataSize = m_size;
-    header.dataHash = hash(m_data, m_size);
+    if (commitStep())
+    {
+        // Let the interrupts that were delayed by the flash operation be handled before the next 
+        // step.
+        return STEP_DELAY_MS * 1000;
+    }
 
-    // Make a copy of the header and data, padded with zeroes and aligned on pages
-    std::vector<uint8_t> dataCopy(
-        (sizeof(Header) + m_size + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE, 0);
-    memcpy(dataCopy.data(), &header, sizeof(header));
-    memcpy(dataCopy.data() + sizeof(header), m_data, m_size);
+    m_writeAlarm = -1;
+    if (g_commit.writeAgain)
+    {
+        g_commit.writeAgain = false;
+        startWrite(m_size);
+    }
+    return 0;
+}
+
+bool Flash::startCommit()
+{
+    bool hasPersisted = g_sector != -1 && g_persisted.size() == m_size;
+    if (hasPersisted && memcmp(m_data, g_persisted.data(), m_size) == 0)
+    {
+        TRACE << "Data did not change, no need to flash.";
+        countSkippedWrite();
+        return false;
+    }
+
+    // Keep a copy of the data being written, as it may be modified during the commit.
+    g_commit.data.assign(m_data, m_data + m_size);
+
+    // Prefer a delta record if it fits in one page and in the current sector
+    std::vector<uint8_t> payload;
+    RecordType type = Delta;
+    if (hasPersisted)
+        makeDelta(m_data, m_size, payload);
+    if (!hasPersisted || pagesOfRecord(payload.size()) > 1)
+    {
+        type = Snapshot;
+        payload = g_commit.data;
+    }
+
+    g_commit.sector = g_sector;
+    g_commit.page = g_nextPage;
+    g_commit.erase = false;
+    if (g_commit.sector == -1 || 
+        g_commit.page + pagesOfRecord(payload.size()) > PAGES_PER_SECTOR ||
+        !isErased(g_commit.sector, g_commit.page, pagesOfRecord(payload.size())))
+    {
+        // Continue in the next sector of the ring, starting with a snapshot
+        TRACE << "Compacting into the next sector";
+        g_commit.sector = (g_commit.sector + 1) % SECTOR_COUNT;
+        g_commit.page = 0;
+        g_commit.erase = true;
+        type = Snapshot;
+        payload = g_commit.data;
+    }
+
+    // Prepare the record, padded with 0xFF to a page boundary so that the rest of the page stays
+    // erased.
+    RecordHeader header = {};
+    header.magic = RECORD_MAGIC;
+    header.type = type;
+    header.payloadSize = payload.size();
+    header.sequence = g_sequence + 1;
+    header.payloadCrc = Crc32::compute(payload.data(), payload.size());
+    header.headerCrc = headerCrc(header);
+
+    g_commit.pages.assign(pagesOfRecord(payload.size()) * FLASH_PAGE_SIZE, 0xFF);
+    memcpy(g_commit.pages.data(), &header, sizeof(header));
+    memcpy(g_commit.pages.data() + sizeof(header), payload.data(), payload.size());
+    g_commit.programmedPages = 0;
+    g_commit.maxBlockedUs = 0;
+    g_commit.active = true;
+    return true;
+}
+
+bool Flash::commitStep()
+{
+    // Code running from flash cannot execute during a flash operation, so interrupts are disabled
+    // for each operation. The operations are kept as small as possible: the erase of one sector,
+    // which cannot be split, or the program of one page.
+    int programmedPages = g_commit.programmedPages;
+    uint32_t offset = 
+        sectorOffset(g_commit.sector) + (g_commit.page + programmedPages) * FLASH_PAGE_SIZE;
 
 #ifndef DISPLAY_PIO
     // As row scanning cannot run during flashing, turn off the display.
@@ -140,13 +495,15 @@ int64_t Flash::write(alarm_id_t id, void *user_data)
     }
 #endif
 
-    // Erase and program
+    uint64_t startUs = time_us_64();
     uint32_t interrupts = save_and_disable_interrupts();
-    TRACE <<"Erasing target region...";
-    flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
-    TRACE <<"Programming target region...";
-    flash_range_program(FLASH_TARGET_OFFSET, dataCopy.data(), dataCopy.size());
+    if (g_commit.erase)
+        flash_range_erase(sectorOffset(g_commit.sector), FLASH_SECTOR_SIZE);
+    else
+        flash_range_program(
+            offset, g_commit.pages.data() + programmedPages * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
     restore_interrupts(interrupts);
+    uint32_t blockedUs = time_us_64() - startUs;
 
 #ifndef DISPLAY_PIO
     // Turn on display again
@@ -154,7 +511,46 @@ int64_t Flash::write(alarm_id_t id, void *user_data)
         display->setBrightness(savedBrightness);
 #endif
 
-    // Do not reschedule
-    m_writeAlarm = -1;
-    return 0;
+    g_commit.maxBlockedUs = std::max(g_commit.maxBlockedUs, blockedUs);
+    g_blockedUsRemainder += blockedUs;
+    g_wear.blockedMs += g_blockedUsRemainder / 1000;
+    g_blockedUsRemainder %= 1000;
+    if (g_commit.erase)
+    {
+        TRACE << "Erased sector" << g_commit.sector << "in" << blockedUs << "us";
+        g_commit.erase = false;
+        g_stats.erases++;
+        g_stats.maxEraseUs = std::max(g_stats.maxEraseUs, blockedUs);
+        g_wear.erases++;
+        return true;
+    }
+
+    TRACE << "Programmed page" << g_commit.page + programmedPages << "of sector" 
+          << g_commit.sector << "in" << blockedUs << "us";
+    g_commit.programmedPages++;
+    g_stats.pagePrograms++;
+    g_stats.maxProgramUs = std::max(g_stats.maxProgramUs, blockedUs);
+    g_wear.pagePrograms++;
+    if (g_commit.programmedPages * FLASH_PAGE_SIZE < g_commit.pages.size())
+        return true;
+
+    // All pages programmed, finish the commit
+    g_commit.active = false;
+    g_stats.commits++;
+    g_stats.lastCommitMaxBlockedUs = g_commit.maxBlockedUs;
+    g_stats.maxBlockedUs = std::max(g_stats.maxBlockedUs, g_commit.maxBlockedUs);
+    g_sector = g_commit.sector;
+
+    if (validRecord(g_commit.sector, g_commit.page) == nullptr)
+    {
+        // Programming failed. Make the next write go to a freshly erased sector.
+        TRACE << "Verification failed";
+        g_nextPage = PAGES_PER_SECTOR;
+        return false;
+    }
+
+    g_nextPage = g_commit.page + g_commit.programmedPages;
+    g_sequence++;
+    g_persisted = g_commit.data;
+    return false;
 }
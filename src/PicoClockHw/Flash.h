@@ -1,27 +1,60 @@
 #pragma once
 
+#include "TimerWheel.h"
+
 #include <cstdint>
 #include <cstddef>
-#include <pico/time.h>
 
 class Flash
 {
 public:
-    // Attach a data block to be read/written from/to flash. It must remain accessible all
-    // the time. 
-    static bool attach(uint8_t *data, size_t size);
+    // Attach a data block of up to capacity bytes to be read/written from/to flash. It must 
+    // remain accessible all the time. 
+    static bool attach(uint8_t *data, size_t capacity);
 
     // Read the data block from flash, return the number of bytes read or -1 if it failed.
     static int read();
 
-    // Schedule the given data block to be written to flash later (as simple measure 
-    // to mitigate wear). Calling the method again restarts the delay.
-    static void scheduleWrite();
+    // Start writing the first size bytes of the data block to flash. The write is done in steps
+    // from interrupt context. If a write is in progress, the block is written again once it is
+    // finished. Delaying writes to mitigate wear is left to the caller.
+    static void startWrite(size_t size);
+
+    // Since the start of the program
+    struct Stats
+    {
+        uint32_t commits;
+        uint32_t erases;
+        uint32_t pagePrograms;
+        uint32_t maxBlockedUs; // Longest time with interrupts disabled for a flash operation
+        uint32_t lastCommitMaxBlockedUs;
+        uint32_t maxEraseUs;
+        uint32_t maxProgramUs;
+    };
+    static Stats stats();
+
+    // Since the first use of the flash, to estimate its wear. The counters are persisted by the 
+    // owner of the data block along with it, and restored after reading it.
+    struct Wear
+    {
+        uint32_t erases;
+        uint32_t pagePrograms;
+        uint32_t skippedWrites; // Writes dropped as the data did not change
+        uint32_t blockedMs; // Time with interrupts disabled for flash operations
+    };
+    static Wear wear();
+    static void restoreWear(const Wear &wear);
+
+    // For writes dropped by the owner of the data block as it did not change
+    static void countSkippedWrite();
 
 private:
-    static int64_t write(alarm_id_t id, void *user_data);
+    static int64_t write(TimerWheel::TimerId id, void *user_data);
+    static bool startCommit();
+    static bool commitStep(); // Return true if more steps are needed
 
     static uint8_t *m_data;
-    static size_t m_size;
-    static alarm_id_t m_writeAlarm;
+    static size_t m_capacity;
+    static size_t m_size; // Size of the data currently in the block
+    static TimerWheel::TimerId m_writeAlarm;
 };
\ No newline at end of file
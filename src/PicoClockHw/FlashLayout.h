@@ -0,0 +1,33 @@
+#pragma once
+
+#include <hardware/flash.h>
+#include <cstdint>
+
+// Sectors reserved at the end of the flash for data, counting from the end. Host tools writing
+// to these sectors must use the same offsets.
+class FlashLayout
+{
+public:
+    // Ring of sectors used by the settings log. More sectors spread the erase cycles further.
+    static const int SETTINGS_SECTOR_COUNT = 4;
+    static const uint32_t SETTINGS_OFFSET = 
+        PICO_FLASH_SIZE_BYTES - SETTINGS_SECTOR_COUNT * FLASH_SECTOR_SIZE;
+
+    // Single settings sector written by previous versions, part of the ring
+    static const uint32_t LEGACY_SETTINGS_OFFSET = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
+
+    static const uint32_t HOLIDAYS_OFFSET = SETTINGS_OFFSET - FLASH_SECTOR_SIZE;
+
+    // Ring of sectors used by EventJournal
+    static const int JOURNAL_SECTOR_COUNT = 2;
+    static const uint32_t JOURNAL_OFFSET = HOLIDAYS_OFFSET - JOURNAL_SECTOR_COUNT * FLASH_SECTOR_SIZE;
+
+    // Checkpoint of TemperatureHistory
+    static const uint32_t TEMPERATURE_HISTORY_OFFSET = JOURNAL_OFFSET - FLASH_SECTOR_SIZE;
+
+    // Memory mapped content at the given offset
+    static const uint8_t *content(uint32_t offset)
+    {
+        return reinterpret_cast<const uint8_t *>(XIP_BASE + offset);
+    }
+};
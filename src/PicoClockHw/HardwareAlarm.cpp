@@ -0,0 +1,47 @@
+#include "HardwareAlarm.h"
+#include "Platform.h"
+
+#include <hardware/timer.h>
+
+namespace
+{
+    // Delay used to retry if the target was missed while it was being set.
+    const uint64_t MISSED_TARGET_RETRY_US = 10;
+}
+
+HardwareAlarm *HardwareAlarm::m_alarmByNum[MAX_ALARMS] = {};
+
+HardwareAlarm::HardwareAlarm(std::function<void()> callback) : m_callback(callback)
+{
+    m_alarmNum = hardware_alarm_claim_unused(true);
+    m_alarmByNum[m_alarmNum] = this;
+    hardware_alarm_set_callback(m_alarmNum, dispatcher);
+}
+
+HardwareAlarm::~HardwareAlarm()
+{
+    hardware_alarm_cancel(m_alarmNum);
+    hardware_alarm_set_callback(m_alarmNum, nullptr);
+    m_alarmByNum[m_alarmNum] = nullptr;
+    hardware_alarm_unclaim(m_alarmNum);
+}
+
+void RAM_FUNC(HardwareAlarm::setTarget)(uint64_t timeUs)
+{
+    // hardware_alarm_set_target returns true if the target is already in the past, in which case
+    // the callback would not be called. Retry with a target in the near future.
+    while (hardware_alarm_set_target(m_alarmNum, from_us_since_boot(timeUs)))
+        timeUs = time_us_64() + MISSED_TARGET_RETRY_US;
+}
+
+void RAM_FUNC(HardwareAlarm::cancel)()
+{
+    hardware_alarm_cancel(m_alarmNum);
+}
+
+void RAM_FUNC(HardwareAlarm::dispatcher)(unsigned int alarmNum)
+{
+    HardwareAlarm *alarm = m_alarmByNum[alarmNum];
+    if (alarm != nullptr && alarm->m_callback)
+        alarm->m_callback();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <functional>
+#include <cstdint>
+
+// One-shot alarm driven by a dedicated hardware timer alarm, so that it does not depend on the
+// alarm pool of the Pico SDK. The callback is called from interrupt context.
+class HardwareAlarm
+{
+public:
+    HardwareAlarm(std::function<void()> callback);
+    ~HardwareAlarm();
+
+    // Make the callback fire once at the given time, as returned by Platform::timeUs(). If the 
+    // time has already passed, it fires as soon as possible. Replaces any previously set target.
+    void setTarget(uint64_t timeUs);
+    void cancel();
+
+private:
+    static void dispatcher(unsigned int alarmNum);
+
+    static const int MAX_ALARMS = 4; // Number of alarms of the RP2040 timer
+    static HardwareAlarm *m_alarmByNum[MAX_ALARMS];
+
+    int m_alarmNum = -1;
+    std::function<void()> m_callback;
+};
@@ -0,0 +1,423 @@
+#include "I2cBus.h"
+#include "EventJournal.h"
+#include "Platform.h"
+#include "TimerWheel.h"
+#include "gpio.h"
+#include "Utils/Trace.h"
+
+#include <hardware/gpio.h>
+#include <hardware/i2c.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <algorithm>
+#include <cstring>
+
+// The transaction at the head of the queue is the one on the bus. Its commands are pushed into the
+// TX FIFO of the controller when it runs low, the last one with STOP, and the read bytes are taken
+// from the RX FIFO as they arrive. The transaction ends on the STOP condition, which the
+// controller also generates after an abort, e.g. when the device does not acknowledge.
+//
+// A device interrupted in the middle of a byte, e.g. by a reset of the RP2040, may hold SDA low
+// while waiting for the clock pulses of the rest of the byte, so that no transaction is possible.
+// The recovery sends up to 9 pulses on SCL until SDA is released, then a STOP condition.
+namespace
+{
+    const auto I2C_PORT = i2c1;
+    const int QUEUE_SIZE = 4;
+    const size_t FIFO_DEPTH = 16;
+
+    // Longest expected transaction is about 2 ms at 100 kHz. Beyond that, the bus is stuck.
+    const uint32_t TIMEOUT_MS = 20;
+
+    // Address NACKs are expected when the device is missing, so they trigger a recovery only when
+    // repeated.
+    const uint32_t MAX_CONSECUTIVE_FAILURES = 3;
+    const int RECOVERY_CLOCK_PULSES = 9;
+    const uint32_t RECOVERY_HALF_PERIOD_US = 5; // 100 kHz
+
+    const uint32_t FIRST_LATENCY_BUCKET_US = 64;
+
+    const uint32_t NACK_ABORT_SOURCES = 
+        I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS | I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS;
+
+    enum Result
+    {
+        Ok,
+        Nack,
+        Timeout,
+        Aborted
+    };
+
+    struct Transaction
+    {
+        uint8_t address;
+        uint8_t writeData[I2cBus::MAX_WRITE_SIZE];
+        uint8_t writeSize;
+        uint8_t readSize;
+        uint8_t kind;
+        uint64_t queuedUs;
+        I2cBus::Callback callback;
+    };
+
+    unsigned int g_baudrate = 0;
+    Transaction g_queue[QUEUE_SIZE];
+    int g_head = 0;
+    int g_count = 0;
+
+    // State of the transaction on the bus
+    bool g_active = false;
+    bool g_aborted = false;
+    uint32_t g_abortSource = 0;
+    size_t g_commandsSent = 0;
+    size_t g_bytesRead = 0;
+    uint8_t g_readData[I2cBus::MAX_READ_SIZE];
+    TimerWheel::TimerId g_timeoutTimer = -1;
+
+    I2cBus::Stats g_stats[I2cBus::MAX_KINDS] = {};
+    I2cBus::Health g_health = {};
+
+    void start();
+
+    i2c_hw_t *hw()
+    {
+        return i2c_get_hw(I2C_PORT);
+    }
+
+    void pushCommands()
+    {
+        const Transaction &transaction = g_queue[g_head];
+        size_t total = transaction.writeSize + transaction.readSize;
+        while (g_commandsSent < total && hw()->txflr < FIFO_DEPTH)
+        {
+            size_t i = g_commandsSent++;
+            uint32_t command;
+            if (i < transaction.writeSize)
+            {
+                command = transaction.writeData[i];
+            } else
+            {
+                command = I2C_IC_DATA_CMD_CMD_BITS;
+                if (i == transaction.writeSize && transaction.writeSize > 0)
+                    command |= I2C_IC_DATA_CMD_RESTART_BITS;
+            }
+            if (i == total - 1)
+                command |= I2C_IC_DATA_CMD_STOP_BITS;
+            hw()->data_cmd = command;
+        }
+
+        if (g_commandsSent == total)
+            hw()->intr_mask &= ~I2C_IC_INTR_MASK_M_TX_EMPTY_BITS;
+    }
+
+    void pullReadBytes()
+    {
+        while (hw()->rxflr > 0)
+        {
+            uint8_t byte = hw()->data_cmd;
+            if (g_bytesRead < g_queue[g_head].readSize)
+                g_readData[g_bytesRead++] = byte;
+        }
+    }
+
+    // Set the registers that i2c_init() leaves to their defaults.
+    void configure()
+    {
+        // Interrupt on every received byte and when the TX FIFO is empty.
+        hw()->intr_mask = 0;
+        hw()->rx_tl = 0;
+        hw()->tx_tl = 0;
+    }
+
+    // Emulate an open drain output, the pull-up making the line high when released.
+    void driveLow(unsigned int pin, bool low)
+    {
+        gpio_set_dir(pin, low ? GPIO_OUT : GPIO_IN);
+        busy_wait_us_32(RECOVERY_HALF_PERIOD_US);
+    }
+
+    // Called in interrupt context, or with interrupts disabled. Takes about 100 us.
+    void recoverBus()
+    {
+        hw()->enable = 0;
+        for (unsigned int pin : {SDA, SCL})
+        {
+            gpio_set_function(pin, GPIO_FUNC_SIO);
+            gpio_set_dir(pin, GPIO_IN);
+            gpio_put(pin, false);
+        }
+        busy_wait_us_32(RECOVERY_HALF_PERIOD_US);
+
+        bool stuck = !gpio_get(SDA);
+        for (int i = 0; i < RECOVERY_CLOCK_PULSES && !gpio_get(SDA); i++)
+        {
+            driveLow(SCL, true);
+            driveLow(SCL, false);
+        }
+
+        // STOP: SDA rising while SCL is high
+        driveLow(SCL, true);
+        driveLow(SDA, true);
+        driveLow(SCL, false);
+        driveLow(SDA, false);
+
+        TRACE << "I2C bus recovered, SDA" << (stuck ? "was stuck" : "was free") << ", now" 
+              << (gpio_get(SDA) ? "free" : "stuck");
+        g_health.recoveries++;
+        if (stuck)
+            g_health.stuckSda++;
+        EventJournal::log(EventJournal::I2cRecovery, stuck);
+
+        gpio_set_function(SDA, GPIO_FUNC_I2C);
+        gpio_set_function(SCL, GPIO_FUNC_I2C);
+        i2c_init(I2C_PORT, g_baudrate);
+        configure();
+    }
+
+    void count(const Transaction &transaction, Result result)
+    {
+        I2cBus::Stats &stats = g_stats[transaction.kind];
+        stats.transfers++;
+        if (result == Nack)
+            stats.nacks++;
+        else if (result == Timeout)
+            stats.timeouts++;
+        else if (result == Aborted)
+            stats.aborts++;
+
+        uint32_t latencyUs = Platform::timeUs() - transaction.queuedUs;
+        stats.maxLatencyUs = std::max(stats.maxLatencyUs, latencyUs);
+        int bucket = 0;
+        while (bucket < I2cBus::LATENCY_BUCKETS - 1 && 
+               latencyUs >= FIRST_LATENCY_BUCKET_US << bucket)
+            bucket++;
+        stats.latencyHistogram[bucket]++;
+
+        if (result == Ok)
+            g_health.consecutiveFailures = 0;
+        else
+            g_health.consecutiveFailures++;
+    }
+
+    // Called in interrupt context, or with interrupts disabled
+    void finish(Result result)
+    {
+        hw()->intr_mask = 0;
+        if (g_timeoutTimer != -1)
+        {
+            TimerWheel::cancel(g_timeoutTimer);
+            g_timeoutTimer = -1;
+        }
+
+        Transaction &transaction = g_queue[g_head];
+        if (result == Ok && g_bytesRead != transaction.readSize)
+            result = Aborted;
+        count(transaction, result);
+
+        // A NACK of the address leaves the bus idle, other failures may leave the device in the
+        // middle of a byte.
+        bool repeatedFailure = 
+            result != Ok && g_health.consecutiveFailures % MAX_CONSECUTIVE_FAILURES == 0;
+        if ((result != Ok && result != Nack) || repeatedFailure)
+            recoverBus();
+
+        bool ok = result == Ok;
+        I2cBus::Callback callback = std::move(transaction.callback);
+        transaction.callback = nullptr;
+        uint8_t data[I2cBus::MAX_READ_SIZE];
+        size_t size = ok ? g_bytesRead : 0;
+        memcpy(data, g_readData, size);
+
+        g_head = (g_head + 1) % QUEUE_SIZE;
+        g_count--;
+        g_active = false;
+
+        // The callback may queue the next transaction, e.g. to retry.
+        if (callback)
+            callback(ok, data, size);
+
+        if (!g_active && g_count > 0)
+            start();
+    }
+
+    int64_t onTimeout(TimerWheel::TimerId id, void *userData)
+    {
+        TRACE << "I2C transaction timed out";
+        g_timeoutTimer = -1;
+
+        // Disabling the controller flushes the FIFOs and releases the bus.
+        hw()->intr_mask = 0;
+        hw()->enable = 0;
+        finish(Timeout);
+        return 0;
+    }
+
+    void onInterrupt()
+    {
+        uint32_t status = hw()->intr_stat;
+
+        if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+        {
+            // The controller flushes the TX FIFO and sends STOP, finish there.
+            g_abortSource = hw()->tx_abrt_source;
+            TRACE << "I2C transaction aborted, source" << g_abortSource;
+            g_aborted = true;
+            hw()->intr_mask &= ~I2C_IC_INTR_MASK_M_TX_EMPTY_BITS;
+            (void)hw()->clr_tx_abrt;
+        }
+
+        if (status & I2C_IC_INTR_STAT_R_RX_FULL_BITS)
+            pullReadBytes();
+
+        if (!g_aborted && (status & I2C_IC_INTR_STAT_R_TX_EMPTY_BITS))
+            pushCommands();
+
+        if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS)
+        {
+            (void)hw()->clr_stop_det;
+            pullReadBytes();
+            if (!g_aborted)
+                finish(Ok);
+            else if (g_abortSource & NACK_ABORT_SOURCES)
+                finish(Nack);
+            else
+                finish(Aborted);
+        }
+    }
+
+    // Called in interrupt context, or with interrupts disabled
+    void start()
+    {
+        const Transaction &transaction = g_queue[g_head];
+        g_active = true;
+        g_aborted = false;
+        g_abortSource = 0;
+        g_commandsSent = 0;
+        g_bytesRead = 0;
+
+        // The target address can only be changed while the controller is disabled.
+        hw()->enable = 0;
+        hw()->tar = transaction.address;
+        hw()->enable = 1;
+
+        // Drop the interrupts left by a transaction that timed out.
+        (void)hw()->clr_intr;
+        hw()->intr_mask =
+            I2C_IC_INTR_MASK_M_TX_EMPTY_BITS | I2C_IC_INTR_MASK_M_RX_FULL_BITS |
+            I2C_IC_INTR_MASK_M_TX_ABRT_BITS | I2C_IC_INTR_MASK_M_STOP_DET_BITS;
+        pushCommands();
+
+        g_timeoutTimer = TimerWheel::addInMs(TIMEOUT_MS, onTimeout, nullptr);
+    }
+}
+
+void I2cBus::init(unsigned int baudrate)
+{
+    g_baudrate = baudrate;
+    i2c_init(I2C_PORT, baudrate);
+    gpio_set_function(SDA, GPIO_FUNC_I2C);
+    gpio_set_function(SCL, GPIO_FUNC_I2C);
+
+    gpio_pull_up(SDA);
+    gpio_pull_up(SCL);
+    configure();
+
+    unsigned int irq = I2C0_IRQ + i2c_hw_index(I2C_PORT);
+    irq_set_exclusive_handler(irq, onInterrupt);
+    irq_set_enabled(irq, true);
+}
+
+void I2cBus::deinit()
+{
+    irq_set_enabled(I2C0_IRQ + i2c_hw_index(I2C_PORT), false);
+    i2c_deinit(I2C_PORT);
+}
+
+bool I2cBus::transfer(
+    uint8_t address, const uint8_t *writeData, size_t writeSize, size_t readSize,
+    Callback callback, int kind)
+{
+    if (writeSize > MAX_WRITE_SIZE || readSize > MAX_READ_SIZE || writeSize + readSize == 0 ||
+        kind < 0 || kind >= MAX_KINDS)
+        return false;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (g_count == QUEUE_SIZE)
+    {
+        restore_interrupts(interrupts);
+        TRACE << "I2C queue full";
+        return false;
+    }
+
+    Transaction &transaction = g_queue[(g_head + g_count) % QUEUE_SIZE];
+    transaction.address = address;
+    memcpy(transaction.writeData, writeData, writeSize);
+    transaction.writeSize = writeSize;
+    transaction.readSize = readSize;
+    transaction.kind = kind;
+    transaction.queuedUs = Platform::timeUs();
+    transaction.callback = std::move(callback);
+    g_count++;
+
+    if (!g_active)
+        start();
+    restore_interrupts(interrupts);
+    return true;
+}
+
+bool I2cBus::transferBlocking(
+    uint8_t address, const uint8_t *writeData, size_t writeSize, uint8_t *readData,
+    size_t readSize, int kind)
+{
+    volatile bool done = false;
+    bool result = false;
+    auto onDone = [&](bool ok, const uint8_t *data, size_t size)
+    {
+        if (ok && size > 0)
+            memcpy(readData, data, size);
+        result = ok;
+        done = true;
+    };
+
+    if (!transfer(address, writeData, writeSize, readSize, onDone, kind))
+        return false;
+
+    while (!done)
+        tight_loop_contents();
+    return result;
+}
+
+I2cBus::Stats I2cBus::stats(int kind)
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    Stats stats = g_stats[kind];
+    restore_interrupts(interrupts);
+    return stats;
+}
+
+I2cBus::Health I2cBus::health()
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    Health health = g_health;
+    restore_interrupts(interrupts);
+    return health;
+}
+
+uint32_t I2cBus::latencyPercentileUs(const Stats &stats, int percent)
+{
+    // Rank of the percentile among the transactions, rounded up
+    uint32_t rank = (static_cast<uint64_t>(stats.transfers) * percent + 99) / 100;
+    uint32_t counted = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        counted += stats.latencyHistogram[bucket];
+        if (counted >= rank && counted > 0)
+        {
+            // The last bucket is open ended.
+            if (bucket == LATENCY_BUCKETS - 1)
+                return stats.maxLatencyUs;
+            return FIRST_LATENCY_BUCKET_US << bucket;
+        }
+    }
+    return 0;
+}
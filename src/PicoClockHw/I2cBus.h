@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Non-blocking I2C controller for the bus of the DS3231. Transactions are queued and executed one
+// after the other, driven by the I2C interrupt, so that callers never wait for the bus and never
+// interleave their transfers. A transaction writes bytes, then reads bytes after a repeated start,
+// either part being optional.
+//
+// Failures and latencies are counted per kind of transaction. After a timeout, a lost arbitration
+// or repeated failures, the bus is recovered by clocking SCL until the device releases SDA, and
+// the controller is initialized again.
+class I2cBus
+{
+public:
+    static const size_t MAX_WRITE_SIZE = 8;
+    static const size_t MAX_READ_SIZE = 19; // All the registers of the DS3231
+    static const int MAX_KINDS = 8;
+    static const int LATENCY_BUCKETS = 16;
+
+    // Called from interrupt context when the transaction is finished. On success, data points to
+    // the bytes read, which are only valid during the call.
+    using Callback = std::function<void(bool ok, const uint8_t *data, size_t size)>;
+
+    // Since the start of the program, for one kind of transaction
+    struct Stats
+    {
+        uint32_t transfers;
+        uint32_t nacks; // The device did not acknowledge its address or a byte
+        uint32_t timeouts;
+        uint32_t aborts; // Other failures, e.g. arbitration lost
+        uint32_t maxLatencyUs;
+
+        // From the call to transfer() to the end of the transaction, including the wait in the
+        // queue. Bucket i counts the latencies below 64 << i us.
+        uint32_t latencyHistogram[LATENCY_BUCKETS];
+    };
+
+    struct Health
+    {
+        uint32_t recoveries;
+        uint32_t stuckSda; // Recoveries that found SDA held low by the device
+        uint32_t consecutiveFailures;
+    };
+
+    static void init(unsigned int baudrate);
+    static void deinit();
+
+    // Queue a transaction. Return false if the queue is full or the sizes are too large, the
+    // callback is not called then. Can be called from interrupt context, including callbacks.
+    // kind is below MAX_KINDS and chosen by the caller to group the statistics.
+    static bool transfer(
+        uint8_t address, const uint8_t *writeData, size_t writeSize, size_t readSize,
+        Callback callback, int kind = 0);
+
+    // Queue a transaction and wait for its end. Must not be called from interrupt context, as the
+    // transaction progresses in interrupts. Return true on success.
+    static bool transferBlocking(
+        uint8_t address, const uint8_t *writeData, size_t writeSize, uint8_t *readData,
+        size_t readSize, int kind = 0);
+
+    static Stats stats(int kind);
+    static Health health();
+
+    // Upper bound of the histogram bucket reaching the given percentile, 0 without transaction.
+    static uint32_t latencyPercentileUs(const Stats &stats, int percent);
+};
@@ -1,4 +1,5 @@
 #include "Ntp.h"
+#include "EventJournal.h"
 #include "Utils/Trampoline.h"
 #include "Utils/Trace.h"
 
@@ -46,7 +47,7 @@ void Ntp::startRequest()
 {
     // Set alarm in case udp requests are lost
     MAKE_TRAMPOLINE(Ntp, onNtpFailed, userPtrAtEnd);
-    m_timeoutAlarm = add_alarm_in_ms(NTP_TIMEOUT_MS, onNtpFailed, this, true);
+    m_timeoutAlarm = TimerWheel::addInMs(NTP_TIMEOUT_MS, onNtpFailed, this);
 
     // Get server address from DNS
     // Note: cyw43_arch_lwip_begin/end should be used around calls into lwIP to ensure correct locking.
@@ -66,6 +67,7 @@ void Ntp::startRequest()
         default:
             TRACE <<"dns request failed";
             m_state = DnsFailed;
+            EventJournal::log(EventJournal::NtpFailed, m_state);
 
             if (m_failCallback)
                 m_failCallback(DnsFailed);
@@ -84,6 +86,7 @@ void Ntp::onNtpDnsFound(const char *hostname, const ip_addr_t *ipaddr)
     {
         TRACE <<"ntp dns request failed";
         m_state = DnsFailed;
+        EventJournal::log(EventJournal::NtpFailed, m_state);
         if (m_failCallback)
             m_failCallback(DnsFailed);
     }
@@ -124,6 +127,7 @@ void Ntp::onMsgReceived(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *ad
         time_t secondsSince1970 = secondsSince1900 - 2208988800;
         
         m_state = Done;
+        m_serverStratum = stratum;
 
         if (m_timeCallback)
             m_timeCallback(secondsSince1970, ms);
@@ -132,6 +136,7 @@ void Ntp::onMsgReceived(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *ad
     {
         TRACE <<"invalid ntp response";
         m_state = InvalidResponse;
+        EventJournal::log(EventJournal::NtpFailed, m_state);
     
         if (m_failCallback)
             m_failCallback(InvalidResponse);
@@ -140,17 +145,18 @@ void Ntp::onMsgReceived(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *ad
 
     if (m_timeoutAlarm != -1) 
     {
-        cancel_alarm(m_timeoutAlarm);
+        TimerWheel::cancel(m_timeoutAlarm);
         m_timeoutAlarm = -1;
     }
 }
 
-// Callback for add_alarm_in_ms
-int64_t Ntp::onNtpFailed(alarm_id_t id)
+// Callback for TimerWheel::addInMs
+int64_t Ntp::onNtpFailed(TimerWheel::TimerId id)
 {
     m_timeoutAlarm = -1;
     TRACE <<"ntp request failed";
     m_state = Timeout;
+    EventJournal::log(EventJournal::NtpFailed, m_state);
     
     if (m_failCallback)
         m_failCallback(Timeout);
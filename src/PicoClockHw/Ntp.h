@@ -4,6 +4,8 @@
 #include <lwip/dns.h>
 #endif
 
+#include "TimerWheel.h"
+
 #include <pico/stdlib.h>
 #include <functional>
 #include <time.h>
@@ -44,21 +46,28 @@ public:
         return m_state;
     }
 
+    // Stratum of the server from its last response, 0 if unknown
+    uint8_t serverStratum() const
+    {
+        return m_serverStratum;
+    }
+
 private:
 #ifdef PICO_CYW43_SUPPORTED
-    int64_t onNtpFailed(alarm_id_t id);
+    int64_t onNtpFailed(TimerWheel::TimerId id);
     void onNtpDnsFound(const char *hostname, const ip_addr_t *ipaddr);
     void sendNtpRequest();
     void onMsgReceived(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
 
     ip_addr_t m_serverAddress;
     udp_pcb *m_pcb = nullptr; // protocol control block
-    alarm_id_t m_timeoutAlarm = -1;
+    TimerWheel::TimerId m_timeoutAlarm = -1;
     std::function<void(time_t utcTime, uint32_t ms)> m_timeCallback;
     std::function<void(State reason)> m_failCallback;
 #endif
 
     State m_state = Idle;
+    uint8_t m_serverStratum = 0;
 };
 
 #ifndef PICO_CYW43_SUPPORTED
@@ -1,18 +1,25 @@
 #include "Platform.h"
-#include "Rtc.h"
 #include <pico/stdlib.h>
+#include <hardware/watchdog.h>
+#include <hardware/structs/xip_ctrl.h>
+
+namespace
+{
+    // Latency of the console commands
+    const uint32_t MAIN_LOOP_PERIOD_MS = 10;
+}
 
 void Platform::initStdIo()
 {
     stdio_init_all();
 }
 
-void Platform::runMainLoop()
+void Platform::runMainLoop(std::function<void()> loopFunction)
 {
     while (1)
     {
-        sleep_ms(1000);
-        Rtc::onSecond();
+        loopFunction();
+        sleep_ms(MAIN_LOOP_PERIOD_MS);
     }
 }
 
@@ -21,7 +28,26 @@ int Platform::getCharNonBlocking()
     return getchar_timeout_us(0);
 }
 
-uint64_t Platform::timeUs()
+uint64_t RAM_FUNC(Platform::timeUs)()
 {
     return time_us_64();
-}
\ No newline at end of file
+}
+
+void Platform::reboot()
+{
+    watchdog_reboot(0, 0, 0);
+    while (1)
+        tight_loop_contents();
+}
+
+Platform::XipCacheStats Platform::xipCacheStats()
+{
+    return {xip_ctrl_hw->ctr_hit, xip_ctrl_hw->ctr_acc};
+}
+
+void Platform::resetXipCacheStats()
+{
+    // Writing any value clears the counters.
+    xip_ctrl_hw->ctr_hit = 0;
+    xip_ctrl_hw->ctr_acc = 0;
+}
@@ -1,12 +1,38 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <pico/platform.h>
+
+// Places a function in SRAM instead of executing it from flash through the XIP cache. Used for
+// the code running on every frame and in the interrupt handlers, so that it neither evicts nor
+// waits for the cache. It does not run during a flash erase or program: these keep the interrupts
+// disabled, see Flash. The function goes to the SDK's .time_critical section, which the default
+// linker script copies to RAM. Code of the libraries that it calls still runs from flash.
+#define RAM_FUNC(name) __not_in_flash_func(name)
 
 class Platform
 {
 public:
     static void initStdIo();
-    static void runMainLoop();
+
+    // Call the function periodically from thread context, for the work that is too slow for the
+    // interrupts, e.g. the console. Never returns.
+    static void runMainLoop(std::function<void()> loopFunction);
+
+    // Return -1 if no character was received.
     static int getCharNonBlocking();
     static uint64_t timeUs();
+
+    // Software reset. The time is kept by WarmRestart.
+    static void reboot();
+
+    // Counters of the XIP cache since the last reset. Accesses from RAM are not counted.
+    struct XipCacheStats
+    {
+        uint32_t hits;
+        uint32_t accesses;
+    };
+    static XipCacheStats xipCacheStats();
+    static void resetXipCacheStats();
 };
\ No newline at end of file
@@ -1,10 +1,15 @@
 #include "Rtc.h"
 
+#include "BootProfiler.h"
+#include "EventJournal.h"
 #include "gpio.h"
+#include "I2cBus.h"
+#include "Platform.h"
 #include "Utils/Trace.h"
+#include "Utils/Trampoline.h"
 
 #include <hardware/gpio.h>
-#include <hardware/i2c.h>
+#include <hardware/irq.h>
 #include <hardware/sync.h>
 #include <iostream>
 #include <iomanip>
@@ -12,9 +17,41 @@
 
 namespace
 {
-    const auto I2C_PORT = i2c1;
     const uint8_t DEVICE_ADDRESS = 0x68;
-    const uint TIMEOUT_US = 100000; // 100 ms
+    const unsigned int BAUDRATE = 100000;
+
+    // Registers of the DS3231
+    // See https://www.analog.com/media/en/technical-documentation/data-sheets/DS3231.pdf for details
+    const uint8_t TIME_REGISTER = 0x00;
+    const uint8_t TIME_SIZE = 7;
+    const uint8_t CONTROL_REGISTER = 0x0E;
+    const uint8_t STATUS_REGISTER = 0x0F;
+    const uint8_t AGING_REGISTER = 0x10;
+    const uint8_t TEMPERATURE_REGISTER = 0x11;
+    const uint8_t REGISTER_COUNT = 0x13;
+    static_assert(REGISTER_COUNT <= I2cBus::MAX_READ_SIZE, "A snapshot is read in one transaction");
+    static_assert(Rtc::TransactionCount <= I2cBus::MAX_KINDS, "Transactions are counted by kind");
+
+    const uint8_t STATUS_OSF = 0x80; // Oscillator stopped
+    const uint8_t STATUS_BSY = 0x04; // Temperature conversion in progress
+    const uint8_t STATUS_A2F = 0x02;
+    const uint8_t STATUS_A1F = 0x01;
+
+    // With the filter over 32 samples, the displayed temperature follows changes within about a
+    // minute.
+    const uint32_t DEFAULT_TEMPERATURE_PERIOD_MS = 2000;
+
+    // A conversion takes 125 ms typically and 200 ms at most. The registers from control to
+    // temperature are read at each poll.
+    const uint32_t CONVERSION_TIME_MS = 125;
+    const uint32_t CONVERSION_POLL_MS = 25;
+    const int MAX_CONVERSION_POLLS = 20;
+    const uint8_t CONVERSION_REGISTER_COUNT = REGISTER_COUNT - CONTROL_REGISTER;
+
+    // Oscillator enabled, square wave output instead of alarm interrupts (INTCN = 0), at 1 Hz
+    // (RS2 = RS1 = 0), alarms disabled
+    const uint8_t CONTROL_SQUARE_WAVE_1HZ = 0x00;
+    const uint8_t CONTROL_CONV = 0x20; // Start a temperature conversion
 
     uint8_t fromBcd(uint8_t value, int min, int max)
     {
@@ -30,76 +67,133 @@ namespace
     {
         return ((value / 10) << 4) + (value % 10);
     }
+
+    void decodeTime(const uint8_t *buffer, tm &dateTime)
+    {
+        dateTime.tm_sec = fromBcd(buffer[0], 0, 59);
+        dateTime.tm_min = fromBcd(buffer[1], 0, 59);
+        dateTime.tm_hour = fromBcd(buffer[2], 0, 23);
+        dateTime.tm_wday = fromBcd(buffer[3], 1, 7) - 1; // Unlike in the DS3231, tm::tm_wday is 0-based
+        dateTime.tm_mday = fromBcd(buffer[4], 1, 31);
+        dateTime.tm_mon = fromBcd(buffer[5] & 0x1F, 1, 12) - 1; // Unlike in the DS3231, tm::tm_mon is 0-based.
+        dateTime.tm_year = fromBcd(buffer[6], 0, 99) + 100;    // tm::tm_year is "years since 1900"
+
+        if (buffer[5] & 0x80)
+            dateTime.tm_year += 100; // Century flag set
+    }
+
+    // 10-bit two's complement value, in 0.25°C
+    int16_t decodeQuarterDegrees(const uint8_t *buffer)
+    {
+        return static_cast<int16_t>((buffer[0] << 8) | buffer[1]) >> 6;
+    }
+
+    float decodeTemperature(const uint8_t *buffer)
+    {
+        return decodeQuarterDegrees(buffer) * 0.25f;
+    }
 }
 
 Rtc *Rtc::m_instance = nullptr;
 
-Rtc::Rtc()
+const char *Rtc::transactionName(Transaction transaction)
 {
-    i2c_init(I2C_PORT, 100000);
-    gpio_set_function(SDA, GPIO_FUNC_I2C);
-    gpio_set_function(SCL, GPIO_FUNC_I2C);
-
-    gpio_pull_up(SDA);
-    gpio_pull_up(SCL);
-
-    TRACE << "Initialize the temperature filter";
-    m_tempFilter = std::make_unique<MovingAverage<32>>(rawTemperature());
+    static const char *names[TransactionCount] = 
+    {
+        "setup", "snapshot read", "time write", "aging write", "conversion start", 
+        "conversion poll"
+    };
+    return names[transaction];
+}
 
+Rtc::Rtc() : m_temperaturePeriodMs(DEFAULT_TEMPERATURE_PERIOD_MS)
+{
+    I2cBus::init(BAUDRATE);
     m_instance = this;
+
+    // The INT/SQW pin is open drain and stays high without DS3231, so the interrupt is harmless
+    // until the probe tells.
+    m_lastSecondEdgeUs = Platform::timeUs();
+    gpio_init(SQW);
+    gpio_set_dir(SQW, GPIO_IN);
+    gpio_pull_up(SQW);
+
+    // As raw handler, so that the GPIO callback used by the buttons is not replaced.
+    gpio_add_raw_irq_handler(SQW, onSquareWaveInterrupt);
+    gpio_set_irq_enabled(SQW, GPIO_IRQ_EDGE_FALL, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
 }
 
 Rtc::~Rtc()
 {
+    uint32_t interrupts = save_and_disable_interrupts();
+    TimerWheel::cancel(m_temperatureTimer);
+    m_temperatureTimer = -1;
+    restore_interrupts(interrupts);
+
+    gpio_set_irq_enabled(SQW, GPIO_IRQ_EDGE_FALL, false);
     m_instance = nullptr;
-    i2c_deinit(I2C_PORT);
+    I2cBus::deinit();
 }
 
-bool Rtc::read(tm &dateTime) const
+bool Rtc::probeAsync(ProbeCallback callback)
 {
-    // Fail if another method is currently communicating with the DS3231
-    if (m_communicating)
-        return false;
-
-    // Read registers from the DS3231
-    // See https://www.analog.com/media/en/technical-documentation/data-sheets/DS3231.pdf for details
-    uint8_t registerNumber = 0x00;
-    if (i2c_write_timeout_us(
-        I2C_PORT, DEVICE_ADDRESS, &registerNumber, 1, true, TIMEOUT_US) != 1)
+    // Output the 1 Hz square wave on the INT/SQW pin. A missing DS3231 does not acknowledge its
+    // address, which fails within a byte time instead of waiting for a timeout.
+    uint8_t control[] = {CONTROL_REGISTER, CONTROL_SQUARE_WAVE_1HZ};
+    auto onProbed = [this, callback](bool ok, const uint8_t *data, size_t size)
     {
-        TRACE << "i2c_write_timeout_us failed";
-        return false;
-    }
-    unsigned char buffer[7];
-    if (i2c_read_timeout_us(
-        I2C_PORT, DEVICE_ADDRESS, buffer, sizeof(buffer), false, TIMEOUT_US) != sizeof(buffer))
+        TRACE << "RTC" << (ok ? "present" : "not present");
+        if (ok)
+        {
+            // The first conversion seeds the temperature filter.
+            m_lastSecondEdgeUs = Platform::timeUs();
+            scheduleTemperatureStep(0);
+        }
+        if (callback)
+            callback(ok);
+    };
+    return I2cBus::transfer(
+        DEVICE_ADDRESS, control, sizeof(control), 0, onProbed, SetupTransaction);
+}
+
+bool Rtc::readSnapshotAsync(SnapshotCallback callback)
+{
+    Snapshot snapshot;
+    if (lastSnapshot(snapshot) && isCurrent(snapshot))
     {
-        TRACE << "i2c_read_timeout_us failed";
-        return false;
+        if (callback)
+            callback(true, snapshot);
+        return true;
     }
 
-    dateTime.tm_sec = fromBcd(buffer[0], 0, 59);
-    dateTime.tm_min = fromBcd(buffer[1], 0, 59);
-    dateTime.tm_hour = fromBcd(buffer[2], 0, 23);
-    dateTime.tm_wday = fromBcd(buffer[3], 1, 7) - 1; // Unlike in the DS3231, tm::tm_wday is 0-based
-    dateTime.tm_mday = fromBcd(buffer[4], 1, 31);
-    dateTime.tm_mon = fromBcd(buffer[5] & 0x1F, 1, 12) - 1; // Unlike in the DS3231, tm::tm_mon is 0-based.
-    dateTime.tm_year = fromBcd(buffer[6], 0, 99) + 100;    // tm::tm_year is "years since 1900"
-
-    if (buffer[5] & 0x80)
-        dateTime.tm_year += 100; // Century flag set
-
-    return true;
+    // The registers are read after the request, so a snapshot is known to be from the current
+    // second if the request was after the last edge.
+    uint64_t requestUs = Platform::timeUs();
+    auto onRead = [this, requestUs, callback](bool ok, const uint8_t *data, size_t size)
+    {
+        Snapshot snapshot = {};
+        if (ok)
+            snapshot = updateSnapshot(data, requestUs);
+        else
+            EventJournal::log(EventJournal::RtcError, EventJournal::RtcRead);
+        if (callback)
+            callback(ok, snapshot);
+    };
+    return I2cBus::transfer(
+        DEVICE_ADDRESS, &TIME_REGISTER, 1, REGISTER_COUNT, onRead, SnapshotRead);
 }
 
-bool Rtc::write(const tm &dateTime)
+bool Rtc::readAsync(ReadCallback callback)
 {
-    // Fail if another method is currently communicating with the DS3231
-    if (m_communicating)
-        return false;
+    return readSnapshotAsync(
+        [callback](bool ok, const Snapshot &snapshot) { callback(ok, snapshot.dateTime); });
+}
 
-    unsigned char buffer[8];
-    buffer[0] = 0;  // Start writing at register 0
+bool Rtc::writeAsync(const tm &dateTime, WriteCallback callback)
+{
+    uint8_t buffer[1 + TIME_SIZE];
+    buffer[0] = TIME_REGISTER;  // Start writing at register 0
     buffer[1] = toBcd(dateTime.tm_sec);
     buffer[2] = toBcd(dateTime.tm_min);
     buffer[3] = toBcd(dateTime.tm_hour);
@@ -113,84 +207,189 @@ bool Rtc::write(const tm &dateTime)
     if (dateTime.tm_year >= 200)
         buffer[6] |= 0x80;
 
-    int written = i2c_write_timeout_us(I2C_PORT, DEVICE_ADDRESS, buffer, sizeof(buffer), false, TIMEOUT_US);
-    if (written == sizeof(buffer))
+    // The cached time becomes wrong.
+    uint32_t interrupts = save_and_disable_interrupts();
+    m_hasSnapshot = false;
+    restore_interrupts(interrupts);
+
+    auto onWritten = [callback](bool ok, const uint8_t *data, size_t size)
     {
-        TRACE << "i2c_write_timeout_us successful";
-        return true;
-    } else 
+        TRACE << "RTC write" << (ok ? "successful" : "failed");
+        if (!ok)
+            EventJournal::log(EventJournal::RtcError, EventJournal::RtcWrite);
+        callback(ok);
+    };
+    return I2cBus::transfer(DEVICE_ADDRESS, buffer, sizeof(buffer), 0, onWritten, TimeWrite);
+}
+
+bool Rtc::writeAgingOffsetAsync(int8_t agingOffset, WriteCallback callback)
+{
+    uint8_t aging[] = {AGING_REGISTER, static_cast<uint8_t>(agingOffset)};
+    uint8_t control[] = {CONTROL_REGISTER, CONTROL_SQUARE_WAVE_1HZ | CONTROL_CONV};
+
+    // Queued together, so that the conversion follows the write.
+    uint32_t interrupts = save_and_disable_interrupts();
+    bool queued = I2cBus::transfer(DEVICE_ADDRESS, aging, sizeof(aging), 0, nullptr, AgingWrite);
+    if (queued)
     {
-        TRACE << "i2c_write_timeout_us failed";
-        return false;
+        auto onWritten = [callback](bool ok, const uint8_t *data, size_t size)
+        {
+            if (!ok)
+                EventJournal::log(EventJournal::RtcError, EventJournal::RtcWrite);
+            callback(ok);
+        };
+        queued = I2cBus::transfer(
+            DEVICE_ADDRESS, control, sizeof(control), 0, onWritten, ConversionStart);
     }
+    restore_interrupts(interrupts);
+    return queued;
 }
 
-float Rtc::temperature()
+bool Rtc::lastSnapshot(Snapshot &snapshot) const
 {
-    // Defer temperature measurement to the main loop, as it takes too long for interrupts.
-    m_requestTemp = true;
+    uint32_t interrupts = save_and_disable_interrupts();
+    bool hasSnapshot = m_hasSnapshot;
+    if (hasSnapshot)
+        snapshot = m_snapshot;
+    restore_interrupts(interrupts);
+    return hasSnapshot;
+}
+
+float Rtc::temperature() const
+{
+    if (!m_tempFilter.hasValue())
+        return NAN;
 
     // As the measured temperature is often hesitating between two values separated by 0.25°, filter
     // using a moving average. This also provides a higher resulting precision.
-    float temp = m_tempFilter->get();
+    float temp = m_tempFilter.sum() * 0.25f / 32;
 
     TRACE << "Temperature: " << temp;
     return temp;
 }
 
-void Rtc::onSecond()
+void Rtc::setTemperaturePeriod(uint32_t periodMs)
+{
+    m_temperaturePeriodMs = periodMs;
+}
+
+void Rtc::scheduleTemperatureStep(uint32_t delayMs)
+{
+    MAKE_TRAMPOLINE(Rtc, sampleTemperature, userPtrAtEnd);
+    m_temperatureTimer = TimerWheel::addInMs(delayMs, sampleTemperature, this);
+}
+
+int64_t Rtc::sampleTemperature(TimerWheel::TimerId id)
 {
-    // Do nothing if the instance does not exist yet or no temperature measurement is requested
-    if (m_instance == nullptr || !m_instance->m_requestTemp)
+    using namespace std::placeholders;
+    if (!I2cBus::transfer(
+            DEVICE_ADDRESS, &CONTROL_REGISTER, 1, CONVERSION_REGISTER_COUNT,
+            std::bind(&Rtc::onTemperatureRegisters, this, _1, _2), ConversionPoll))
+        return static_cast<int64_t>(m_temperaturePeriodMs) * 1000; // Queue full, try again later
+
+    // The next step is scheduled when the registers are read.
+    m_temperatureTimer = -1;
+    return 0;
+}
+
+void Rtc::onTemperatureRegisters(bool ok, const uint8_t *data)
+{
+    if (!ok)
+    {
+        EventJournal::log(EventJournal::RtcError, EventJournal::RtcTemperature);
+        m_converting = false;
+        scheduleTemperatureStep(m_temperaturePeriodMs);
         return;
+    }
 
-    // Acknowledge the request
-    m_instance->m_requestTemp = false;
+    uint8_t control = data[0];
+    uint8_t status = data[STATUS_REGISTER - CONTROL_REGISTER];
+    bool busy = (control & CONTROL_CONV) || (status & STATUS_BSY);
 
-    TRACE << "Measure";
-    float currentTemp = m_instance->rawTemperature();
+    if (busy)
+    {
+        // Either the forced conversion or an automatic one, which must end before forcing one.
+        if (++m_conversionPolls < MAX_CONVERSION_POLLS)
+        {
+            scheduleTemperatureStep(CONVERSION_POLL_MS);
+            return;
+        }
+        TRACE << "Temperature conversion timeout";
+        EventJournal::log(EventJournal::RtcError, EventJournal::RtcTemperature);
+    } else if (m_converting)
+    {
+        int16_t temp = decodeQuarterDegrees(data + TEMPERATURE_REGISTER - CONTROL_REGISTER);
+        m_tempFilter.put(temp);
+        BootProfiler::mark(BootProfiler::FirstTemperature);
+        TRACE << "Measured temperature:" << std::fixed << std::setprecision(2) << temp * 0.25f;
+    } else
+    {
+        uint8_t convert[] = {CONTROL_REGISTER, CONTROL_SQUARE_WAVE_1HZ | CONTROL_CONV};
+        auto onStarted = [this](bool ok, const uint8_t *data, size_t size)
+        {
+            m_converting = ok;
+            m_conversionPolls = 0;
+            if (!ok)
+                EventJournal::log(EventJournal::RtcError, EventJournal::RtcTemperature);
+            scheduleTemperatureStep(ok ? CONVERSION_TIME_MS : m_temperaturePeriodMs);
+        };
+        if (I2cBus::transfer(
+                DEVICE_ADDRESS, convert, sizeof(convert), 0, onStarted, ConversionStart))
+            return;
+    }
 
-    // Prevent access to member variables from interruptions
-    uint32_t interrupts = save_and_disable_interrupts();
+    m_converting = false;
+    m_conversionPolls = 0;
+    scheduleTemperatureStep(m_temperaturePeriodMs);
+}
 
-    // Update the moving average with this measurement
-    m_instance->m_tempFilter->put(currentTemp);
+Rtc::Snapshot Rtc::updateSnapshot(const uint8_t *registers, uint64_t timeUs)
+{
+    Snapshot snapshot;
+    decodeTime(registers + TIME_REGISTER, snapshot.dateTime);
+    snapshot.temperature = decodeTemperature(registers + TEMPERATURE_REGISTER);
+    snapshot.agingOffset = static_cast<int8_t>(registers[AGING_REGISTER]);
+    snapshot.control = registers[CONTROL_REGISTER];
+    snapshot.status = registers[STATUS_REGISTER];
+    snapshot.oscillatorStopped = snapshot.status & STATUS_OSF;
+    snapshot.alarm1Fired = snapshot.status & STATUS_A1F;
+    snapshot.alarm2Fired = snapshot.status & STATUS_A2F;
+    snapshot.timeUs = timeUs;
 
-    // Interrupts may access member variables again
+    uint32_t interrupts = save_and_disable_interrupts();
+    m_snapshot = snapshot;
+    m_hasSnapshot = true;
     restore_interrupts(interrupts);
+
+    return snapshot;
 }
 
-float Rtc::rawTemperature()
+bool Rtc::isCurrent(const Snapshot &snapshot) const
 {
-    // Get temperature from RTC
-    m_communicating = true;
-    uint8_t registerNumber = 0x11;
-    int result = i2c_write_timeout_us(
-        I2C_PORT, DEVICE_ADDRESS, &registerNumber, 1, true, TIMEOUT_US);
-    if (result != 1)
-    {
-        m_communicating = false;
-        TRACE << "i2c_write_timeout_us returned" << result;
-        return NAN;
-    }
-    unsigned char buffer[2];
-    if (i2c_read_timeout_us(I2C_PORT, DEVICE_ADDRESS, buffer, sizeof(buffer), false, TIMEOUT_US) != 
-        sizeof(buffer))
-    {
-        m_communicating = false;
-        TRACE << "i2c_read_timeout_us failed";
-        return NAN;
-    }
-    m_communicating = false;
-
-    // Calculate temperature as floating point number
-    float currentTemp = buffer[0];
-    float fractional = (buffer[1] >> 6) * 0.25;
-    if (currentTemp >= 0)
-        currentTemp += fractional;
-    else
-        currentTemp -= fractional;
-    TRACE << "Measured temperature:" <<std::fixed << std::setprecision(2) << currentTemp;
-
-    return currentTemp;
-}
\ No newline at end of file
+    // Only known from the 1 Hz output, which must have been seen for the current second.
+    return 
+        m_secondEdges > 0 && snapshot.timeUs > m_lastSecondEdgeUs &&
+        Platform::timeUs() - m_lastSecondEdgeUs < 1000000;
+}
+
+void Rtc::setSecondCallback(SecondCallback callback)
+{
+    m_secondCallback = callback;
+}
+
+void RAM_FUNC(Rtc::onSquareWaveInterrupt)()
+{
+    if (!(gpio_get_irq_event_mask(SQW) & GPIO_IRQ_EDGE_FALL))
+        return;
+    gpio_acknowledge_irq(SQW, GPIO_IRQ_EDGE_FALL);
+
+    // Timestamp first, so that the latency of the rest does not matter.
+    uint64_t edgeUs = Platform::timeUs();
+    if (m_instance == nullptr)
+        return;
+
+    m_instance->m_lastSecondEdgeUs = edgeUs;
+    m_instance->m_secondEdges++;
+    if (m_instance->m_secondCallback)
+        m_instance->m_secondCallback(edgeUs);
+}
@@ -1,29 +1,113 @@
 #pragma once
 
-#include "Utils/MovingAverage.h"
+#include "TimerWheel.h"
+#include "Utils/IntegerMovingAverage.h"
 
-#include <memory>
+#include <cstdint>
+#include <ctime>
+#include <functional>
 
+// DS3231 real-time clock. The transfers go through the I2C queue, so the asynchronous methods
+// return immediately and can be called from interrupt context. Their callbacks are called from
+// interrupt context.
 class Rtc
 {
 public:
+    // Content of the registers, all read in one transaction
+    struct Snapshot
+    {
+        tm dateTime;
+        float temperature; // Updated by the DS3231 every 64 s
+        int8_t agingOffset;
+        uint8_t control;
+        uint8_t status;
+        bool oscillatorStopped; // The time may be wrong, e.g. the battery was empty
+        bool alarm1Fired;
+        bool alarm2Fired;
+        uint64_t timeUs; // When it was requested, as returned by Platform::timeUs()
+    };
+
+    // Kinds of the I2C transactions, for I2cBus::stats()
+    enum Transaction
+    {
+        SetupTransaction,
+        SnapshotRead,
+        TimeWrite,
+        AgingWrite,
+        ConversionStart,
+        ConversionPoll,
+        TransactionCount
+    };
+    static const char *transactionName(Transaction transaction);
+
+    using SnapshotCallback = std::function<void(bool ok, const Snapshot &snapshot)>;
+    using ReadCallback = std::function<void(bool ok, const tm &dateTime)>;
+    using WriteCallback = std::function<void(bool ok)>;
+    using SecondCallback = std::function<void(uint64_t edgeUs)>;
+    using ProbeCallback = std::function<void(bool present)>;
+
+    // Nothing is sent to the DS3231 until it is probed.
     Rtc();
     ~Rtc();
 
-    static void onSecond();
+    // Enable the 1 Hz output in one transaction, which also tells if the DS3231 is connected,
+    // then start the temperature conversions. Return false if the request could not be queued.
+    bool probeAsync(ProbeCallback callback);
+
+    // Return false if the request could not be queued, the callback is not called then. If the
+    // last snapshot was taken during the current second of the RTC, as known from the 1 Hz
+    // output, it is used without bus traffic and the callback is called before returning.
+    bool readSnapshotAsync(SnapshotCallback callback);
+    bool readAsync(ReadCallback callback);
+    bool writeAsync(const tm &dateTime, WriteCallback callback);
+
+    // Trim the frequency of the crystal, by about 0.1 ppm per step, positive values slowing it
+    // down. A temperature conversion is started so that it applies immediately.
+    bool writeAgingOffsetAsync(int8_t agingOffset, WriteCallback callback);
 
-    bool read(tm &dateTime) const;
-    bool write(const tm &dateTime);
+    // Return false if no snapshot was read yet.
+    bool lastSnapshot(Snapshot &snapshot) const;
 
-    float temperature();
+    // Return the filtered temperature, or NAN if none was measured yet. Never blocks, the
+    // filter being fed by conversions started in the background once probed. The first one
+    // completes about 150 ms after the probe.
+    float temperature() const;
+
+    // Period of the temperature conversions. Each one is forced through the CONV bit instead of
+    // waiting for the automatic conversion every 64 s, so that the filter gets fresh samples.
+    void setTemperaturePeriod(uint32_t periodMs);
+
+    // Called on each falling edge of the 1 Hz output, which is when the seconds of the DS3231
+    // change, with the time of the edge as returned by Platform::timeUs().
+    void setSecondCallback(SecondCallback callback);
+
+    // Time of the last edge of the 1 Hz output, or of its activation if no edge was seen yet.
+    uint64_t lastSecondEdgeUs() const
+    {
+        return m_lastSecondEdgeUs;
+    }
 
 private:
-    float rawTemperature();
+    static void onSquareWaveInterrupt();
+    Snapshot updateSnapshot(const uint8_t *registers, uint64_t timeUs);
+    bool isCurrent(const Snapshot &snapshot) const;
+    int64_t sampleTemperature(TimerWheel::TimerId id);
+    void onTemperatureRegisters(bool ok, const uint8_t *data);
+    void scheduleTemperatureStep(uint32_t delayMs);
 
     static Rtc *m_instance;
-    bool m_communicating = false;
-    bool m_requestTemp = true; // Request one temperature measurement at the beginning
+    volatile uint64_t m_lastSecondEdgeUs = 0;
+    uint32_t m_secondEdges = 0;
+    SecondCallback m_secondCallback;
 
-    std::unique_ptr<MovingAverage<32>> m_tempFilter;
-};
+    Snapshot m_snapshot = {};
+    bool m_hasSnapshot = false;
 
+    // Temperature sampling, one step at a time: wait for the end of an automatic conversion if
+    // any, start a conversion, then poll until it is done.
+    uint32_t m_temperaturePeriodMs;
+    TimerWheel::TimerId m_temperatureTimer = -1;
+    bool m_converting = false;
+    int m_conversionPolls = 0;
+    IntegerMovingAverage<32> m_tempFilter; // In 0.25°C
+};
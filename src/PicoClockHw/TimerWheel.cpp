@@ -0,0 +1,327 @@
+#include "TimerWheel.h"
+#include "HardwareAlarm.h"
+#include "Platform.h"
+#include "Utils/Trace.h"
+
+#include <hardware/sync.h>
+
+namespace
+{
+    const int SLOT_BITS = 6;
+    const int SLOT_COUNT = 1 << SLOT_BITS;
+    const int LEVEL_COUNT = 4; // With 1 ms ticks, the wheel covers about 4.6 hours
+    const uint64_t MAX_DELAY_TICKS = (1ull << (SLOT_BITS * LEVEL_COUNT)) - 1;
+    const int MAX_TIMERS = 16;
+    const int TICK_US = 1000;
+
+    const int16_t NO_TIMER = -1;
+
+    // Lists are the slots of all levels, plus the list of expired timers waiting for their 
+    // callback to be called and the list of free timers.
+    const int16_t EXPIRED_LIST = LEVEL_COUNT * SLOT_COUNT;
+    const int16_t FREE_LIST = EXPIRED_LIST + 1;
+    const int LIST_COUNT = FREE_LIST + 1;
+
+    struct Timer
+    {
+        uint64_t expires; // Tick at which the callback must be called
+        TimerWheel::Callback callback;
+        void *userData;
+        int16_t list = FREE_LIST;
+        int16_t prev = NO_TIMER;
+        int16_t next = NO_TIMER;
+        uint16_t generation = 0; // Incremented on each allocation, so that stale ids are detected
+    };
+
+    Timer g_timers[MAX_TIMERS];
+    int16_t g_listHeads[LIST_COUNT];
+    uint64_t g_occupiedSlots[LEVEL_COUNT] = {}; // One bit per non-empty slot
+    uint64_t g_currentTick = 0; // Last processed tick
+    bool g_initialized = false;
+    HardwareAlarm *g_alarm = nullptr;
+    TimerWheel::Stats g_stats = {};
+
+    void onAlarm();
+
+    uint64_t RAM_FUNC(nowTick)()
+    {
+        return Platform::timeUs() / TICK_US;
+    }
+
+    TimerWheel::TimerId RAM_FUNC(makeId)(int16_t index)
+    {
+        return (static_cast<TimerWheel::TimerId>(g_timers[index].generation) << 8) | index;
+    }
+
+    // Return the timer index, or NO_TIMER if the id does not designate an allocated timer.
+    int16_t RAM_FUNC(indexFromId)(TimerWheel::TimerId id)
+    {
+        if (id < 0)
+            return NO_TIMER;
+
+        int16_t index = id & 0xFF;
+        if (index >= MAX_TIMERS || 
+            g_timers[index].list == FREE_LIST || 
+            makeId(index) != id)
+            return NO_TIMER;
+
+        return index;
+    }
+
+    void RAM_FUNC(link)(int16_t index, int16_t list)
+    {
+        Timer &t = g_timers[index];
+        t.list = list;
+        t.prev = NO_TIMER;
+        t.next = g_listHeads[list];
+        if (t.next != NO_TIMER)
+            g_timers[t.next].prev = index;
+        g_listHeads[list] = index;
+
+        if (list < EXPIRED_LIST)
+            g_occupiedSlots[list / SLOT_COUNT] |= 1ull << (list % SLOT_COUNT);
+    }
+
+    void RAM_FUNC(unlink)(int16_t index)
+    {
+        Timer &t = g_timers[index];
+        if (t.prev != NO_TIMER)
+            g_timers[t.prev].next = t.next;
+        else
+            g_listHeads[t.list] = t.next;
+        if (t.next != NO_TIMER)
+            g_timers[t.next].prev = t.prev;
+
+        if (t.list < EXPIRED_LIST && g_listHeads[t.list] == NO_TIMER)
+            g_occupiedSlots[t.list / SLOT_COUNT] &= ~(1ull << (t.list % SLOT_COUNT));
+    }
+
+    void initialize()
+    {
+        for (auto &head : g_listHeads)
+            head = NO_TIMER;
+        for (int16_t index = 0; index < MAX_TIMERS; index++)
+            link(index, FREE_LIST);
+
+        g_currentTick = nowTick();
+        g_alarm = new HardwareAlarm(onAlarm);
+        g_initialized = true;
+    }
+
+    // Put the timer into the slot corresponding to its expiry, in the lowest level that can hold it.
+    // When cascading, the slot of the current tick is still to be processed, otherwise it is not.
+    void RAM_FUNC(insert)(int16_t index, bool cascading = false)
+    {
+        Timer &t = g_timers[index];
+        if (t.expires < g_currentTick || (t.expires == g_currentTick && !cascading))
+            t.expires = g_currentTick + 1;
+        if (t.expires - g_currentTick > MAX_DELAY_TICKS)
+            t.expires = g_currentTick + MAX_DELAY_TICKS;
+
+        uint64_t delta = t.expires - g_currentTick;
+        int level = 0;
+        while (level < LEVEL_COUNT - 1 && delta >= 1ull << (SLOT_BITS * (level + 1)))
+            level++;
+
+        int slot = (t.expires >> (SLOT_BITS * level)) & (SLOT_COUNT - 1);
+        link(index, level * SLOT_COUNT + slot);
+    }
+
+    // Return the tick at which the given level needs processing next, or 0 if it is empty.
+    uint64_t RAM_FUNC(nextTickForLevel)(int level)
+    {
+        uint64_t occupied = g_occupiedSlots[level];
+        if (occupied == 0)
+            return 0;
+
+        // Rotate so that bit 0 is the slot following the current one. The current slot itself 
+        // comes last, as it was processed already and entries in it belong to the next round.
+        int shift = SLOT_BITS * level;
+        int nextSlot = ((g_currentTick >> shift) + 1) & (SLOT_COUNT - 1);
+        uint64_t rotated = nextSlot == 0 ? occupied : (occupied >> nextSlot) | (occupied << (SLOT_COUNT - nextSlot));
+        int slotsAhead = __builtin_ctzll(rotated) + 1;
+
+        return ((g_currentTick >> shift) + slotsAhead) << shift;
+    }
+
+    uint64_t RAM_FUNC(nextTick)()
+    {
+        uint64_t next = 0;
+        for (int level = 0; level < LEVEL_COUNT; level++)
+        {
+            uint64_t tick = nextTickForLevel(level);
+            if (tick != 0 && (next == 0 || tick < next))
+                next = tick;
+        }
+        return next;
+    }
+
+    void RAM_FUNC(arm)()
+    {
+        // Timers that expired while bringing the wheel up to date are called as soon as possible.
+        uint64_t next = g_listHeads[EXPIRED_LIST] != NO_TIMER ? g_currentTick : nextTick();
+        if (next == 0)
+            g_alarm->cancel();
+        else
+            g_alarm->setTarget(next * TICK_US);
+    }
+
+    // Process all ticks up to the given one, moving expired timers to the expired list.
+    void RAM_FUNC(advance)(uint64_t targetTick)
+    {
+        while (true)
+        {
+            uint64_t tick = nextTick();
+            if (tick == 0 || tick > targetTick)
+                break;
+            g_currentTick = tick;
+
+            // Cascade the higher levels whose slot starts now, from the top so that timers coming
+            // from a higher level are not stuck in a slot that was already cascaded.
+            for (int level = LEVEL_COUNT - 1; level >= 1; level--)
+            {
+                int shift = SLOT_BITS * level;
+                if ((tick & ((1ull << shift) - 1)) != 0)
+                    continue;
+
+                int16_t list = level * SLOT_COUNT + ((tick >> shift) & (SLOT_COUNT - 1));
+                while (g_listHeads[list] != NO_TIMER)
+                {
+                    int16_t index = g_listHeads[list];
+                    unlink(index);
+                    insert(index, true);
+                }
+            }
+
+            int16_t list = tick & (SLOT_COUNT - 1);
+            while (g_listHeads[list] != NO_TIMER)
+            {
+                int16_t index = g_listHeads[list];
+                unlink(index);
+                link(index, EXPIRED_LIST);
+            }
+        }
+
+        if (targetTick > g_currentTick)
+            g_currentTick = targetTick;
+    }
+
+    void RAM_FUNC(onAlarm)()
+    {
+        uint32_t interrupts = save_and_disable_interrupts();
+        advance(nowTick());
+
+        while (g_listHeads[EXPIRED_LIST] != NO_TIMER)
+        {
+            int16_t index = g_listHeads[EXPIRED_LIST];
+            Timer &t = g_timers[index];
+            TimerWheel::TimerId id = makeId(index);
+
+            uint32_t latency = Platform::timeUs() - t.expires * TICK_US;
+            if (latency > g_stats.maxCallbackLatencyUs)
+                g_stats.maxCallbackLatencyUs = latency;
+
+            // Call back with interrupts enabled, the timer being still allocated so that it can
+            // be cancelled by the callback.
+            restore_interrupts(interrupts);
+            int64_t reschedule = t.callback(id, t.userData);
+            interrupts = save_and_disable_interrupts();
+
+            // Skip if the callback cancelled the timer
+            if (indexFromId(id) == NO_TIMER || t.list != EXPIRED_LIST)
+                continue;
+
+            unlink(index);
+            if (reschedule == 0)
+            {
+                link(index, FREE_LIST);
+                g_stats.activeTimers--;
+            } else
+            {
+                if (reschedule < 0)
+                    t.expires += (-reschedule + TICK_US - 1) / TICK_US;
+                else
+                    t.expires = nowTick() + (reschedule + TICK_US - 1) / TICK_US;
+                insert(index);
+            }
+        }
+
+        arm();
+        restore_interrupts(interrupts);
+    }
+}
+
+TimerWheel::TimerId RAM_FUNC(TimerWheel::addInMs)(uint32_t ms, Callback callback, void *userData)
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (!g_initialized)
+        initialize();
+
+    int16_t index = g_listHeads[FREE_LIST];
+    if (index == NO_TIMER)
+    {
+        restore_interrupts(interrupts);
+        TRACE << "No free timer";
+        return -1;
+    }
+
+    // The current tick only moves when the alarm fires, and lags behind after an idle period.
+    // The delay is measured from it, so bring it up to date first.
+    advance(nowTick());
+
+    unlink(index);
+    Timer &t = g_timers[index];
+    t.generation++;
+    t.callback = callback;
+    t.userData = userData;
+
+    // Round up so that at least the given delay elapses.
+    t.expires = (Platform::timeUs() + ms * 1000ull + TICK_US - 1) / TICK_US;
+    insert(index);
+
+    g_stats.activeTimers++;
+    if (g_stats.activeTimers > g_stats.maxActiveTimers)
+        g_stats.maxActiveTimers = g_stats.activeTimers;
+
+    arm();
+    TimerId id = makeId(index);
+    restore_interrupts(interrupts);
+
+    return id;
+}
+
+bool RAM_FUNC(TimerWheel::cancel)(TimerId id)
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    int16_t index = indexFromId(id);
+    if (index == NO_TIMER)
+    {
+        restore_interrupts(interrupts);
+        return false;
+    }
+
+    unlink(index);
+    link(index, FREE_LIST);
+    g_stats.activeTimers--;
+
+    arm();
+    restore_interrupts(interrupts);
+    return true;
+}
+
+TimerWheel::Stats TimerWheel::stats()
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    Stats s = g_stats;
+    restore_interrupts(interrupts);
+    return s;
+}
+
+void TimerWheel::resetStats()
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    g_stats.maxActiveTimers = g_stats.activeTimers;
+    g_stats.maxCallbackLatencyUs = 0;
+    restore_interrupts(interrupts);
+}
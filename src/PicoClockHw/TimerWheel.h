@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Hierarchical timing wheel replacing the alarm pool of the Pico SDK for the drivers. Timers are
+// taken from a fixed preallocated pool, inserting and cancelling are O(1), and all timers are
+// driven by a single hardware alarm that is only armed for the next slot that needs processing.
+// Callbacks are called from interrupt context.
+class TimerWheel
+{
+public:
+    using TimerId = int32_t; // -1 means no timer
+    
+    // Same semantics as alarm callbacks of the Pico SDK: return 0 to stop, a negative value to 
+    // reschedule this many us after the previous target, a positive value to reschedule this many
+    // us from now. The timer keeps its id when rescheduled.
+    using Callback = int64_t (*)(TimerId id, void *userData);
+
+    struct Stats
+    {
+        int activeTimers;
+        int maxActiveTimers;
+        uint32_t maxCallbackLatencyUs;
+    };
+
+    // Return the id of the timer, or -1 if the pool is exhausted. The resolution is 1 ms.
+    static TimerId addInMs(uint32_t ms, Callback callback, void *userData);
+
+    // Return true if the timer was active. Ids of expired or cancelled timers are ignored.
+    static bool cancel(TimerId id);
+
+    static Stats stats();
+    static void resetStats();
+};
@@ -0,0 +1,81 @@
+#include "WarmRestart.h"
+#include "Utils/Trace.h"
+#include "Platform.h"
+
+#include <hardware/watchdog.h>
+#include <pico/time.h>
+
+// Layout of the scratch registers. Scratch 4 to 7 are reserved for the Pico SDK and the bootrom.
+//
+// 0: time
+// 1: bits 0-19 phase in us, bit 20 hasRtc, bits 24-31 MAGIC
+// 2: bits 0-15 drift, bits 16-31 minutes since the last NTP sync
+// 3: checksum of 0 to 2
+namespace
+{
+    const uint32_t MAGIC = 0xC1;
+    const uint32_t PHASE_MASK = 0xFFFFF;
+    const uint32_t HAS_RTC = 1 << 20;
+
+    uint32_t checksum(uint32_t s0, uint32_t s1, uint32_t s2)
+    {
+        // Not meant to be strong, only to reject random content and partially written states.
+        uint32_t sum = 0x9E3779B9;
+        for (uint32_t value : {s0, s1, s2})
+        {
+            sum ^= value;
+            sum *= 0x01000193;
+            sum ^= sum >> 15;
+        }
+        return sum;
+    }
+}
+
+void RAM_FUNC(WarmRestart::save)(const State &state)
+{
+    uint32_t s0 = static_cast<uint32_t>(state.time);
+    uint32_t s1 = 
+        (state.phaseUs & PHASE_MASK) | (state.hasRtc ? HAS_RTC : 0) | (MAGIC << 24);
+    uint32_t s2 = 
+        (static_cast<uint32_t>(state.driftCentiPpm) & 0xFFFF) | (state.minSinceNtpSync << 16);
+
+    // Invalidate the checksum first, so that a reset in the middle of the update cannot lead to
+    // restoring a mix of old and new values.
+    watchdog_hw->scratch[3] = ~checksum(s0, s1, s2);
+    watchdog_hw->scratch[0] = s0;
+    watchdog_hw->scratch[1] = s1;
+    watchdog_hw->scratch[2] = s2;
+    watchdog_hw->scratch[3] = checksum(s0, s1, s2);
+}
+
+bool WarmRestart::restore(State &state)
+{
+    // After a power-on, the scratch registers are cleared, but a random match is not impossible 
+    // after a reset by the RUN pin.
+    if (!watchdog_caused_reboot())
+    {
+        TRACE << "No watchdog reboot";
+        return false;
+    }
+
+    uint32_t s0 = watchdog_hw->scratch[0];
+    uint32_t s1 = watchdog_hw->scratch[1];
+    uint32_t s2 = watchdog_hw->scratch[2];
+    if ((s1 >> 24) != MAGIC || watchdog_hw->scratch[3] != checksum(s0, s1, s2))
+    {
+        TRACE << "No valid state saved";
+        return false;
+    }
+
+    // The timer restarts from 0 on reset, so its value is the time elapsed since then. Add it 
+    // and normalize.
+    uint64_t phaseUs = (s1 & PHASE_MASK) + time_us_64();
+    state.time = static_cast<time_t>(s0) + static_cast<time_t>(phaseUs / 1000000);
+    state.phaseUs = phaseUs % 1000000;
+    state.hasRtc = (s1 & HAS_RTC) != 0;
+    state.driftCentiPpm = static_cast<int16_t>(s2 & 0xFFFF);
+    state.minSinceNtpSync = s2 >> 16;
+
+    TRACE << "Restored time" << state.time << "phase" << state.phaseUs;
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <time.h>
+
+// Keep the time across watchdog and software resets in the watchdog scratch registers, which are
+// only cleared on power-on. This allows displaying the correct time immediately after a reset,
+// without waiting for the RTC or NTP, and even if there is no RTC.
+class WarmRestart
+{
+public:
+    struct State
+    {
+        time_t time; // Time at the start of the current second, local, not considering DST
+        uint32_t phaseUs; // Time elapsed since the start of the second
+        int32_t driftCentiPpm; // Drift estimate of the clock, in 0.01 ppm
+        uint32_t minSinceNtpSync; // NO_NTP_SYNC if there was no sync
+        bool hasRtc;
+    };
+
+    static const uint32_t NO_NTP_SYNC = 0xFFFF;
+
+    // Cheap enough to be called on every frame, so that a reset at any moment loses at most one 
+    // frame.
+    static void save(const State &state);
+
+    // Return true if the state was saved before a watchdog or software reset. The returned phase
+    // includes the time elapsed since the reset.
+    static bool restore(State &state);
+};
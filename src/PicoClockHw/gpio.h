@@ -3,6 +3,7 @@
 enum Gpio
 {
     K2 = 2,         // Input:  top button
+    SQW = 3,        // Input:  1 Hz square wave from DS3231, falls when its seconds change
     SDA = 6,        // Output: I2C data line to DS3231
     SCL = 7,        // Output: I2C clock line to DS3231
     CLK = 10,       // Output: clock line for LED matrix controller
@@ -0,0 +1,76 @@
+#include "RtcCalibrator.h"
+#include "Utils/Trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    // The drift is evaluated once it caused an offset that is large compared to the inaccuracy
+    // of NTP and of the measurements, over at least 2 days. A smaller offset after 30 days means
+    // that the RTC is accurate to a few 0.01 ppm, the measurement then starts again.
+    const int64_t MIN_CALIBRATION_SEC = 2 * 24 * 60 * 60;
+    const int64_t MAX_CALIBRATION_SEC = 30 * 24 * 60 * 60;
+    const int64_t MIN_SIGNIFICANT_OFFSET_US = 100000;
+
+    // The RTC is only used at startup, so it is set again only when its error would be visible.
+    // Not setting it on each NTP sync lets its drift accumulate, which is what is measured.
+    const int64_t MAX_RTC_OFFSET_US = 100000;
+
+    // One step of the aging offset changes the frequency by about 0.1 ppm at 25°C. Positive
+    // steps slow the oscillator down.
+    const int64_t CENTI_PPM_PER_AGING_STEP = 10;
+
+    // A larger drift is not the crystal, e.g. the oscillator stopped, so it is not corrected.
+    const int64_t MAX_DRIFT_CENTI_PPM = 2000; // 20 ppm
+
+    // Limit the change from a single measurement, in case it was disturbed.
+    const int MAX_AGING_CHANGE = 30;
+}
+
+RtcCalibrator::Result RtcCalibrator::onOffsetMeasured(time_t time, int64_t offsetUs)
+{
+    Result result = {};
+
+    if (m_periodStartTime != -1 && time > m_periodStartTime)
+    {
+        m_measuredSec += time - m_periodStartTime;
+        m_measuredOffsetUs += offsetUs - m_periodStartOffsetUs;
+    }
+    m_periodStartTime = time;
+    m_periodStartOffsetUs = offsetUs;
+
+    if (m_measuredSec >= MAX_CALIBRATION_SEC || 
+        (m_measuredSec >= MIN_CALIBRATION_SEC && std::abs(m_measuredOffsetUs) >= MIN_SIGNIFICANT_OFFSET_US))
+    {
+        // ppm is us per s, positive if the RTC is fast.
+        int64_t driftCentiPpm = m_measuredOffsetUs * 100 / m_measuredSec;
+        m_measuredSec = 0;
+        m_measuredOffsetUs = 0;
+        TRACE << "RTC drift" << driftCentiPpm << "x0.01 ppm";
+
+        int64_t halfStep = CENTI_PPM_PER_AGING_STEP / 2;
+        int64_t steps = 
+            (driftCentiPpm + (driftCentiPpm >= 0 ? halfStep : -halfStep)) / CENTI_PPM_PER_AGING_STEP;
+        steps = std::max<int64_t>(-MAX_AGING_CHANGE, std::min<int64_t>(steps, MAX_AGING_CHANGE));
+        int agingOffset = std::max<int>(
+            INT8_MIN, std::min<int>(m_calibration.agingOffset + steps, INT8_MAX));
+
+        if (std::abs(driftCentiPpm) <= MAX_DRIFT_CENTI_PPM && agingOffset != m_calibration.agingOffset)
+        {
+            TRACE << "New RTC aging offset" << agingOffset;
+            m_calibration.agingOffset = agingOffset;
+            m_calibration.adjustments++;
+            m_calibration.lastAdjustmentTime = time;
+
+            auto &history = m_calibration.driftHistory;
+            memmove(history + 1, history, sizeof(history) - sizeof(history[0]));
+            history[0] = driftCentiPpm;
+            result.agingChanged = true;
+        }
+    }
+
+    result.writeTime = std::abs(offsetUs) > MAX_RTC_OFFSET_US;
+    return result;
+}
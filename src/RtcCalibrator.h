@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Settings.h"
+
+#include <cstdint>
+#include <time.h>
+
+// Trims the crystal of the DS3231 through its aging offset register, from its drift measured
+// against NTP. The offset of the RTC is measured at each NTP sync. The drift is accumulated over
+// the periods during which the RTC was not written, and the aging offset is adjusted once the
+// accumulated offset is large compared to the inaccuracy of NTP and of the measurements.
+//
+// The measurement in progress is lost on reboot, only the calibration is persisted.
+class RtcCalibrator
+{
+public:
+    struct Result
+    {
+        bool writeTime; // The RTC is too far off and must be set
+        bool agingChanged; // The new aging offset must be written to the RTC and persisted
+    };
+
+    void setCalibration(const Settings::RtcCalibration &calibration)
+    {
+        m_calibration = calibration;
+    }
+
+    const Settings::RtcCalibration &calibration() const
+    {
+        return m_calibration;
+    }
+
+    // Offset of the RTC at the given time, positive if the RTC is ahead. Both must be accurate,
+    // i.e. measured right after an NTP sync.
+    Result onOffsetMeasured(time_t time, int64_t offsetUs);
+
+    // The offset of the RTC jumped, the current period ends.
+    void onRtcWritten()
+    {
+        m_periodStartTime = -1;
+    }
+
+private:
+    Settings::RtcCalibration m_calibration;
+    time_t m_periodStartTime = -1; // -1 if not measured since the RTC was last written
+    int64_t m_periodStartOffsetUs = 0;
+    int64_t m_measuredSec = 0; // Total length of the periods
+    int64_t m_measuredOffsetUs = 0; // Total drift of the RTC over the periods
+};
@@ -0,0 +1,169 @@
+#include "RtcTimeSource.h"
+#include "PicoClockHw/Platform.h"
+#include "Utils/Trace.h"
+#include "Utils/Trampoline.h"
+
+#include <hardware/sync.h>
+
+namespace
+{
+    // The RTC is set from NTP and keeps about 2 ppm, so it ranks below any usual NTP server but
+    // above the tick source of the clock.
+    const int STRATUM = 8;
+
+    // Without edge of the 1 Hz output for this long, it is not connected or not running, and the
+    // sample is taken by polling the time registers.
+    const int64_t SQUARE_WAVE_TIMEOUT_US = 2000000;
+    const uint32_t POLL_PERIOD_MS = 10;
+
+    // Latency of the edge interrupt
+    const uint32_t SQUARE_WAVE_PRECISION_US = 100;
+
+    // Long enough to detect the missing 1 Hz output and to poll a change of second
+    const uint64_t SAMPLE_TIMEOUT_US = 4000000;
+
+    TimeSource::Sample sampleOf(tm rtcTime, uint64_t timeUs)
+    {
+        // The RTC time is the one of the second starting at timeUs.
+        TimeSource::Sample sample;
+        sample.time = mktime(&rtcTime);
+        sample.timeUs = timeUs;
+        return sample;
+    }
+}
+
+RtcTimeSource::RtcTimeSource() : m_rtc(std::make_unique<Rtc>())
+{
+    using namespace std::placeholders;
+    m_rtc->setSecondCallback(std::bind(&RtcTimeSource::onSecond, this, _1));
+}
+
+int RtcTimeSource::stratum() const
+{
+    return STRATUM;
+}
+
+uint32_t RtcTimeSource::precisionUs() const
+{
+    if (m_rtc && hasSquareWave(Platform::timeUs()))
+        return SQUARE_WAVE_PRECISION_US;
+    return POLL_PERIOD_MS * 1000;
+}
+
+bool RtcTimeSource::hasSquareWave(uint64_t nowUs) const
+{
+    return static_cast<int64_t>(nowUs - m_rtc->lastSecondEdgeUs()) <= SQUARE_WAVE_TIMEOUT_US;
+}
+
+// May be called from the main loop while the RTC interrupts are running.
+bool RtcTimeSource::requestSample(SampleCallback callback)
+{
+    if (!m_rtc)
+        return false;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    bool started = !m_sampleCallback;
+    if (started)
+    {
+        m_sampleCallback = callback;
+        m_requestUs = Platform::timeUs();
+        m_lastSec = -1;
+
+        MAKE_TRAMPOLINE(RtcTimeSource, poll, userPtrAtEnd);
+        m_pollTimer = TimerWheel::addInMs(POLL_PERIOD_MS, poll, this);
+        if (m_pollTimer == -1)
+        {
+            m_sampleCallback = nullptr;
+            started = false;
+        }
+    }
+    restore_interrupts(interrupts);
+    return started;
+}
+
+void RtcTimeSource::onSecond(uint64_t edgeUs)
+{
+    if (!m_rtc)
+        return; // Disabled
+
+    if (m_sampleCallback && !m_readPending)
+    {
+        // The registers now hold the second that just started, so a single read is enough.
+        using namespace std::placeholders;
+        m_readUs = edgeUs;
+        m_readPending = true;
+        if (!m_rtc->readAsync(std::bind(&RtcTimeSource::onReadAtEdge, this, _1, _2)))
+            m_readPending = false;
+    }
+
+    if (m_secondCallback)
+        m_secondCallback(edgeUs);
+}
+
+void RtcTimeSource::onReadAtEdge(bool ok, const tm &rtcTime)
+{
+    m_readPending = false;
+    if (!m_sampleCallback)
+        return;
+
+    TRACE << "RTC sampled at the 1 Hz edge";
+    finish(ok, sampleOf(rtcTime, m_readUs));
+}
+
+int64_t RtcTimeSource::poll(TimerWheel::TimerId id)
+{
+    uint64_t now = Platform::timeUs();
+    if (!m_rtc || now - m_requestUs > SAMPLE_TIMEOUT_US)
+    {
+        TRACE << "RTC sample timed out";
+        m_pollTimer = -1;
+        finish(false, Sample());
+        return 0;
+    }
+
+    // With the 1 Hz output, the sample is taken at its next edge.
+    if (!m_readPending && !hasSquareWave(now))
+    {
+        using namespace std::placeholders;
+        m_readUs = now;
+        m_readPending = true;
+        if (!m_rtc->readAsync(std::bind(&RtcTimeSource::onPolled, this, _1, _2)))
+            m_readPending = false;
+    }
+    return POLL_PERIOD_MS * 1000;
+}
+
+void RtcTimeSource::onPolled(bool ok, const tm &rtcTime)
+{
+    m_readPending = false;
+    if (!m_sampleCallback)
+        return;
+
+    if (!ok)
+    {
+        finish(false, Sample());
+    } else if (m_lastSec == -1)
+    {
+        // First read, the next change of second will be detected from now on.
+        m_lastSec = rtcTime.tm_sec;
+    } else if (rtcTime.tm_sec != m_lastSec)
+    {
+        // The second changed at most one poll period before this read.
+        TRACE << "RTC sampled by polling";
+        finish(true, sampleOf(rtcTime, m_readUs));
+    }
+}
+
+void RtcTimeSource::finish(bool ok, const Sample &sample)
+{
+    if (m_pollTimer != -1)
+    {
+        TimerWheel::cancel(m_pollTimer);
+        m_pollTimer = -1;
+    }
+
+    // Cleared before calling, so that the callback can request the next sample.
+    SampleCallback callback = std::move(m_sampleCallback);
+    m_sampleCallback = nullptr;
+    callback(ok, sample);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "TimeSource.h"
+#include "PicoClockHw/Rtc.h"
+#include "PicoClockHw/TimerWheel.h"
+
+#include <memory>
+
+// The DS3231, sampled at an edge of its 1 Hz output, or by polling its registers until the
+// second changes if that output is not connected.
+class RtcTimeSource : public TimeSource
+{
+public:
+    RtcTimeSource();
+
+    // The RTC is not connected, or must not be used anymore.
+    void disable()
+    {
+        m_rtc.release();
+    }
+
+    Rtc *rtc()
+    {
+        return m_rtc.get();
+    }
+
+    // Forwarded from the RTC, after the pending sample if any was started from the same edge
+    void setSecondCallback(Rtc::SecondCallback callback)
+    {
+        m_secondCallback = callback;
+    }
+
+    const char *name() const override
+    {
+        return "RTC";
+    }
+    int stratum() const override;
+    uint32_t precisionUs() const override;
+    bool isAvailable() const override
+    {
+        return m_rtc.operator bool();
+    }
+    bool requestSample(SampleCallback callback) override;
+
+private:
+    void onSecond(uint64_t edgeUs);
+    void onReadAtEdge(bool ok, const tm &rtcTime);
+    int64_t poll(TimerWheel::TimerId id);
+    void onPolled(bool ok, const tm &rtcTime);
+    void finish(bool ok, const Sample &sample);
+    bool hasSquareWave(uint64_t nowUs) const;
+
+    std::unique_ptr<Rtc> m_rtc; // As unique_ptr so that it can be easily disabled
+    Rtc::SecondCallback m_secondCallback;
+
+    SampleCallback m_sampleCallback; // Set while a sample is pending
+    uint64_t m_requestUs = 0;
+    TimerWheel::TimerId m_pollTimer = -1;
+    bool m_readPending = false;
+    uint64_t m_readUs = 0; // Edge at which the RTC is being read, or start of the polled read
+    int m_lastSec = -1; // -1 if the RTC was not polled yet during the sample
+};
@@ -1,18 +1,426 @@
 #include "Settings.h"
 #include "PicoClockHw/Flash.h"
+#include "PicoClockHw/Platform.h"
 #include "Utils/Trace.h"
+#include "Utils/Trampoline.h"
+
+#include <hardware/sync.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace
+{
+    // Delay without modification before the values get written to flash, to mitigate wear when 
+    // e.g. a button is held to scroll through a value.
+    const uint32_t WRITE_DELAY_MS = 60 * 1000;
+
+    // Maximum delay after the first modification, so that modifications keep being saved when
+    // they never stop for the delay above.
+    const uint32_t MAX_WRITE_DELAY_MS = 5 * 60 * 1000;
+
+    // The values are stored as a list of fields, each made of a key and a value, both as varints
+    // like in Protocol Buffers: the key is the id of the field shifted left by 3 bits, combined 
+    // with the wire type. Signed values are zigzag encoded, so that small negative values stay 
+    // short. Fields with an unknown id are skipped, and missing fields keep their default value, 
+    // so that values written by other versions of the program can be read.
+    //
+    // The wear counters of the flash change on every write, so they are encoded with a fixed size,
+    // as the 32-bit fixed wire type of Protocol Buffers. Otherwise, a counter getting one byte
+    // longer would change the size of the encoded values, which Flash can only write as a full
+    // snapshot instead of a delta.
+    //
+    // The encoding starts with a marker byte, which cannot be the first byte of the raw copy of
+    // Values written by previous versions, as it would be a negative function index.
+    const uint8_t FORMAT_MARKER = 0xFE;
+    const int MAX_VARINT_SIZE = 10;
+
+    enum WireType : uint8_t
+    {
+        Varint = 0,
+        LengthDelimited = 2, // Not used yet, but can be skipped by this version
+        Fixed32 = 5 // Little endian, unsigned
+    };
+
+    // Limits of the type of a field, also for enums
+    template <typename T, bool = std::is_enum<T>::value>
+    struct FieldType : std::numeric_limits<T> {};
+    template <typename T>
+    struct FieldType<T, true> : std::numeric_limits<typename std::underlying_type<T>::type> {};
+
+    struct Field
+    {
+        uint8_t id; // Identifies the field in flash, must never change nor be reused
+        uint8_t size;
+        uint16_t offset;
+        bool isSigned;
+        int64_t min; // Range of the valid values, others are skipped when decoding
+        int64_t max;
+    };
+
+    // Also for array elements, whose decltype is a reference
+    #define MEMBER_TYPE(Struct, name) std::decay_t<decltype(std::declval<Struct>().name)>
+    #define FIELD(Struct, id, name, min, max) \
+        {id, sizeof(std::declval<Struct>().name), offsetof(Struct, name), \
+         FieldType<MEMBER_TYPE(Struct, name)>::is_signed, min, max}
+    #define SETTINGS_FIELD(id, name, min, max) FIELD(Settings::Values, id, name, min, max)
+    #define BOOL_FIELD(id, name) SETTINGS_FIELD(id, name, 0, 1)
+    #define ENUM_FIELD(id, name, Enum) \
+        SETTINGS_FIELD(id, name, 0, static_cast<int64_t>(Enum::Count) - 1)
+    #define WEAR_FIELD(id, name) \
+        FIELD(Flash::Wear, id, name, 0, FieldType<MEMBER_TYPE(Flash::Wear, name)>::max())
+
+    constexpr Field FIELDS[] = 
+    {
+        SETTINGS_FIELD(1, function, 0, Settings::FUNCTION_COUNT - 1),
+        BOOL_FIELD(2, autoScroll),
+        BOOL_FIELD(3, useCelsius),
+        BOOL_FIELD(4, format24h),
+        ENUM_FIELD(5, hourlyChime, Settings::HourlyChimeMode),
+        BOOL_FIELD(6, autoLight),
+        ENUM_FIELD(7, alarm1.mode, Settings::AlarmMode),
+        SETTINGS_FIELD(8, alarm1.hour, 0, 23),
+        SETTINGS_FIELD(9, alarm1.min, 0, 59),
+        SETTINGS_FIELD(10, alarm1.weekDayBits, 0, 0x7F),
+        ENUM_FIELD(11, alarm2.mode, Settings::AlarmMode),
+        SETTINGS_FIELD(12, alarm2.hour, 0, 23),
+        SETTINGS_FIELD(13, alarm2.min, 0, 59),
+        SETTINGS_FIELD(14, alarm2.weekDayBits, 0, 0x7F),
+        BOOL_FIELD(15, skipNextAlarm),
+        SETTINGS_FIELD(16, countdownStartMin, 0, 59),
+        SETTINGS_FIELD(17, countdownStartSec, 0, 59),
+        SETTINGS_FIELD(18, manualBrightness, 0, 100),
+        SETTINGS_FIELD(19, brightnessDark, -100, 100),
+        SETTINGS_FIELD(20, brightnessDim, -100, 100),
+        SETTINGS_FIELD(21, brightnessBright, -100, 100),
+        SETTINGS_FIELD(22, rtcCalibration.agingOffset, INT8_MIN, INT8_MAX), // Whole register
+        SETTINGS_FIELD(23, rtcCalibration.adjustments, 0, UINT16_MAX),
+        SETTINGS_FIELD(24, rtcCalibration.lastAdjustmentTime, 0, UINT32_MAX),
+        SETTINGS_FIELD(25, rtcCalibration.driftHistory[0], INT16_MIN, INT16_MAX),
+        SETTINGS_FIELD(26, rtcCalibration.driftHistory[1], INT16_MIN, INT16_MAX),
+        SETTINGS_FIELD(27, rtcCalibration.driftHistory[2], INT16_MIN, INT16_MAX),
+        SETTINGS_FIELD(28, rtcCalibration.driftHistory[3], INT16_MIN, INT16_MAX),
+    };
+    const size_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+    // The wear counters of the flash are stored with the values, so that they cover the whole 
+    // life of the device.
+    constexpr Field WEAR_FIELDS[] = 
+    {
+        WEAR_FIELD(100, erases),
+        WEAR_FIELD(101, pagePrograms),
+        WEAR_FIELD(102, skippedWrites),
+        WEAR_FIELD(103, blockedMs),
+    };
+    const size_t WEAR_FIELD_COUNT = sizeof(WEAR_FIELDS) / sizeof(WEAR_FIELDS[0]);
+
+    constexpr const Field &fieldAt(size_t i)
+    {
+        return i < FIELD_COUNT ? FIELDS[i] : WEAR_FIELDS[i - FIELD_COUNT];
+    }
+
+    constexpr bool hasUniqueIds()
+    {
+        for (size_t i = 0; i < FIELD_COUNT + WEAR_FIELD_COUNT; i++)
+        {
+            for (size_t j = i + 1; j < FIELD_COUNT + WEAR_FIELD_COUNT; j++)
+            {
+                if (fieldAt(i).id == fieldAt(j).id)
+                    return false;
+            }
+        }
+        return true;
+    }
+    static_assert(hasUniqueIds(), "Field ids must be unique");
+
+    constexpr bool fitsInInt64()
+    {
+        for (size_t i = 0; i < FIELD_COUNT + WEAR_FIELD_COUNT; i++)
+        {
+            if (fieldAt(i).size > 4)
+                return false;
+        }
+        return true;
+    }
+    static_assert(fitsInInt64(), "Fields are handled as int64_t and must be at most 32 bits");
+
+    constexpr bool hasRangesWithinTypes()
+    {
+        for (size_t i = 0; i < FIELD_COUNT + WEAR_FIELD_COUNT; i++)
+        {
+            const Field &field = fieldAt(i);
+            int bits = field.size * 8;
+            int64_t max = (int64_t(1) << (field.isSigned ? bits - 1 : bits)) - 1;
+            int64_t min = field.isSigned ? -max - 1 : 0;
+            if (field.min > field.max || field.min < min || field.max > max)
+                return false;
+        }
+        return true;
+    }
+    static_assert(hasRangesWithinTypes(), "The range of a field must fit in its type");
+
+    static_assert(FIELD_COUNT <= 32, "Changed fields are tracked as bits");
+
+    void putVarint(uint8_t *encoded, size_t &pos, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            encoded[pos++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        encoded[pos++] = value;
+    }
+
+    bool getVarint(const uint8_t *encoded, size_t size, size_t &pos, uint64_t &value)
+    {
+        value = 0;
+        for (int i = 0; i < MAX_VARINT_SIZE && pos < size; i++)
+        {
+            uint8_t byte = encoded[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    int64_t loadField(const void *base, const Field &field)
+    {
+        // Little endian, sign extended if needed
+        uint64_t raw = 0;
+        memcpy(&raw, static_cast<const uint8_t *>(base) + field.offset, field.size);
+        int shift = 64 - 8 * field.size;
+        if (field.isSigned)
+            return static_cast<int64_t>(raw << shift) >> shift;
+        return raw;
+    }
+
+    void storeField(void *base, const Field &field, int64_t value)
+    {
+        memcpy(static_cast<uint8_t *>(base) + field.offset, &value, field.size);
+    }
+
+    void encodeFields(
+        const Field *fields, size_t count, const void *base, WireType type, uint8_t *encoded,
+        size_t &pos)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            int64_t value = loadField(base, fields[i]);
+            putVarint(encoded, pos, fields[i].id << 3 | type);
+            if (type == Fixed32)
+            {
+                for (int byte = 0; byte < 4; byte++)
+                    encoded[pos++] = static_cast<uint64_t>(value) >> (8 * byte);
+            } else
+            {
+                // Zigzag encoded
+                putVarint(encoded, pos, (static_cast<uint64_t>(value) << 1) ^ (value >> 63));
+            }
+        }
+    }
+
+    const Field *fieldById(const Field *fields, size_t count, uint64_t id)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (fields[i].id == id)
+                return &fields[i];
+        }
+        return nullptr;
+    }
+}
 
 Settings::Settings()
 {
-    Flash::attach(reinterpret_cast<uint8_t *>(&m_values), sizeof(m_values));
-    Flash::read();
+    static_assert(sizeof(Values) <= MAX_ENCODED_SIZE, "The raw copy of previous versions must fit");
+    Flash::attach(m_encoded, sizeof(m_encoded));
+    int size = Flash::read();
+    if (size > 0 && m_encoded[0] == FORMAT_MARKER)
+    {
+        Flash::Wear wear = {};
+        if (!decode(m_encoded, size, m_values, wear))
+            TRACE << "Settings partially decoded";
+        Flash::restoreWear(wear);
+    } else if (size > 0)
+    {
+        // Raw copy of Values written by previous versions. It is replaced by the encoded values
+        // on the next commit.
+        TRACE << "Reading raw settings";
+        memcpy(&m_values, m_encoded, std::min<size_t>(size, sizeof(m_values)));
+    }
+    m_persisted = m_values;
 
     TRACE << "countdownStartSec" << m_values.countdownStartSec;
 }
 
-Settings::Values &Settings::modify()
+Settings::Modification Settings::modify()
+{
+    // The sequence becomes odd when the first of nested modifications starts.
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (m_modifyDepth++ == 0)
+        m_modifyCount = m_modifyCount + 1;
+    restore_interrupts(interrupts);
+    __dmb();
+
+    m_stats.modifyCalls++;
+    m_lastModifyUs = Platform::timeUs();
+
+    if (m_commitTimer != -1)
+    {
+        // The timer is not restarted here, as this is called very often when scrolling through a
+        // value. It checks the time of the last modification when it expires instead.
+        m_stats.avoidedWrites++;
+    } else
+    {
+        m_firstModifyUs = m_lastModifyUs;
+        MAKE_TRAMPOLINE(Settings, commit, userPtrAtEnd);
+        m_commitTimer = TimerWheel::addInMs(WRITE_DELAY_MS, commit, this);
+    }
+
+    return Modification(this);
+}
+
+void Settings::endModify()
+{
+    __dmb();
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (--m_modifyDepth == 0)
+        m_modifyCount = m_modifyCount + 1;
+    restore_interrupts(interrupts);
+}
+
+Settings::Values Settings::snapshot() const
+{
+    Values values;
+    uint32_t modifyCount;
+    do
+    {
+        modifyCount = m_modifyCount;
+        __dmb();
+        values = m_values;
+        __dmb();
+    } while ((modifyCount & 1) != 0 || modifyCount != m_modifyCount);
+
+    return values;
+}
+
+// Return a bit per field of the given values that differs from the persisted values.
+uint32_t Settings::changedFields(const Values &values) const
+{
+    auto bytes = reinterpret_cast<const uint8_t *>(&values);
+    auto persisted = reinterpret_cast<const uint8_t *>(&m_persisted);
+
+    uint32_t changed = 0;
+    for (size_t i = 0; i < FIELD_COUNT; i++)
+    {
+        const Field &field = FIELDS[i];
+        if (memcmp(bytes + field.offset, persisted + field.offset, field.size) != 0)
+            changed |= 1u << i;
+    }
+    return changed;
+}
+
+int64_t Settings::commit(TimerWheel::TimerId id)
 {
-    Flash::scheduleWrite();
+    uint64_t nowUs = Platform::timeUs();
+    uint64_t dueUs = std::min(
+        m_lastModifyUs + WRITE_DELAY_MS * 1000ull, m_firstModifyUs + MAX_WRITE_DELAY_MS * 1000ull);
+    if (dueUs > nowUs)
+        return dueUs - nowUs; // Modified since the timer was started
 
-    return m_values;
-}
\ No newline at end of file
+    m_commitTimer = -1;
+
+    // The values are only read through a snapshot, so that the record written is consistent even
+    // if the commit gets interrupted by a modification. Such a modification starts a new commit.
+    Values values = snapshot();
+    uint32_t changed = changedFields(values);
+    if (changed == 0)
+    {
+        TRACE << "Settings did not change, no need to flash.";
+        m_stats.avoidedWrites++;
+        Flash::countSkippedWrite();
+        return 0;
+    }
+
+    TRACE << "Changed settings fields" << changed;
+    m_persisted = values;
+    m_stats.commits++;
+    m_stats.changedFields += __builtin_popcount(changed);
+    Flash::startWrite(encode(values, Flash::wear(), m_encoded));
+    return 0;
+}
+
+// Encode the values and wear counters in the format described at the top of the file, return the 
+// size.
+size_t Settings::encode(const Values &values, const Flash::Wear &wear, uint8_t *encoded)
+{
+    // Keys take up to 2 bytes with ids below 2^11, zigzag encoded 32-bit values up to 5 bytes.
+    static_assert(
+        1 + (FIELD_COUNT + WEAR_FIELD_COUNT) * (2 + 5) <= MAX_ENCODED_SIZE, 
+        "Encoded values may not fit");
+
+    size_t pos = 0;
+    encoded[pos++] = FORMAT_MARKER;
+    encodeFields(FIELDS, FIELD_COUNT, &values, Varint, encoded, pos);
+    encodeFields(WEAR_FIELDS, WEAR_FIELD_COUNT, &wear, Fixed32, encoded, pos);
+    return pos;
+}
+
+// Decode the fields into values and wear, which must be initialized with the defaults. Return
+// false if the encoded values are corrupted, in which case the fields decoded so far are kept.
+bool Settings::decode(const uint8_t *encoded, size_t size, Values &values, Flash::Wear &wear)
+{
+    size_t pos = 1; // Skip the marker
+    while (pos < size)
+    {
+        uint64_t key, value;
+        if (!getVarint(encoded, size, pos, key))
+            return false;
+
+        int64_t decoded;
+        switch (key & 7)
+        {
+            case Varint:
+                if (!getVarint(encoded, size, pos, value))
+                    return false;
+                decoded = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+                break;
+            case Fixed32:
+                if (size - pos < 4)
+                    return false;
+                decoded = 0;
+                for (int byte = 0; byte < 4; byte++)
+                    decoded |= static_cast<int64_t>(encoded[pos++]) << (8 * byte);
+                break;
+            case LengthDelimited:
+                // The value read is the length of the content.
+                if (!getVarint(encoded, size, pos, value) || value > size - pos)
+                    return false;
+                pos += value;
+                continue;
+            default:
+                // The size of other wire types is unknown.
+                return false;
+        }
+
+        void *base = &values;
+        const Field *field = fieldById(FIELDS, FIELD_COUNT, key >> 3);
+        if (field == nullptr)
+        {
+            base = &wear;
+            field = fieldById(WEAR_FIELDS, WEAR_FIELD_COUNT, key >> 3);
+        }
+
+        if (field != nullptr && decoded >= field->min && decoded <= field->max)
+            storeField(base, *field, decoded);
+        else
+            TRACE << "Skipped settings field" << (key >> 3);
+    }
+    return true;
+}
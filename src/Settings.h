@@ -1,10 +1,17 @@
 #pragma once
 
+#include "PicoClockHw/Flash.h"
+#include "PicoClockHw/TimerWheel.h"
+
 #include <cstdint>
+#include <cstddef>
 
 class Settings
 {
 public:
+    // Functions of the root menu of ClockUi, one of which is selected by Values::function
+    static const int FUNCTION_COUNT = 11;
+
     enum class HourlyChimeMode : uint8_t
     {
         Off = 0,
@@ -34,6 +41,17 @@ public:
         }
     };
 
+    // Trimming of the crystal of the RTC, maintained by the clock, see RtcCalibrator.
+    struct RtcCalibration
+    {
+        int8_t agingOffset = 0; // Value of the aging offset register of the DS3231
+        uint16_t adjustments = 0;
+        uint32_t lastAdjustmentTime = 0; // Local time without DST, 0 if never adjusted
+
+        // Drift measured before each of the last adjustments, in 0.01 ppm, newest first
+        int16_t driftHistory[4] = {};
+    };
+
     struct Values
     {
         int8_t function = 1; // Time with HourMinBar style by default
@@ -51,6 +69,7 @@ public:
         int brightnessDark = -20;
         int brightnessDim = 55;
         int brightnessBright = 100;
+        RtcCalibration rtcCalibration;
     };
 
     Settings();
@@ -61,9 +80,83 @@ public:
         return m_values;
     }
 
-    // Get write access to settings values and schedule saving to flash memory
-    Values &modify();
+    // Write access to the values for the lifetime of this object, given by modify(). It must not
+    // be kept beyond the modification, e.g. modify()->autoLight = false.
+    class Modification
+    {
+    public:
+        Modification(Modification &&other) : m_settings(other.m_settings)
+        {
+            other.m_settings = nullptr;
+        }
+
+        ~Modification()
+        {
+            if (m_settings != nullptr)
+                m_settings->endModify();
+        }
+
+        Values *operator->() const
+        {
+            return &m_settings->m_values;
+        }
+
+        Values &operator*() const
+        {
+            return m_settings->m_values;
+        }
+
+    private:
+        friend class Settings;
+        explicit Modification(Settings *settings) : m_settings(settings)
+        {
+        }
+
+        Settings *m_settings;
+    };
+
+    // Get write access to settings values and schedule saving to flash memory. Modifications
+    // are written together once no modification happened for a while, only if some field 
+    // actually changed.
+    Modification modify();
+
+    // Consistent copy of the values, which does not block modifications: the copy is taken again
+    // if a modification was in progress or happened meanwhile. As a modification cannot complete
+    // while it is interrupted, this must not be called from an interrupt that can preempt one.
+    Values snapshot() const;
+
+    struct Stats
+    {
+        uint32_t modifyCalls;
+        uint32_t commits;
+        uint32_t avoidedWrites; // Modifications merged into a pending commit or changed back
+        uint32_t changedFields; // Fields written by all commits
+    };
+    Stats stats() const
+    {
+        return m_stats;
+    }
+
+    // Encoded values as stored in flash, see Settings.cpp. Decoding skips the fields that are
+    // unknown or out of their range, keeping their previous value, and returns false if the
+    // encoding is damaged.
+    static const size_t MAX_ENCODED_SIZE = 256;
+    static size_t encode(const Values &values, const Flash::Wear &wear, uint8_t *encoded);
+    static bool decode(const uint8_t *encoded, size_t size, Values &values, Flash::Wear &wear);
 
 private:
+    uint32_t changedFields(const Values &values) const;
+    int64_t commit(TimerWheel::TimerId id);
+
+    void endModify();
+
     Values m_values;
+    volatile uint32_t m_modifyCount = 0; // Sequence checked by snapshot(), odd while modifying
+    int m_modifyDepth = 0; // Modifications in progress, which may be nested
+    Values m_persisted; // Values as last given to Flash
+    uint8_t m_encoded[MAX_ENCODED_SIZE];
+    TimerWheel::TimerId m_commitTimer = -1;
+    uint64_t m_firstModifyUs = 0; // First modification since the last commit
+    uint64_t m_lastModifyUs = 0;
+    Stats m_stats = {};
 };
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "TemperatureHistory.h"
+#include "Utils/Trace.h"
+#include "Utils/Trampoline.h"
+
+#ifdef TEMPERATURE_HISTORY_IN_FLASH
+#include "PicoClockHw/Crc32.h"
+#include "PicoClockHw/FlashLayout.h"
+
+#include <hardware/flash.h>
+#endif
+
+#include <hardware/sync.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    // Without sample for this long, the history is obsolete.
+    const time_t MAX_GAP_SEC = TemperatureHistory::HOUR_COUNT * 60 * 60;
+
+#ifdef TEMPERATURE_HISTORY_IN_FLASH
+    // Up to this many hours are lost on power loss. A checkpoint erases the sector, which lasts
+    // about 100000 erase cycles, so several decades at this period.
+    const int CHECKPOINT_PERIOD_HOURS = 6;
+
+    // Delay between the flash operations of a checkpoint
+    const uint32_t STEP_DELAY_MS = 5;
+
+    const uint32_t CHECKPOINT_MAGIC = 0x54484953; // "THIS"
+
+    // Content of the sector. The rings are stored as is, including their head.
+    struct Checkpoint
+    {
+        uint32_t crc; // Of the bytes after it
+        uint32_t magic;
+        int32_t lastSampleTime;
+        int32_t hourSum;
+        int32_t hourSamples;
+        int16_t minuteOldest, minuteNewest;
+        uint16_t minuteHead, minuteCount;
+        int16_t hourOldest, hourNewest;
+        uint16_t hourHead, hourCount;
+        int8_t minuteDeltas[TemperatureHistory::MINUTE_COUNT];
+        int8_t hourDeltas[TemperatureHistory::HOUR_COUNT];
+    };
+
+    const int CHECKPOINT_PAGES = (sizeof(Checkpoint) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    static_assert(CHECKPOINT_PAGES * FLASH_PAGE_SIZE <= FLASH_SECTOR_SIZE, "Must fit in a sector");
+
+    // Copy of the history being written, so that samples added meanwhile do not mix in.
+    alignas(Checkpoint) uint8_t g_checkpoint[CHECKPOINT_PAGES * FLASH_PAGE_SIZE];
+
+    uint32_t checkpointCrc(const Checkpoint &checkpoint)
+    {
+        auto bytes = reinterpret_cast<const uint8_t *>(&checkpoint);
+        return Crc32::compute(bytes + sizeof(checkpoint.crc), sizeof(checkpoint) - sizeof(checkpoint.crc));
+    }
+#endif
+}
+
+template <int capacity>
+void TemperatureHistory::DeltaRing<capacity>::push(int16_t value)
+{
+    if (count == 0)
+    {
+        oldest = newest = value;
+        count = 1;
+        return;
+    }
+
+    if (count == capacity)
+    {
+        // Drop the oldest value, the next one becomes the reference.
+        head = (head + 1) % capacity;
+        oldest += deltas[head];
+        count--;
+    }
+
+    int delta = std::max<int>(INT8_MIN, std::min<int>(value - newest, INT8_MAX));
+    deltas[(head + count) % capacity] = delta;
+    newest += delta;
+    count++;
+}
+
+template <int capacity>
+template <typename Function>
+void TemperatureHistory::DeltaRing<capacity>::forEach(Function function) const
+{
+    int16_t value = oldest;
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+            value += deltas[(head + i) % capacity];
+        function(i, value);
+    }
+}
+
+TemperatureHistory::TemperatureHistory()
+{
+#ifdef TEMPERATURE_HISTORY_IN_FLASH
+    restore();
+#endif
+}
+
+void TemperatureHistory::addMinuteSample(time_t time, int16_t quarterDegrees)
+{
+    bool hoursChanged = false;
+    if (m_lastSampleTime != -1 && std::abs(time - m_lastSampleTime) > MAX_GAP_SEC)
+    {
+        TRACE << "Temperature history obsolete";
+        m_minutes.count = 0;
+        m_hours.count = 0;
+        m_hourSum = 0;
+        m_hourSamples = 0;
+        hoursChanged = true;
+    } else if (m_lastSampleTime != -1 && time / 3600 != m_lastSampleTime / 3600 && m_hourSamples > 0)
+    {
+        // The hour of the previous samples is complete.
+        int32_t halfCount = m_hourSamples / 2;
+        m_hours.push((m_hourSum + (m_hourSum >= 0 ? halfCount : -halfCount)) / m_hourSamples);
+        m_hourSum = 0;
+        m_hourSamples = 0;
+        hoursChanged = true;
+
+#ifdef TEMPERATURE_HISTORY_IN_FLASH
+        if (++m_hoursSinceCheckpoint >= CHECKPOINT_PERIOD_HOURS)
+            startCheckpoint();
+#endif
+    }
+
+    m_minutes.push(quarterDegrees);
+    m_hourSum += quarterDegrees;
+    m_hourSamples++;
+    m_lastSampleTime = time;
+    updateSummaries(hoursChanged);
+}
+
+bool TemperatureHistory::summary(Range range, Summary &summary) const
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    summary = m_summaries[range];
+    restore_interrupts(interrupts);
+    return summary.columnCount > 0;
+}
+
+// Called from interrupt context, once per minute. The day takes 1440 samples, the month is only
+// averaged again when an hour is added.
+void TemperatureHistory::updateSummaries(bool hoursChanged)
+{
+    Summary day;
+    summarize(m_minutes, day);
+    Summary month = m_summaries[Month];
+    if (hoursChanged)
+        summarize(m_hours, month);
+    day.sequence = month.sequence = m_sequence + 1;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    m_summaries[Day] = day;
+    m_summaries[Month] = month;
+    m_sequence = day.sequence;
+    restore_interrupts(interrupts);
+}
+
+template <int capacity>
+void TemperatureHistory::summarize(const DeltaRing<capacity> &ring, Summary &summary)
+{
+    int count = ring.count;
+    summary.columnCount = count < COLUMN_COUNT ? count : COLUMN_COUNT;
+    if (summary.columnCount == 0)
+        return;
+
+    int32_t sums[COLUMN_COUNT] = {};
+    int samples[COLUMN_COUNT] = {};
+    summary.min = INT16_MAX;
+    summary.max = INT16_MIN;
+    ring.forEach([&](int i, int16_t value)
+    {
+        int column = static_cast<int64_t>(i) * summary.columnCount / count;
+        sums[column] += value;
+        samples[column]++;
+        summary.min = std::min(summary.min, value);
+        summary.max = std::max(summary.max, value);
+    });
+
+    for (int column = 0; column < summary.columnCount; column++)
+        summary.columns[column] = sums[column] / samples[column];
+}
+
+#ifdef TEMPERATURE_HISTORY_IN_FLASH
+void TemperatureHistory::restore()
+{
+    auto &checkpoint = *reinterpret_cast<const Checkpoint *>(
+        FlashLayout::content(FlashLayout::TEMPERATURE_HISTORY_OFFSET));
+    if (checkpoint.magic != CHECKPOINT_MAGIC || checkpoint.crc != checkpointCrc(checkpoint) ||
+        checkpoint.minuteHead >= MINUTE_COUNT || checkpoint.minuteCount > MINUTE_COUNT ||
+        checkpoint.hourHead >= HOUR_COUNT || checkpoint.hourCount > HOUR_COUNT)
+    {
+        TRACE << "No temperature history in flash";
+        return;
+    }
+
+    m_lastSampleTime = checkpoint.lastSampleTime;
+    m_hourSum = checkpoint.hourSum;
+    m_hourSamples = checkpoint.hourSamples;
+    m_minutes.oldest = checkpoint.minuteOldest;
+    m_minutes.newest = checkpoint.minuteNewest;
+    m_minutes.head = checkpoint.minuteHead;
+    m_minutes.count = checkpoint.minuteCount;
+    memcpy(m_minutes.deltas, checkpoint.minuteDeltas, sizeof(m_minutes.deltas));
+    m_hours.oldest = checkpoint.hourOldest;
+    m_hours.newest = checkpoint.hourNewest;
+    m_hours.head = checkpoint.hourHead;
+    m_hours.count = checkpoint.hourCount;
+    memcpy(m_hours.deltas, checkpoint.hourDeltas, sizeof(m_hours.deltas));
+    updateSummaries(true);
+    TRACE << "Temperature history restored," << m_minutes.count << "minutes," << m_hours.count << "hours";
+}
+
+// Called from interrupt context
+void TemperatureHistory::startCheckpoint()
+{
+    if (m_checkpointStep != -1)
+        return; // Next time
+
+    m_hoursSinceCheckpoint = 0;
+    memset(g_checkpoint, 0xFF, sizeof(g_checkpoint));
+    auto &checkpoint = *reinterpret_cast<Checkpoint *>(g_checkpoint);
+    checkpoint.magic = CHECKPOINT_MAGIC;
+    checkpoint.lastSampleTime = m_lastSampleTime;
+    checkpoint.hourSum = m_hourSum;
+    checkpoint.hourSamples = m_hourSamples;
+    checkpoint.minuteOldest = m_minutes.oldest;
+    checkpoint.minuteNewest = m_minutes.newest;
+    checkpoint.minuteHead = m_minutes.head;
+    checkpoint.minuteCount = m_minutes.count;
+    memcpy(checkpoint.minuteDeltas, m_minutes.deltas, sizeof(m_minutes.deltas));
+    checkpoint.hourOldest = m_hours.oldest;
+    checkpoint.hourNewest = m_hours.newest;
+    checkpoint.hourHead = m_hours.head;
+    checkpoint.hourCount = m_hours.count;
+    memcpy(checkpoint.hourDeltas, m_hours.deltas, sizeof(m_hours.deltas));
+    checkpoint.crc = checkpointCrc(checkpoint);
+
+    m_checkpointStep = 0;
+    MAKE_TRAMPOLINE(TemperatureHistory, checkpointStep, userPtrAtEnd);
+    if (TimerWheel::addInMs(0, checkpointStep, this) == -1)
+        m_checkpointStep = -1;
+}
+
+// One flash operation per call, with interrupts disabled as code running from flash cannot
+// execute meanwhile. The frames missed during the erase are caught up by ClockUi.
+int64_t TemperatureHistory::checkpointStep(TimerWheel::TimerId id)
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (m_checkpointStep == 0)
+        flash_range_erase(FlashLayout::TEMPERATURE_HISTORY_OFFSET, FLASH_SECTOR_SIZE);
+    else
+    {
+        size_t offset = (m_checkpointStep - 1) * FLASH_PAGE_SIZE;
+        flash_range_program(
+            FlashLayout::TEMPERATURE_HISTORY_OFFSET + offset, g_checkpoint + offset, FLASH_PAGE_SIZE);
+    }
+    restore_interrupts(interrupts);
+
+    if (m_checkpointStep++ < CHECKPOINT_PAGES)
+        return STEP_DELAY_MS * 1000;
+
+    TRACE << "Temperature history checkpoint written";
+    m_checkpointStep = -1;
+    return 0;
+}
+#endif
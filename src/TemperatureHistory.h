@@ -0,0 +1,97 @@
+#pragma once
+
+#include "PicoClockHw/TimerWheel.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <time.h>
+
+// Temperature recorded once per minute over the last 24 hours and once per hour, as average of
+// the minutes, over the last 30 days. The samples are stored as differences to the previous one,
+// on one byte each. Samples are added from interrupt context, which also averages both series into
+// columns, once per minute for the day and once per hour for the month. Drawing them from the frame
+// interrupt then only copies a summary.
+//
+// With TEMPERATURE_HISTORY_IN_FLASH, both series are written to a flash sector every few hours
+// and restored at startup.
+class TemperatureHistory
+{
+public:
+    enum Range
+    {
+        Day, // Minute samples
+        Month, // Hour samples
+    };
+
+    static const int MINUTE_COUNT = 24 * 60;
+    static const int HOUR_COUNT = 30 * 24;
+    static const int COLUMN_COUNT = 19; // Width of the sparkline of TemperatureTrend
+
+    // Samples of a range averaged into columns, the newest at the end. Values are in 0.25°C.
+    struct Summary
+    {
+        int columnCount; // Less than COLUMN_COUNT if there are fewer samples
+        int16_t columns[COLUMN_COUNT];
+        int16_t min;
+        int16_t max;
+        uint32_t sequence; // Changes when samples are added
+    };
+
+    TemperatureHistory();
+
+    // Sample of the given minute, in 0.25°C, called from interrupt context. Minutes without
+    // sample are skipped.
+    void addMinuteSample(time_t time, int16_t quarterDegrees);
+
+    // Copy of the summary computed when the last sample was added, with interrupts disabled for
+    // the copy only. Return false if the range has no sample.
+    bool summary(Range range, Summary &summary) const;
+
+    uint32_t sequence() const
+    {
+        return m_sequence;
+    }
+
+private:
+    // Ring of values stored as deltas. The oldest value and the newest one are kept as is, the
+    // first to decode the ring, the second to encode the next delta. Deltas larger than a byte
+    // are clamped and the newest value follows the decoded one, so that errors do not accumulate.
+    template <int capacity>
+    struct DeltaRing
+    {
+        int8_t deltas[capacity]; // deltas[head] belongs to the oldest value and is unused
+        int16_t oldest = 0;
+        int16_t newest = 0;
+        uint16_t head = 0;
+        uint16_t count = 0;
+
+        void push(int16_t value);
+
+        template <typename Function>
+        void forEach(Function function) const;
+    };
+
+    template <int capacity>
+    static void summarize(const DeltaRing<capacity> &ring, Summary &summary);
+
+    void updateSummaries(bool hoursChanged);
+
+#ifdef TEMPERATURE_HISTORY_IN_FLASH
+    void restore();
+    void startCheckpoint();
+    int64_t checkpointStep(TimerWheel::TimerId id);
+#endif
+
+    DeltaRing<MINUTE_COUNT> m_minutes;
+    DeltaRing<HOUR_COUNT> m_hours;
+    time_t m_lastSampleTime = -1;
+    int32_t m_hourSum = 0; // Of the minute samples of the current hour
+    int m_hourSamples = 0;
+    Summary m_summaries[2] = {}; // By range
+    volatile uint32_t m_sequence = 0;
+
+#ifdef TEMPERATURE_HISTORY_IN_FLASH
+    int m_hoursSinceCheckpoint = 0;
+    int m_checkpointStep = -1; // 0 for the erase, then the pages, -1 if no checkpoint is running
+#endif
+};
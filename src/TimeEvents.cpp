@@ -0,0 +1,126 @@
+#include "TimeEvents.h"
+#include "Utils/Trace.h"
+#include "PicoClockHw/Platform.h"
+
+#include <algorithm>
+
+namespace
+{
+    // The hardware timer and the clock are driven by the same crystal, but the clock only counts
+    // the second when the frame callback comes. If the alarm fires just before that, check again 
+    // after this delay.
+    const uint64_t RETRY_DELAY_US = 1000;
+
+    // A deadline that the clock stepped over when it was adjusted, e.g. by a sync or a DST change,
+    // still fires if it passed by at most this long. Longer steps, e.g. when the time is set for
+    // the first time, skip the deadlines.
+    const time_t MAX_CATCH_UP_SEC = 2 * 60 * 60;
+}
+
+TimeEvents::TimeEvents(std::function<time_t()> now) : m_now(now)
+{
+}
+
+int TimeEvents::add(NextDeadline nextDeadline, Callback callback)
+{
+    if (m_eventCount >= MAX_EVENTS)
+    {
+        TRACE << "No free event slot";
+        return -1;
+    }
+
+    Event &event = m_events[m_eventCount];
+    event.nextDeadline = nextDeadline;
+    event.callback = callback;
+    event.deadline = NO_DEADLINE;
+
+    return m_eventCount++;
+}
+
+void TimeEvents::update(int id)
+{
+    Event &event = m_events[id];
+    event.deadline = event.nextDeadline(m_now());
+    arm();
+}
+
+void TimeEvents::setReference(time_t now, uint64_t secondStartUs)
+{
+    m_referenceTime = now;
+    m_referenceUs = secondStartUs;
+    m_hasReference = true;
+
+    for (int i = 0; i < m_eventCount; i++)
+    {
+        Event &event = m_events[i];
+
+        // A deadline not reached yet is kept if the clock reached or stepped over it, so that it
+        // fires now. The next deadline is strictly after now, which would skip it.
+        if (event.deadline != NO_DEADLINE && event.deadline <= now && 
+            now - event.deadline <= MAX_CATCH_UP_SEC)
+            continue;
+
+        event.deadline = event.nextDeadline(now);
+
+        // If the clock stepped back before the last deadline reached, e.g. when DST ends, it is 
+        // not reached a second time.
+        if (event.deadline != NO_DEADLINE && event.deadline == event.lastReached)
+            event.deadline = event.nextDeadline(event.deadline);
+    }
+
+    arm();
+}
+
+void RAM_FUNC(TimeEvents::arm)(uint64_t notBeforeUs)
+{
+    if (!m_hasReference)
+        return;
+
+    time_t earliest = NO_DEADLINE;
+    for (int i = 0; i < m_eventCount; i++)
+    {
+        time_t deadline = m_events[i].deadline;
+        if (deadline != NO_DEADLINE && (earliest == NO_DEADLINE || deadline < earliest))
+            earliest = deadline;
+    }
+
+    if (earliest == NO_DEADLINE)
+    {
+        m_alarm.cancel();
+        return;
+    }
+
+    // Convert the deadline to a hardware timer target. Deadlines in the past fire as soon as 
+    // possible.
+    int64_t targetUs = 
+        static_cast<int64_t>(m_referenceUs) + static_cast<int64_t>(earliest - m_referenceTime) * 1000000;
+    if (targetUs < static_cast<int64_t>(notBeforeUs))
+        targetUs = notBeforeUs;
+    m_alarm.setTarget(std::max<int64_t>(targetUs, 0));
+}
+
+void RAM_FUNC(TimeEvents::onAlarm)()
+{
+    time_t now = m_now();
+
+    bool anyReached = false;
+    for (int i = 0; i < m_eventCount; i++)
+    {
+        Event &event = m_events[i];
+        if (event.deadline == NO_DEADLINE || event.deadline > now)
+            continue;
+
+        anyReached = true;
+        time_t reached = event.deadline;
+        event.lastReached = reached;
+
+        // Compute the next deadline before calling back, as the callback may update the event.
+        event.deadline = event.nextDeadline(reached);
+        event.callback(reached);
+    }
+
+    if (anyReached)
+        arm();
+    else
+        arm(Platform::timeUs() + RETRY_DELAY_US);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "PicoClockHw/HardwareAlarm.h"
+
+#include <functional>
+#include <time.h>
+
+// Service in which components register events at absolute wall-clock deadlines (e.g. the next 
+// alarm or the next full hour). A single hardware alarm is armed for the earliest deadline, so 
+// that nothing needs to be evaluated on every second in the frame callback.
+//
+// Deadlines are expressed in the same base as the time returned by the "now" function passed to 
+// the constructor. Callbacks are called from interrupt context.
+class TimeEvents
+{
+public:
+    static const time_t NO_DEADLINE = -1;
+    static const int MAX_EVENTS = 8;
+
+    // Return the next deadline strictly after the given time, or NO_DEADLINE if the event is 
+    // currently not needed.
+    using NextDeadline = std::function<time_t(time_t now)>;
+    
+    // Called with the deadline that was reached
+    using Callback = std::function<void(time_t deadline)>;
+
+    TimeEvents(std::function<time_t()> now);
+
+    // Register an event and return its id, or -1 if all slots are used. The event is scheduled
+    // only after calling update() or setReference().
+    int add(NextDeadline nextDeadline, Callback callback);
+
+    // Recompute the deadline of the given event, e.g. because its parameters have changed.
+    void update(int id);
+
+    time_t deadline(int id) const
+    {
+        return m_events[id].deadline;
+    }
+
+    // Give the time of the last second change in microseconds as returned by Platform::timeUs(),
+    // which allows converting deadlines to hardware timer targets. To be called whenever the clock
+    // was adjusted. As the clock may have jumped, the deadlines are recomputed, except the ones
+    // that it just reached or stepped over without firing them, which fire immediately.
+    void setReference(time_t now, uint64_t secondStartUs);
+
+private:
+    struct Event
+    {
+        NextDeadline nextDeadline;
+        Callback callback;
+        time_t deadline = NO_DEADLINE;
+        time_t lastReached = NO_DEADLINE;
+    };
+
+    void arm(uint64_t notBeforeUs = 0);
+    void onAlarm();
+
+    std::function<time_t()> m_now;
+    Event m_events[MAX_EVENTS];
+    int m_eventCount = 0;
+    bool m_hasReference = false;
+    time_t m_referenceTime = 0;
+    uint64_t m_referenceUs = 0;
+    HardwareAlarm m_alarm{std::bind(&TimeEvents::onAlarm, this)};
+};
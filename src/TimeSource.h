@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <time.h>
+
+// Provider of the time the clock is synchronized from, e.g. the RTC or NTP. The clock asks the
+// best available source for a sample and falls back to the next one if it fails.
+class TimeSource
+{
+public:
+    struct Sample
+    {
+        time_t time = 0; // Local, not considering DST, as the clock keeps it
+        uint32_t us = 0; // Within that second
+        uint64_t timeUs = 0; // When the sample was valid, as returned by Platform::timeUs()
+    };
+
+    // Called from interrupt context. The sample is only valid if ok.
+    using SampleCallback = std::function<void(bool ok, const Sample &sample)>;
+
+    virtual ~TimeSource() = default;
+
+    virtual const char *name() const = 0;
+
+    // Distance to a reference clock as for NTP, lower being better
+    virtual int stratum() const = 0;
+
+    // Expected error of a sample, deciding between sources of the same stratum
+    virtual uint32_t precisionUs() const = 0;
+
+    virtual bool isAvailable() const = 0;
+
+    // Return false if the request could not be started, e.g. one is already pending, the
+    // callback is not called then. Otherwise it is called exactly once.
+    virtual bool requestSample(SampleCallback callback) = 0;
+
+    bool isBetterThan(const TimeSource &other) const
+    {
+        if (stratum() != other.stratum())
+            return stratum() < other.stratum();
+        return precisionUs() < other.precisionUs();
+    }
+};
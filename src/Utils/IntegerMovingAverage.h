@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "CyclicCounter.h"
+
+// Moving average of integer samples, filled by a single writer, e.g. an interrupt, and read
+// without locking. The sum is exact, so it does not accumulate rounding errors, and it is published
+// as one 32-bit word, which is read and written atomically on the RP2040.
+template <size_t size>
+class IntegerMovingAverage
+{
+public:
+    // The first sample fills the whole buffer, so that the average is right from the start.
+    void put(int16_t value)
+    {
+        int32_t sum;
+        if (!m_hasValue)
+        {
+            for (size_t i = 0; i < size; i++)
+                m_ringBuffer[i] = value;
+            sum = static_cast<int32_t>(value) * size;
+        } else
+        {
+            // Update the sum and exchange values in the ring buffer
+            sum = m_sum - m_ringBuffer[m_pos] + value;
+            m_ringBuffer[m_pos] = value;
+            m_pos.increment();
+        }
+
+        m_sum = sum;
+        m_hasValue = true;
+    }
+
+    bool hasValue() const
+    {
+        return m_hasValue;
+    }
+
+    // Sum of the last samples, the average being sum() / size. Kept as sum so that the caller
+    // can scale it before dividing.
+    int32_t sum() const
+    {
+        return m_sum;
+    }
+
+private:
+    int16_t m_ringBuffer[size];
+    CyclicCounter m_pos{size, 0};
+    volatile int32_t m_sum = 0;
+    volatile bool m_hasValue = false;
+};
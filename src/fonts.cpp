@@ -1,5 +1,8 @@
 #include "fonts.h"
 
+// The tables are intentionally not const: this way they are placed in RAM, and drawing characters on
+// every frame neither reads from flash through the XIP cache nor stalls while the flash is written.
+
 // clang-format off
 
 static ProportionalCharacter narrowFontChars[] =
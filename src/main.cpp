@@ -2,12 +2,25 @@
 #include "ClockUi.h"
 #include "Utils/Trace.h"
 
+#include "PicoClockHw/BootProfiler.h"
+#include "PicoClockHw/EventJournal.h"
 #include "PicoClockHw/Platform.h"
 #include "PicoClockHw/Wifi.h"
 
+namespace
+{
+    // The slow subsystems wait for the first correct frame at most this long, as without RTC the
+    // time is only known from NTP.
+    const uint64_t FIRST_FRAME_TIMEOUT_US = 100000;
+}
+
 int main() 
 {
+    BootProfiler::mark(BootProfiler::Main);
     Platform::initStdIo();
+    BootProfiler::mark(BootProfiler::StdIo);
+    EventJournal::init();
+    BootProfiler::mark(BootProfiler::Journal);
 
     // Can be enabled to delay startup in order to debug
 #if 0    
@@ -17,15 +30,36 @@ int main()
         std::cout << i << std::endl;
     }
 #endif
+    // First stage: the display and the last known time, from the warm restart or the RTC. From
+    // then on, the display and the clock run from interrupts.
     TRACE << "Clock UI";
     ClockUi ui;
 
+    // Second stage: the slow subsystems, once the time is shown. The temperature conversions
+    // already started in the background with the RTC. Blocking here only delays NTP, as the main
+    // loop has nothing else to do.
+    uint64_t stageStartUs = Platform::timeUs();
+    while (!BootProfiler::reached(BootProfiler::FirstCorrectFrame) && 
+           Platform::timeUs() - stageStartUs < FIRST_FRAME_TIMEOUT_US)
+        sleep_ms(1);
+
+    bool connected = false;
     if (Wifi::init())
-        if (Wifi::connectBlocking())
-            ui.startNtpRequest();
+    {
+        BootProfiler::mark(BootProfiler::WifiInit);
+        connected = Wifi::connectBlocking();
+    }
+
+    // Without network, the RTC is still synced from periodically.
+    if (connected)
+    {
+        BootProfiler::mark(BootProfiler::WifiConnected);
+        ui.startNtpRequest();
+    } else
+        ui.startSyncWithoutNetwork();
 
     TRACE <<"Start the loop\n";
-    Platform::runMainLoop();
+    Platform::runMainLoop(std::bind(&ClockUi::handleControlFromConsole, &ui));
 
     // Not reachable for the moment, but a shutdown function may be added later.
     Wifi::deinit();
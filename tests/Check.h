@@ -0,0 +1,46 @@
+#pragma once
+
+#include <iostream>
+
+// Minimal checks of the host tests. A failed check is reported with its location and makes the
+// test fail at the end, the following checks still run.
+namespace Check
+{
+    inline int &failures()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    // To be returned by main()
+    inline int result()
+    {
+        if (failures() != 0)
+            std::cerr << failures() << " check(s) failed" << std::endl;
+        return failures() == 0 ? 0 : 1;
+    }
+}
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" \
+                      << std::endl; \
+            Check::failures()++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+    do \
+    { \
+        auto actualValue = (actual); \
+        auto expectedValue = (expected); \
+        if (!(actualValue == expectedValue)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " is " << actualValue \
+                      << ", expected " << expectedValue << std::endl; \
+            Check::failures()++; \
+        } \
+    } while (0)
@@ -0,0 +1,245 @@
+#include "Check.h"
+#include "Clock.h"
+#include "SimulatedTimeSource.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+// Synchronization of the clock from simulated time sources, the host build having neither RTC nor
+// network: choice of the best source, fallback when it fails, holdover of the better source, and
+// convergence of the drift compensation.
+namespace
+{
+    const int TICKS_PER_SEC = 250; // Display::FRAME_RATE
+    const uint64_t SEC_US = 1000000;
+    const uint64_t HOUR_US = 60 * 60 * SEC_US;
+
+    SimulatedTimeSource::Config ntpConfig()
+    {
+        SimulatedTimeSource::Config config;
+        config.name = "Simulated NTP";
+        config.stratum = 3;
+        config.precisionUs = 10000;
+        return config;
+    }
+
+    // Ranked as the RTC without its 1 Hz output, so not a reference for the drift
+    SimulatedTimeSource::Config backupConfig(int64_t offsetUs)
+    {
+        SimulatedTimeSource::Config config;
+        config.name = "Simulated backup";
+        config.stratum = 8;
+        config.precisionUs = 10000;
+        config.latencyUs = 1000;
+        config.jitterUs = 100;
+        config.halfLatencyError = false;
+        config.offsetUs = offsetUs;
+        return config;
+    }
+
+    // Calls Clock::tick() as the frame interrupt, from a tick source off by the given drift
+    class TickSource
+    {
+    public:
+        TickSource(Clock &clock, double driftPpm) :
+            m_clock(clock), m_periodUs(1e6 / TICKS_PER_SEC / (1 + driftPpm * 1e-6)),
+            m_nextUs(Simulation::timeUs() + m_periodUs)
+        {}
+
+        void runFor(uint64_t us)
+        {
+            uint64_t endUs = Simulation::timeUs() + us;
+            while (m_nextUs <= endUs)
+            {
+                Simulation::runUntil(std::llround(m_nextUs));
+                bool clockAdjusted;
+                m_clock.tick(clockAdjusted);
+                m_nextUs += m_periodUs;
+            }
+            Simulation::runUntil(endUs);
+        }
+
+    private:
+        Clock &m_clock;
+        double m_periodUs;
+        double m_nextUs;
+    };
+
+    // Of the clock to the reference at the last tick, positive if ahead. The simulation starts
+    // in November, without DST.
+    int64_t offsetUs(const Clock &clock)
+    {
+        int64_t clockUs =
+            static_cast<int64_t>(clock.now()) * SEC_US +
+            static_cast<int64_t>(clock.tickCount()) * SEC_US / TICKS_PER_SEC;
+        return clockUs - SimulatedTimeSource::referenceUs(Simulation::timeUs());
+    }
+
+    // Accuracy after a sync: the NTP error of half the latency, the jitter and a tick
+    bool isSyncedTo(const Clock &clock, int64_t sourceOffsetUs)
+    {
+        return std::abs(offsetUs(clock) - sourceOffsetUs) <= 10000 + 5000 + 4000 + 1000;
+    }
+
+    void testBestSourceSelected()
+    {
+        Simulation::reset();
+        SimulatedTimeSource ntp(ntpConfig());
+        SimulatedTimeSource backup(backupConfig(300000));
+        Clock clock(TICKS_PER_SEC);
+        CHECK(!clock.hasRtc());
+        CHECK(clock.addTimeSource(&backup));
+        CHECK(clock.addTimeSource(&ntp));
+        TickSource ticks(clock, 0);
+
+        clock.startPeriodicSync();
+        ticks.runFor(SEC_US);
+        CHECK_EQUAL(ntp.requests(), 1);
+        CHECK_EQUAL(backup.requests(), 0);
+        CHECK(isSyncedTo(clock, 0));
+
+        // Unavailable sources are not asked.
+        ntp.setAvailable(false);
+        ticks.runFor(4 * HOUR_US);
+        CHECK_EQUAL(ntp.requests(), 1);
+        CHECK_EQUAL(backup.requests(), 1);
+    }
+
+    void testFallbackOnFailure()
+    {
+        Simulation::reset();
+        SimulatedTimeSource ntp(ntpConfig());
+        SimulatedTimeSource backup(backupConfig(300000));
+        Clock clock(TICKS_PER_SEC);
+        clock.addTimeSource(&ntp);
+        clock.addTimeSource(&backup);
+        TickSource ticks(clock, 0);
+
+        // Without sync before, the worse source is taken at once.
+        ntp.setFailing(true);
+        clock.startPeriodicSync();
+        ticks.runFor(SEC_US);
+        CHECK_EQUAL(ntp.requests(), 1);
+        CHECK_EQUAL(backup.requests(), 1);
+        CHECK(isSyncedTo(clock, 300000));
+
+        // A failure of the last source does not retry the others.
+        backup.setFailing(true);
+        ticks.runFor(4 * HOUR_US);
+        CHECK_EQUAL(ntp.requests(), 2);
+        CHECK_EQUAL(backup.requests(), 2);
+        CHECK_EQUAL(backup.failures(), 1);
+
+        // The better source replaces the worse one as soon as it answers.
+        ntp.setFailing(false);
+        ticks.runFor(4 * HOUR_US);
+        CHECK_EQUAL(ntp.requests(), 3);
+        CHECK_EQUAL(backup.requests(), 2);
+        CHECK(isSyncedTo(clock, 0));
+    }
+
+    void testHoldover()
+    {
+        Simulation::reset();
+        SimulatedTimeSource ntp(ntpConfig());
+        SimulatedTimeSource backup(backupConfig(2 * SEC_US));
+        Clock clock(TICKS_PER_SEC);
+        clock.addTimeSource(&ntp);
+        clock.addTimeSource(&backup);
+        TickSource ticks(clock, 0);
+
+        clock.startPeriodicSync();
+        ticks.runFor(SEC_US);
+        CHECK(isSyncedTo(clock, 0));
+
+        // The worse source is sampled on each resync, but ignored for a day after the last sync
+        // from the better one.
+        ntp.setFailing(true);
+        ticks.runFor(23 * HOUR_US);
+        CHECK_EQUAL(backup.requests(), 5);
+        CHECK(isSyncedTo(clock, 0));
+
+        // The resync at 24 h takes it.
+        ticks.runFor(2 * HOUR_US);
+        CHECK_EQUAL(backup.requests(), 6);
+        CHECK(isSyncedTo(clock, 2 * SEC_US));
+
+        // Then it is ignored again once the better source is back.
+        ntp.setFailing(false);
+        ticks.runFor(4 * HOUR_US);
+        CHECK(isSyncedTo(clock, 0));
+        CHECK_EQUAL(backup.requests(), 6);
+    }
+
+    // Without NTP, as on the host, the other sources are still synced from periodically. A later
+    // start only syncs at once, without a second period.
+    void testPeriodicSyncWithoutNtp()
+    {
+        Simulation::reset();
+        SimulatedTimeSource backup(backupConfig(0));
+        Clock clock(TICKS_PER_SEC);
+        clock.addTimeSource(&backup);
+        TickSource ticks(clock, 0);
+
+        clock.startSyncFromNtp();
+        ticks.runFor(SEC_US);
+        CHECK_EQUAL(backup.requests(), 1);
+
+        clock.startPeriodicSync();
+        ticks.runFor(SEC_US);
+        CHECK_EQUAL(backup.requests(), 2);
+        ticks.runFor(4 * HOUR_US);
+        CHECK_EQUAL(backup.requests(), 3);
+    }
+
+    // Maximum offset of the clock per day, with a tick source as off as a poor crystal and NTP
+    // failing now and then. The drift is measured from the second sync, then only the error of
+    // NTP and the rest of the drift over the resync period remain.
+    void benchmarkConvergence(double driftPpm)
+    {
+        const int DAYS = 3;
+        Simulation::reset();
+        SimulatedTimeSource::Config config = ntpConfig();
+        config.failureRate = 0.1;
+        SimulatedTimeSource ntp(config, 7);
+        Clock clock(TICKS_PER_SEC);
+        clock.addTimeSource(&ntp);
+        TickSource ticks(clock, driftPpm);
+
+        clock.startPeriodicSync();
+        ticks.runFor(SEC_US);
+        int64_t maxOffsetUs[DAYS] = {};
+        for (int minute = 0; minute < DAYS * 24 * 60; minute++)
+        {
+            ticks.runFor(60 * SEC_US);
+            int64_t &max = maxOffsetUs[minute / (24 * 60)];
+            max = std::max(max, std::abs(offsetUs(clock)));
+        }
+
+        std::cout << "Drift " << std::setw(6) << driftPpm << " ppm, max offset per day (ms):";
+        for (int day = 0; day < DAYS; day++)
+            std::cout << " " << maxOffsetUs[day] / 1000;
+        std::cout << ", NTP failed " << ntp.failures() << "/" << ntp.requests() << std::endl;
+
+        // Without compensation, the offset would reach the drift over the resync period.
+        if (std::fabs(driftPpm) >= 10)
+            CHECK(maxOffsetUs[0] > std::fabs(driftPpm) * 4 * 60 * 60 / 2);
+        CHECK(maxOffsetUs[DAYS - 1] <= 30000);
+    }
+}
+
+int main()
+{
+    testBestSourceSelected();
+    testFallbackOnFailure();
+    testHoldover();
+    testPeriodicSyncWithoutNtp();
+    benchmarkConvergence(50);
+    benchmarkConvergence(-120);
+    return Check::result();
+}
@@ -0,0 +1,78 @@
+#include "Check.h"
+#include "PicoClockHw/Crc32.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+// CRC-32 by software and by the simulated DMA sniffer, which is used from 16 bytes on: standard
+// check values, agreement of both, and CRCs continued over several calls.
+namespace
+{
+    const uint8_t *bytes(const char *text)
+    {
+        return reinterpret_cast<const uint8_t *>(text);
+    }
+
+    void testCheckValues()
+    {
+        const char *check = "123456789";
+        CHECK_EQUAL(Crc32::computeBySoftware(bytes(check), strlen(check)), 0xCBF43926u);
+        CHECK_EQUAL(Crc32::compute(bytes(check), strlen(check)), 0xCBF43926u);
+
+        const char *fox = "The quick brown fox jumps over the lazy dog";
+        CHECK_EQUAL(Crc32::computeBySoftware(bytes(fox), strlen(fox)), 0x414FA339u);
+        CHECK_EQUAL(Crc32::compute(bytes(fox), strlen(fox)), 0x414FA339u);
+
+        CHECK_EQUAL(Crc32::compute(nullptr, 0), 0u);
+        CHECK_EQUAL(Crc32::compute(nullptr, 0, 0x12345678), 0x12345678u);
+    }
+
+    void testSoftwareAndDmaAgree()
+    {
+        std::mt19937 random(7);
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::vector<uint8_t> data(1000);
+        for (uint8_t &value : data)
+            value = byte(random);
+
+        for (size_t size = 0; size <= data.size(); size += size < 64 ? 1 : 37)
+        {
+            CHECK_EQUAL(Crc32::compute(data.data(), size),
+                        Crc32::computeBySoftware(data.data(), size));
+        }
+    }
+
+    // Split at every position, each part taking either implementation
+    void testChainedCalls()
+    {
+        std::vector<uint8_t> data(100);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = i * 7 + 3;
+
+        uint32_t whole = Crc32::computeBySoftware(data.data(), data.size());
+        CHECK_EQUAL(Crc32::compute(data.data(), data.size()), whole);
+        for (size_t split = 0; split <= data.size(); split++)
+        {
+            size_t rest = data.size() - split;
+            uint32_t first = Crc32::compute(data.data(), split);
+            CHECK_EQUAL(Crc32::compute(data.data() + split, rest, first), whole);
+            first = Crc32::computeBySoftware(data.data(), split);
+            CHECK_EQUAL(Crc32::computeBySoftware(data.data() + split, rest, first), whole);
+        }
+
+        // Byte by byte
+        uint32_t crc = 0;
+        for (uint8_t value : data)
+            crc = Crc32::compute(&value, 1, crc);
+        CHECK_EQUAL(crc, whole);
+    }
+}
+
+int main()
+{
+    testCheckValues();
+    testSoftwareAndDmaAgree();
+    testChainedCalls();
+    return Check::result();
+}
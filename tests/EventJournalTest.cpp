@@ -0,0 +1,60 @@
+#include "Check.h"
+#include "FlashSimulator.h"
+#include "Simulation.h"
+#include "PicoClockHw/EventJournal.h"
+
+#include <vector>
+
+// Dump of the journal from the main loop while the interrupts keep logging and flushing records.
+namespace
+{
+    std::vector<uint32_t> dumpSequences(bool logDuringDump)
+    {
+        std::vector<uint32_t> sequences;
+        EventJournal::forEach([&](const EventJournal::Record &record)
+        {
+            sequences.push_back(record.sequence);
+
+            // Printing a record takes long enough for the timers to fire meanwhile.
+            if (logDuringDump)
+                EventJournal::log(EventJournal::TimeSet, 0, record.sequence);
+            Simulation::runFor(2000);
+        });
+        return sequences;
+    }
+
+    void testDumpDuringFlushes()
+    {
+        FlashSimulator::reset();
+        Simulation::reset();
+        EventJournal::init();
+
+        // Some records in flash, some staged
+        for (int i = 0; i < 100; i++)
+        {
+            EventJournal::log(EventJournal::NtpSync, 0, i);
+            Simulation::runFor(10000);
+        }
+        for (int i = 0; i < 10; i++)
+            EventJournal::log(EventJournal::NtpSync, 0, i);
+        CHECK(EventJournal::stats().staged > 0);
+        CHECK_EQUAL(EventJournal::stats().dropped, 0u);
+
+        std::vector<uint32_t> sequences = dumpSequences(true);
+        CHECK_EQUAL(sequences.size(), 110u);
+        for (size_t i = 0; i < sequences.size(); i++)
+            CHECK_EQUAL(sequences[i], uint32_t(i));
+
+        // The records logged during the dump are all there afterwards.
+        Simulation::runFor(120 * 1000000ull);
+        CHECK_EQUAL(EventJournal::stats().staged, 0u);
+        CHECK_EQUAL(EventJournal::stats().dropped, 0u);
+        CHECK_EQUAL(dumpSequences(false).size(), 220u);
+    }
+}
+
+int main()
+{
+    testDumpDuringFlushes();
+    return Check::result();
+}
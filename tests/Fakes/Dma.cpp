@@ -0,0 +1,100 @@
+#include <hardware/dma.h>
+
+// The sniffer of the RP2040 in its CRC32R mode: the CRC-32 polynomial applied MSB first to the
+// bit-reversed bytes, the reversal and inversion being only applied when the accumulator is read.
+namespace
+{
+    const uint32_t POLYNOMIAL = 0x04C11DB7;
+
+    struct Sniffer
+    {
+        int channel = -1; // -1 if disabled
+        unsigned int mode = 0;
+        bool reverseOutput = false;
+        bool invertOutput = false;
+        uint32_t accumulator = 0;
+    };
+    Sniffer g_sniffer;
+    bool g_claimed = false;
+
+    uint8_t reverseByte(uint8_t value)
+    {
+        uint8_t result = 0;
+        for (int i = 0; i < 8; i++)
+            result = (result << 1) | ((value >> i) & 1);
+        return result;
+    }
+
+    void sniff(uint8_t data)
+    {
+        g_sniffer.accumulator ^= uint32_t(reverseByte(data)) << 24;
+        for (int i = 0; i < 8; i++)
+        {
+            bool msb = g_sniffer.accumulator & 0x80000000;
+            g_sniffer.accumulator = (g_sniffer.accumulator << 1) ^ (msb ? POLYNOMIAL : 0);
+        }
+    }
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    if (g_claimed)
+        return -1;
+
+    g_claimed = true;
+    return 0;
+}
+
+void dma_channel_configure(
+    unsigned int channel, const dma_channel_config *config, volatile void *write_addr,
+    const volatile void *read_addr, unsigned int transfer_count, bool trigger)
+{
+    // Only what Crc32 uses: bytes read in sequence for the sniffer
+    if (!trigger || !config->sniff || g_sniffer.channel != int(channel) ||
+        g_sniffer.mode != DMA_SNIFF_CTRL_CALC_VALUE_CRC32R || config->size != DMA_SIZE_8 ||
+        !config->readIncrement)
+        return;
+
+    auto data = static_cast<const volatile uint8_t *>(read_addr);
+    for (unsigned int i = 0; i < transfer_count; i++)
+        sniff(data[i]);
+}
+
+void dma_sniffer_enable(unsigned int channel, unsigned int mode, bool force)
+{
+    g_sniffer.channel = channel;
+    g_sniffer.mode = mode;
+}
+
+void dma_sniffer_disable()
+{
+    g_sniffer = Sniffer();
+}
+
+void dma_sniffer_set_output_reverse_enabled(bool enable)
+{
+    g_sniffer.reverseOutput = enable;
+}
+
+void dma_sniffer_set_output_invert_enabled(bool enable)
+{
+    g_sniffer.invertOutput = enable;
+}
+
+void dma_sniffer_set_data_accumulator(uint32_t seed_value)
+{
+    g_sniffer.accumulator = seed_value;
+}
+
+uint32_t dma_sniffer_get_data_accumulator()
+{
+    uint32_t value = g_sniffer.accumulator;
+    if (g_sniffer.reverseOutput)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < 32; i++)
+            reversed = (reversed << 1) | ((value >> i) & 1);
+        value = reversed;
+    }
+    return g_sniffer.invertOutput ? ~value : value;
+}
@@ -0,0 +1,134 @@
+#include "FlashSimulator.h"
+#include "Simulation.h"
+
+#include <hardware/flash.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const uint32_t SECTOR_COUNT = PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE;
+
+    struct Memory
+    {
+        Memory()
+            : content(PICO_FLASH_SIZE_BYTES, 0xFF), erases(SECTOR_COUNT), programs(SECTOR_COUNT)
+        {
+        }
+
+        std::vector<uint8_t> content;
+        std::vector<uint32_t> erases;
+        std::vector<uint32_t> programs;
+        uint32_t violations = 0;
+        uint64_t bytesUntilPowerLoss = UINT64_MAX;
+        bool powerLost = false;
+    };
+
+    // Built on first use, as the layout of the flash is used by static initializers.
+    Memory &memory()
+    {
+        static Memory memory;
+        return memory;
+    }
+
+    bool isValidRange(uint32_t offset, size_t count, uint32_t alignment)
+    {
+        if (offset % alignment == 0 && count % alignment == 0 &&
+            offset + count <= PICO_FLASH_SIZE_BYTES)
+            return true;
+
+        memory().violations++;
+        return false;
+    }
+
+    // Return how many of the bytes of an operation are done before the power is lost.
+    size_t bytesBeforePowerLoss(size_t count)
+    {
+        if (memory().powerLost)
+            return 0;
+        if (memory().bytesUntilPowerLoss == UINT64_MAX)
+            return count;
+
+        size_t done = std::min<uint64_t>(count, memory().bytesUntilPowerLoss);
+        memory().bytesUntilPowerLoss -= done;
+        memory().powerLost = memory().bytesUntilPowerLoss == 0;
+        return done;
+    }
+}
+
+void FlashSimulator::reset()
+{
+    memory() = Memory();
+}
+
+uintptr_t FlashSimulator::base()
+{
+    return reinterpret_cast<uintptr_t>(memory().content.data());
+}
+
+uint32_t FlashSimulator::eraseCount(uint32_t offset)
+{
+    return memory().erases[offset / FLASH_SECTOR_SIZE];
+}
+
+uint32_t FlashSimulator::programCount(uint32_t offset)
+{
+    return memory().programs[offset / FLASH_SECTOR_SIZE];
+}
+
+uint32_t FlashSimulator::violations()
+{
+    return memory().violations;
+}
+
+void FlashSimulator::losePowerAfter(uint64_t bytes)
+{
+    memory().bytesUntilPowerLoss = bytes;
+    memory().powerLost = bytes == 0;
+}
+
+bool FlashSimulator::isPowerLost()
+{
+    return memory().powerLost;
+}
+
+void FlashSimulator::restorePower()
+{
+    memory().bytesUntilPowerLoss = UINT64_MAX;
+    memory().powerLost = false;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (!isValidRange(flash_offs, count, FLASH_SECTOR_SIZE))
+        return;
+
+    size_t done = bytesBeforePowerLoss(count);
+    memset(memory().content.data() + flash_offs, 0xFF, done);
+    for (uint32_t offset = flash_offs; offset < flash_offs + done; offset += FLASH_SECTOR_SIZE)
+    {
+        memory().erases[offset / FLASH_SECTOR_SIZE]++;
+        Simulation::stall(FlashSimulator::ERASE_US);
+    }
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if (!isValidRange(flash_offs, count, FLASH_PAGE_SIZE))
+        return;
+
+    size_t done = bytesBeforePowerLoss(count);
+    uint8_t *content = memory().content.data() + flash_offs;
+    for (size_t i = 0; i < done; i++)
+    {
+        if ((data[i] & ~content[i]) != 0)
+            memory().violations++;
+        content[i] &= data[i];
+    }
+    for (uint32_t offset = flash_offs; offset < flash_offs + done; offset += FLASH_PAGE_SIZE)
+    {
+        memory().programs[offset / FLASH_SECTOR_SIZE]++;
+        Simulation::stall(FlashSimulator::PROGRAM_US);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Flash memory of the host build, mapped at XIP_BASE by the replacement of hardware/flash.h.
+// Erases and programs are checked as on the RP2040: they must be aligned, and programming only
+// clears bits. They are counted per sector to estimate the wear, and they stall the simulated time
+// as long as they keep the interrupts disabled on the device. A power loss can be injected in the
+// middle of an operation.
+class FlashSimulator
+{
+public:
+    // Typical durations of the W25Q16JV of the Pico
+    static const uint64_t ERASE_US = 45000;
+    static const uint64_t PROGRAM_US = 400;
+
+    // Erase the whole memory and clear the counters.
+    static void reset();
+
+    static uintptr_t base();
+
+    // Of the sector containing the given offset
+    static uint32_t eraseCount(uint32_t offset);
+    static uint32_t programCount(uint32_t offset);
+
+    // Misaligned operations and programs of bits that were not erased
+    static uint32_t violations();
+
+    // Lose the power once the given number of bytes were erased or programmed, in the middle of an
+    // operation if it comes to that: its bytes are done in order, and the following ones keep
+    // their previous content. Later operations are ignored until the power is restored, as when
+    // the program restarts.
+    static void losePowerAfter(uint64_t bytes);
+    static bool isPowerLost();
+    static void restorePower();
+};
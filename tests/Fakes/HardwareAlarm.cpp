@@ -0,0 +1,32 @@
+#include "PicoClockHw/HardwareAlarm.h"
+#include "Simulation.h"
+
+// The alarm number is not needed, the simulation handle of the target is kept in its place.
+HardwareAlarm *HardwareAlarm::m_alarmByNum[MAX_ALARMS] = {};
+
+HardwareAlarm::HardwareAlarm(std::function<void()> callback) : m_callback(callback)
+{
+}
+
+HardwareAlarm::~HardwareAlarm()
+{
+    cancel();
+}
+
+void HardwareAlarm::setTarget(uint64_t timeUs)
+{
+    cancel();
+    m_alarmNum = Simulation::schedule(timeUs, [this]()
+    {
+        m_alarmNum = -1;
+        if (m_callback)
+            m_callback();
+    });
+}
+
+void HardwareAlarm::cancel()
+{
+    if (m_alarmNum != -1)
+        Simulation::cancel(m_alarmNum);
+    m_alarmNum = -1;
+}
@@ -0,0 +1,31 @@
+#include "PicoClockHw/Platform.h"
+#include "Simulation.h"
+
+#include <hardware/sync.h>
+#include <mutex>
+
+namespace
+{
+    std::recursive_mutex g_interruptLock;
+}
+
+uint64_t Platform::timeUs()
+{
+    return Simulation::timeUs();
+}
+
+uint64_t time_us_64()
+{
+    return Simulation::timeUs();
+}
+
+uint32_t save_and_disable_interrupts()
+{
+    g_interruptLock.lock();
+    return 0;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    g_interruptLock.unlock();
+}
@@ -0,0 +1,63 @@
+#include "PicoClockHw/Rtc.h"
+
+#include <cmath>
+
+// The host build has no DS3231: the probe fails, so that the clock disables the RTC and relies on
+// the sources added by the tests.
+Rtc *Rtc::m_instance = nullptr;
+
+const char *Rtc::transactionName(Transaction transaction)
+{
+    return "none";
+}
+
+Rtc::Rtc() : m_temperaturePeriodMs(0)
+{
+}
+
+Rtc::~Rtc()
+{
+}
+
+bool Rtc::probeAsync(ProbeCallback callback)
+{
+    return false;
+}
+
+bool Rtc::readSnapshotAsync(SnapshotCallback callback)
+{
+    return false;
+}
+
+bool Rtc::readAsync(ReadCallback callback)
+{
+    return false;
+}
+
+bool Rtc::writeAsync(const tm &dateTime, WriteCallback callback)
+{
+    return false;
+}
+
+bool Rtc::writeAgingOffsetAsync(int8_t agingOffset, WriteCallback callback)
+{
+    return false;
+}
+
+bool Rtc::lastSnapshot(Snapshot &snapshot) const
+{
+    return false;
+}
+
+float Rtc::temperature() const
+{
+    return NAN;
+}
+
+void Rtc::setTemperaturePeriod(uint32_t periodMs)
+{
+}
+
+void Rtc::setSecondCallback(SecondCallback callback)
+{
+}
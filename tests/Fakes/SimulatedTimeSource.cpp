@@ -0,0 +1,55 @@
+#include "SimulatedTimeSource.h"
+
+#include <algorithm>
+
+SimulatedTimeSource::SimulatedTimeSource(const Config &config, uint32_t seed) :
+    m_config(config), m_random(seed)
+{
+}
+
+SimulatedTimeSource::~SimulatedTimeSource()
+{
+    Simulation::cancel(m_pending);
+}
+
+int64_t SimulatedTimeSource::jitterUs()
+{
+    int64_t jitterUs = m_config.jitterUs;
+    return std::uniform_int_distribution<int64_t>(-jitterUs, jitterUs)(m_random);
+}
+
+bool SimulatedTimeSource::requestSample(SampleCallback callback)
+{
+    if (!m_available || m_pending != 0)
+        return false;
+
+    m_requests++;
+    uint32_t latencyUs = std::max<int64_t>(0, m_config.latencyUs + jitterUs());
+    m_pending = Simulation::schedule(
+        Simulation::timeUs() + latencyUs,
+        [this, callback, latencyUs]() { answer(callback, latencyUs); });
+    return true;
+}
+
+void SimulatedTimeSource::answer(SampleCallback callback, uint32_t latencyUs)
+{
+    m_pending = 0;
+    std::uniform_real_distribution<double> draw(0, 1);
+    if (m_failing || draw(m_random) < m_config.failureRate)
+    {
+        m_failures++;
+        callback(false, Sample());
+        return;
+    }
+
+    // Received now, the reference being read the given time before
+    uint64_t nowUs = Simulation::timeUs();
+    int64_t readUs = m_config.halfLatencyError ? nowUs - latencyUs / 2 : nowUs;
+    int64_t us = referenceUs(readUs) + m_config.offsetUs + jitterUs();
+
+    Sample sample;
+    sample.time = us / 1000000;
+    sample.us = us % 1000000;
+    sample.timeUs = nowUs;
+    callback(true, sample);
+}
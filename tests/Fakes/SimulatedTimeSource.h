@@ -0,0 +1,92 @@
+#pragma once
+
+#include "TimeSource.h"
+#include "Simulation.h"
+
+#include <random>
+
+// Time source of the host build, e.g. an NTP server or a GPS receiver. The reference time is the
+// simulated time since START_TIME. Each request is answered after a random latency, or fails at
+// random, and the sample is off by a random error and by a constant offset.
+class SimulatedTimeSource : public TimeSource
+{
+public:
+    // Local time, without DST, at the simulated time 0
+    static const time_t START_TIME = 1700000000;
+
+    struct Config
+    {
+        const char *name = "Simulated";
+        int stratum = 3;
+        uint32_t precisionUs = 10000;
+        uint32_t latencyUs = 20000; // Of the answer, on average
+        uint32_t jitterUs = 5000; // Of the latency and of the sample, at most
+        double failureRate = 0; // Of the requests, between 0 and 1
+        int64_t offsetUs = 0; // Of the samples, e.g. of a source that was set wrong
+        bool halfLatencyError = true; // The sample is taken halfway, as by an NTP server
+    };
+
+    // Time of the reference at the given simulated time, in us
+    static int64_t referenceUs(uint64_t timeUs)
+    {
+        return static_cast<int64_t>(START_TIME) * 1000000 + static_cast<int64_t>(timeUs);
+    }
+
+    SimulatedTimeSource(const Config &config, uint32_t seed = 1);
+    ~SimulatedTimeSource();
+
+    void setAvailable(bool available)
+    {
+        m_available = available;
+    }
+
+    // Make the next requests fail, or answer again
+    void setFailing(bool failing)
+    {
+        m_failing = failing;
+    }
+
+    void setOffsetUs(int64_t offsetUs)
+    {
+        m_config.offsetUs = offsetUs;
+    }
+
+    int requests() const
+    {
+        return m_requests;
+    }
+    int failures() const
+    {
+        return m_failures;
+    }
+
+    const char *name() const override
+    {
+        return m_config.name;
+    }
+    int stratum() const override
+    {
+        return m_config.stratum;
+    }
+    uint32_t precisionUs() const override
+    {
+        return m_config.precisionUs;
+    }
+    bool isAvailable() const override
+    {
+        return m_available;
+    }
+    bool requestSample(SampleCallback callback) override;
+
+private:
+    int64_t jitterUs();
+    void answer(SampleCallback callback, uint32_t latencyUs);
+
+    Config m_config;
+    std::mt19937 m_random;
+    bool m_available = true;
+    bool m_failing = false;
+    Simulation::Handle m_pending = 0;
+    int m_requests = 0;
+    int m_failures = 0;
+};
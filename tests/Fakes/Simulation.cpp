@@ -0,0 +1,72 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+namespace
+{
+    struct Scheduled
+    {
+        uint64_t timeUs;
+        std::function<void()> callback;
+    };
+
+    uint64_t g_timeUs = 0;
+    Simulation::Handle g_nextHandle = 1;
+
+    // Ordered by time, then by handle so that callbacks due at the same time run in the order
+    // they were scheduled.
+    std::map<std::pair<uint64_t, Simulation::Handle>, std::function<void()>> g_queue;
+    std::map<Simulation::Handle, uint64_t> g_timeByHandle;
+}
+
+void Simulation::reset(uint64_t timeUs)
+{
+    g_queue.clear();
+    g_timeByHandle.clear();
+    g_timeUs = timeUs;
+}
+
+uint64_t Simulation::timeUs()
+{
+    return g_timeUs;
+}
+
+void Simulation::runUntil(uint64_t timeUs)
+{
+    while (!g_queue.empty() && g_queue.begin()->first.first <= timeUs)
+    {
+        auto first = g_queue.begin();
+        g_timeUs = std::max(g_timeUs, first->first.first);
+        std::function<void()> callback = std::move(first->second);
+        g_timeByHandle.erase(first->first.second);
+        g_queue.erase(first);
+        callback();
+    }
+    g_timeUs = std::max(g_timeUs, timeUs);
+}
+
+void Simulation::stall(uint64_t us)
+{
+    g_timeUs += us;
+}
+
+Simulation::Handle Simulation::schedule(uint64_t timeUs, std::function<void()> callback)
+{
+    Handle handle = g_nextHandle++;
+    timeUs = std::max(timeUs, g_timeUs);
+    g_queue[{timeUs, handle}] = callback;
+    g_timeByHandle[handle] = timeUs;
+    return handle;
+}
+
+void Simulation::cancel(Handle handle)
+{
+    auto found = g_timeByHandle.find(handle);
+    if (found == g_timeByHandle.end())
+        return;
+
+    g_queue.erase({found->second, handle});
+    g_timeByHandle.erase(found);
+}
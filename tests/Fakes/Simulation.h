@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// Simulated time of the host build, as returned by Platform::timeUs(). It only advances when the
+// test asks for it, firing the fakes of the hardware timer (HardwareAlarm, TimerWheel) in the
+// order of their targets, as the interrupts would.
+class Simulation
+{
+public:
+    using Handle = uint64_t; // 0 means no callback
+
+    // Drop all scheduled callbacks and restart at the given time.
+    static void reset(uint64_t timeUs = 0);
+
+    static uint64_t timeUs();
+
+    // Advance to the given time, calling the callbacks that are due in the order of their times.
+    // The time is the one of the callback while it runs.
+    static void runUntil(uint64_t timeUs);
+    static void runFor(uint64_t us)
+    {
+        runUntil(timeUs() + us);
+    }
+
+    // Advance without calling the callbacks that become due, as when the interrupts are disabled.
+    // They are called late, by the next run.
+    static void stall(uint64_t us);
+
+    // Call the function once at the given time, or as soon as possible if it has passed.
+    static Handle schedule(uint64_t timeUs, std::function<void()> callback);
+    static void cancel(Handle handle);
+};
@@ -0,0 +1,91 @@
+#include "PicoClockHw/TimerWheel.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <map>
+
+namespace
+{
+    struct Timer
+    {
+        TimerWheel::Callback callback;
+        void *userData;
+        uint64_t targetUs;
+        Simulation::Handle handle;
+    };
+
+    TimerWheel::TimerId g_nextId = 0;
+    std::map<TimerWheel::TimerId, Timer> g_timers;
+    TimerWheel::Stats g_stats = {};
+
+    void schedule(TimerWheel::TimerId id);
+
+    void fire(TimerWheel::TimerId id)
+    {
+        Timer &timer = g_timers[id];
+        int64_t result = timer.callback(id, timer.userData);
+
+        // The callback may have cancelled its own timer.
+        auto found = g_timers.find(id);
+        if (found == g_timers.end() || found->second.handle != 0)
+            return;
+
+        if (result == 0)
+        {
+            g_timers.erase(found);
+            g_stats.activeTimers--;
+            return;
+        }
+
+        if (result < 0)
+            found->second.targetUs -= result;
+        else
+            found->second.targetUs = Simulation::timeUs() + result;
+        schedule(id);
+    }
+
+    void schedule(TimerWheel::TimerId id)
+    {
+        Timer &timer = g_timers[id];
+        timer.handle = Simulation::schedule(timer.targetUs, [id]()
+        {
+            g_timers[id].handle = 0;
+            fire(id);
+        });
+    }
+}
+
+TimerWheel::TimerId TimerWheel::addInMs(uint32_t ms, Callback callback, void *userData)
+{
+    TimerId id = g_nextId++;
+    g_timers[id] = {callback, userData, Simulation::timeUs() + ms * 1000ull, 0};
+    schedule(id);
+
+    g_stats.activeTimers++;
+    g_stats.maxActiveTimers = std::max(g_stats.maxActiveTimers, g_stats.activeTimers);
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    auto found = g_timers.find(id);
+    if (found == g_timers.end())
+        return false;
+
+    if (found->second.handle != 0)
+        Simulation::cancel(found->second.handle);
+    g_timers.erase(found);
+    g_stats.activeTimers--;
+    return true;
+}
+
+TimerWheel::Stats TimerWheel::stats()
+{
+    return g_stats;
+}
+
+void TimerWheel::resetStats()
+{
+    g_stats.maxActiveTimers = g_stats.activeTimers;
+    g_stats.maxCallbackLatencyUs = 0;
+}
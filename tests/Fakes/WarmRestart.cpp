@@ -0,0 +1,11 @@
+#include "PicoClockHw/WarmRestart.h"
+
+// Each test starts as after a power-on, without saved state.
+void WarmRestart::save(const State &state)
+{
+}
+
+bool WarmRestart::restore(State &state)
+{
+    return false;
+}
@@ -0,0 +1,263 @@
+#include "Check.h"
+#include "FlashSimulator.h"
+#include "Settings.h"
+#include "Simulation.h"
+#include "PicoClockHw/FlashLayout.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+
+// Settings written to the log of Flash over many commits, checking the records and the erase
+// count of each sector of the ring, and the content read back after a power loss.
+namespace
+{
+    const int PAGES_PER_SECTOR = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+    const int COMMIT_COUNT = 200;
+
+    // Settings modified about once an hour on average, far more than by hand, with a restart each
+    // month, over years of use
+    const int WEAR_YEARS = 5;
+    const int WEAR_COMMITS_PER_DAY = 24;
+    const int WEAR_RESTART_DAYS = 30;
+    const uint32_t ERASE_ENDURANCE = 100000; // Cycles per sector of the W25Q16JV
+    const uint64_t HOUR_US = 60 * 60 * 1000000ull;
+
+    // Enough for a series of commits to compact into two new sectors
+    const int POWER_LOSS_COMMITS = 2 * PAGES_PER_SECTOR + 8;
+
+    // Record header of Flash.cpp
+    const uint8_t MAGIC_LOW = 0x78, MAGIC_HIGH = 0x5E;
+    const uint8_t SNAPSHOT = 1, DELTA = 2;
+
+    struct RecordCount
+    {
+        int snapshots = 0;
+        int deltas = 0;
+        int snapshotsAfterFirstPage = 0;
+    };
+
+    RecordCount countRecords()
+    {
+        RecordCount count;
+        for (int sector = 0; sector < FlashLayout::SETTINGS_SECTOR_COUNT; sector++)
+        {
+            for (int page = 0; page < PAGES_PER_SECTOR; page++)
+            {
+                const uint8_t *header = FlashLayout::content(
+                    FlashLayout::SETTINGS_OFFSET + sector * FLASH_SECTOR_SIZE +
+                    page * FLASH_PAGE_SIZE);
+                if (header[0] != MAGIC_LOW || header[1] != MAGIC_HIGH)
+                    continue;
+
+                if (header[2] == SNAPSHOT)
+                {
+                    count.snapshots++;
+                    if (page != 0)
+                        count.snapshotsAfterFirstPage++;
+                } else if (header[2] == DELTA)
+                    count.deltas++;
+            }
+        }
+        return count;
+    }
+
+    // Erase counts of the sectors of the ring
+    struct EraseCount
+    {
+        uint32_t total = 0;
+        uint32_t min = UINT32_MAX;
+        uint32_t max = 0;
+    };
+
+    EraseCount countErases()
+    {
+        EraseCount count;
+        for (int sector = 0; sector < FlashLayout::SETTINGS_SECTOR_COUNT; sector++)
+        {
+            uint32_t offset = FlashLayout::SETTINGS_OFFSET + sector * FLASH_SECTOR_SIZE;
+            uint32_t erases = FlashSimulator::eraseCount(offset);
+            count.total += erases;
+            count.min = std::min(count.min, erases);
+            count.max = std::max(count.max, erases);
+        }
+        return count;
+    }
+
+    // Each modification is committed on its own, the wear counters changing with each of them.
+    void testWearCountersKeepDeltas()
+    {
+        FlashSimulator::reset();
+        Simulation::reset();
+
+        Settings settings;
+        // Close to the limits where the counters would take one more byte as varints
+        Flash::restoreWear({0, 0, 0, 8100});
+        int snapshotsAfterFirstPage = 0;
+        for (int i = 0; i < COMMIT_COUNT; i++)
+        {
+            settings.modify()->countdownStartMin = i % 50 + 2; // Not the default value
+            Simulation::runFor(61 * 1000000ull);
+
+            // Checked after each commit, as the sectors get erased again
+            snapshotsAfterFirstPage += countRecords().snapshotsAfterFirstPage;
+        }
+
+        CHECK_EQUAL(Flash::stats().commits, uint32_t(COMMIT_COUNT));
+        CHECK_EQUAL(FlashSimulator::violations(), 0u);
+
+        // One snapshot at the start of each sector, then deltas only
+        CHECK_EQUAL(snapshotsAfterFirstPage, 0);
+        RecordCount count = countRecords();
+        CHECK_EQUAL(count.snapshots, FlashLayout::SETTINGS_SECTOR_COUNT);
+        CHECK(count.deltas > 0);
+
+        // The erases are spread over the ring, each sector taking a full record per page.
+        const uint32_t expectedErases = (COMMIT_COUNT + PAGES_PER_SECTOR - 1) / PAGES_PER_SECTOR;
+        CHECK_EQUAL(Flash::stats().erases, expectedErases);
+        EraseCount erases = countErases();
+        CHECK(erases.max - erases.min <= 1);
+
+        // Read back as after a restart
+        Flash::Wear wear = Flash::wear();
+        Settings restored;
+        CHECK_EQUAL(restored.get().countdownStartMin, (COMMIT_COUNT - 1) % 50 + 2);
+        CHECK_EQUAL(Flash::wear().erases, wear.erases);
+        CHECK(Flash::wear().blockedMs >= 8100 + expectedErases * FlashSimulator::ERASE_US / 1000);
+    }
+
+    // Many thousands of commits at random times, the ring being erased evenly and the wear
+    // counters surviving the restarts. The endurance is projected from the erases per year of the
+    // most erased sector.
+    void testWearOverYears()
+    {
+        FlashSimulator::reset();
+        Simulation::reset();
+        Flash::restoreWear({});
+
+        std::mt19937 random(11);
+        std::uniform_int_distribution<uint64_t> gapUs(0, 2 * 24 * HOUR_US / WEAR_COMMITS_PER_DAY);
+        auto settings = std::make_unique<Settings>();
+        const int days = WEAR_YEARS * 365;
+        int commits = 0;
+        for (int day = 0; day < days; day++)
+        {
+            if (day % WEAR_RESTART_DAYS == 0 && day > 0)
+            {
+                // The counters are lost with the RAM, and read back with the settings.
+                uint32_t erases = Flash::wear().erases;
+                Flash::restoreWear({});
+                settings = std::make_unique<Settings>();
+                CHECK_EQUAL(Flash::wear().erases, erases);
+            }
+
+            uint64_t endUs = Simulation::timeUs() + 24 * HOUR_US;
+            for (int i = 0; i < WEAR_COMMITS_PER_DAY; i++)
+            {
+                settings->modify()->countdownStartMin = commits % 50 + 2;
+                commits++;
+                Simulation::runFor(61 * 1000000ull + gapUs(random));
+            }
+            Simulation::runUntil(std::max(endUs, Simulation::timeUs()));
+        }
+
+        EraseCount erases = countErases();
+        CHECK_EQUAL(Flash::wear().erases, erases.total);
+        CHECK_EQUAL(FlashSimulator::violations(), 0u);
+        CHECK_EQUAL(Flash::wear().skippedWrites, 0u);
+
+        // One erase per sector full of one page records, as with fewer commits
+        const uint32_t expectedErases = (commits + PAGES_PER_SECTOR - 1) / PAGES_PER_SECTOR;
+        CHECK_EQUAL(erases.total, expectedErases);
+        CHECK(erases.max - erases.min <= 1);
+
+        double enduranceYears = double(ERASE_ENDURANCE) * WEAR_YEARS / erases.max;
+        std::cout << commits << " commits over " << WEAR_YEARS << " years, erases per sector "
+                  << erases.min << " to " << erases.max << ", endurance " << enduranceYears
+                  << " years" << std::endl;
+        CHECK(enduranceYears > 100);
+
+        Settings restored;
+        CHECK_EQUAL(restored.get().countdownStartMin, (commits - 1) % 50 + 2);
+    }
+
+    int commitValue(int commit)
+    {
+        return commit % 50 + 2; // Not the default value
+    }
+
+    // Commit the settings until the power is lost, from a blank flash. Return the commit that was
+    // interrupted, or POWER_LOSS_COMMITS if none was.
+    int commitUntilPowerLoss(uint64_t lossBytes)
+    {
+        FlashSimulator::reset();
+        FlashSimulator::losePowerAfter(lossBytes);
+        Simulation::reset();
+        Flash::restoreWear({});
+
+        Settings settings;
+        for (int commit = 0; commit < POWER_LOSS_COMMITS; commit++)
+        {
+            settings.modify()->countdownStartMin = commitValue(commit);
+            Simulation::runFor(61 * 1000000ull);
+            if (FlashSimulator::isPowerLost())
+                return commit;
+        }
+        return POWER_LOSS_COMMITS;
+    }
+
+    // The power is lost after each byte erased or programmed by a series of delta records and
+    // compactions. After the restart, the settings hold either the value of the interrupted commit
+    // or the previous one, and the next commit is read back.
+    void testPowerLoss()
+    {
+        CHECK_EQUAL(commitUntilPowerLoss(UINT64_MAX), POWER_LOSS_COMMITS);
+        uint64_t totalBytes = 0;
+        for (int sector = 0; sector < FlashLayout::SETTINGS_SECTOR_COUNT; sector++)
+        {
+            uint32_t offset = FlashLayout::SETTINGS_OFFSET + sector * FLASH_SECTOR_SIZE;
+            totalBytes += FlashSimulator::eraseCount(offset) * FLASH_SECTOR_SIZE +
+                FlashSimulator::programCount(offset) * FLASH_PAGE_SIZE;
+        }
+        CHECK(Flash::stats().erases >= 3);
+
+        int failures = 0;
+        for (uint64_t lossBytes = 0; lossBytes < totalBytes && failures < 10; lossBytes++)
+        {
+            int commit = commitUntilPowerLoss(lossBytes);
+            CHECK(commit < POWER_LOSS_COMMITS);
+
+            FlashSimulator::restorePower();
+            Flash::restoreWear({});
+            int value = Settings().get().countdownStartMin;
+            int previousValue = commit == 0 ? Settings::Values().countdownStartMin
+                                            : commitValue(commit - 1);
+            if (value != commitValue(commit) && value != previousValue)
+            {
+                CHECK_EQUAL(value, commitValue(commit));
+                failures++;
+                continue;
+            }
+
+            Settings settings;
+            settings.modify()->countdownStartMin = commitValue(commit + 1);
+            Simulation::runFor(61 * 1000000ull);
+            if (Settings().get().countdownStartMin != commitValue(commit + 1) ||
+                FlashSimulator::violations() != 0)
+            {
+                CHECK_EQUAL(Settings().get().countdownStartMin, commitValue(commit + 1));
+                CHECK_EQUAL(FlashSimulator::violations(), 0u);
+                failures++;
+            }
+        }
+    }
+}
+
+int main()
+{
+    testWearCountersKeepDeltas();
+    testWearOverYears();
+    testPowerLoss();
+    return Check::result();
+}
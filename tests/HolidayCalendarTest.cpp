@@ -0,0 +1,308 @@
+#include "Check.h"
+#include "FlashSimulator.h"
+#include "HolidayCalendar.h"
+#include "PicoClockHw/FlashLayout.h"
+
+#include <hardware/flash.h>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// A calendar written into the simulated holiday sector as tools/holiday_import.py does, against
+// a day by day evaluation of the same days and rules.
+namespace
+{
+    using Calendar = HolidayCalendar;
+
+    const int FIRST_YEAR = 1995;
+    const int LAST_YEAR = 2045;
+    const time_t DAY_SEC = 24 * 60 * 60;
+
+    struct Date
+    {
+        int year;
+        int month; // 1 to 12
+        int day; // Of the month
+        int weekday; // 0 for Sunday
+        int yday;
+    };
+
+    Date dateOf(time_t time)
+    {
+        tm tm;
+        gmtime_r(&time, &tm);
+        return {tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_wday, tm.tm_yday};
+    }
+
+    time_t dayTime(int year, int month, int day)
+    {
+        tm tm = {};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = day; // Normalized by timegm(), e.g. 0 for the last day of the month before
+        return timegm(&tm);
+    }
+
+    time_t yearStart(int year)
+    {
+        return dayTime(year, 1, 1);
+    }
+
+    int daysInMonth(int year, int month)
+    {
+        return dateOf(dayTime(year, month + 1, 0)).day;
+    }
+
+    // Knuth's algorithm, different from the one of HolidayCalendar, as day of the year
+    int easterDayOfYear(int year)
+    {
+        int golden = year % 19 + 1;
+        int century = year / 100 + 1;
+        int x = 3 * century / 4 - 12;
+        int z = (8 * century + 5) / 25 - 5;
+        int d = 5 * year / 4 - x - 10;
+        int epact = (11 * golden + 20 + z - x) % 30;
+        if ((epact == 25 && golden > 11) || epact == 24)
+            epact++;
+        int n = 44 - epact;
+        if (n < 21)
+            n += 30;
+        n = n + 7 - (d + n) % 7; // Day of March, over 31 in April
+        return dateOf(dayTime(year, 3, n)).yday;
+    }
+
+    struct Content
+    {
+        std::vector<Calendar::Year> years;
+        std::vector<Calendar::Rule> rules;
+    };
+
+    Calendar::Year yearWithDays(int year, int firstDay, int lastDay)
+    {
+        Calendar::Year result = {};
+        result.year = year;
+        for (int day = firstDay; day <= lastDay; day++)
+            result.dayBits[day / 32] |= 1u << (day % 32);
+        return result;
+    }
+
+    Content sampleContent()
+    {
+        Content content;
+        content.years.push_back(yearWithDays(2024, 100, 110));
+        content.years.push_back(yearWithDays(2024, 359, 365));
+        content.years.push_back(yearWithDays(2025, 0, 3));
+
+        // Three years off in a row, longer than the search
+        for (int year = 2036; year <= 2038; year++)
+            content.years.push_back(yearWithDays(year, 0, 365));
+
+        content.rules =
+        {
+            {Calendar::FixedDate, 1, 1, 0},
+            {Calendar::FixedDate, 5, 1, 0},
+            {Calendar::FixedDate, 12, 25, 0},
+            {Calendar::FixedDate, 2, 29, 0}, // Only in leap years
+            {Calendar::FixedDate, 4, 31, 0}, // Never
+            {Calendar::NthWeekday, 11, 4, 4}, // 4th Thursday of November
+            {Calendar::NthWeekday, 5, 1, -1}, // Last Monday of May
+            {Calendar::NthWeekday, 9, 1, 1}, // First Monday of September
+            {Calendar::NthWeekday, 3, 5, 5}, // 5th Friday of March, some years only
+            {Calendar::NthWeekday, 8, 0, -5}, // 5th last Sunday of August, some years only
+            {Calendar::NthWeekday, 7, 7, 1}, // Invalid weekday
+            {Calendar::NthWeekday, 13, 1, 1}, // Invalid month
+            {Calendar::EasterOffset, 0, 0, 1}, // Easter Monday
+            {Calendar::EasterOffset, 0, 0, -2}, // Good Friday
+            {Calendar::EasterOffset, 0, 0, 50}, // Whit Monday
+            {Calendar::EasterOffset, 0, 0, -100}, // Before the year
+        };
+        return content;
+    }
+
+    uint32_t djb2(const uint8_t *data, size_t size)
+    {
+        uint32_t hash = 5381;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash << 5) + hash + data[i];
+        return hash;
+    }
+
+    void writeCalendar(const Content &content)
+    {
+        size_t yearsSize = content.years.size() * sizeof(Calendar::Year);
+        size_t rulesSize = content.rules.size() * sizeof(Calendar::Rule);
+        std::vector<uint8_t> data(sizeof(Calendar::Header) + yearsSize + rulesSize);
+        memcpy(data.data() + sizeof(Calendar::Header), content.years.data(), yearsSize);
+        memcpy(data.data() + sizeof(Calendar::Header) + yearsSize, content.rules.data(), rulesSize);
+
+        Calendar::Header header = {};
+        header.magic = Calendar::MAGIC;
+        header.version = Calendar::VERSION;
+        header.yearCount = content.years.size();
+        header.ruleCount = content.rules.size();
+        header.hash = djb2(data.data() + sizeof(header), data.size() - sizeof(header));
+        memcpy(data.data(), &header, sizeof(header));
+
+        data.resize((data.size() + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE, 0xFF);
+        FlashSimulator::reset();
+        flash_range_program(FlashLayout::HOLIDAYS_OFFSET, data.data(), data.size());
+    }
+
+    bool matches(const Calendar::Rule &rule, const Date &date)
+    {
+        switch (rule.type)
+        {
+            case Calendar::FixedDate:
+                return date.month == rule.month && date.day == rule.day;
+
+            case Calendar::NthWeekday:
+            {
+                if (date.month != rule.month || date.weekday != rule.day)
+                    return false;
+                if (rule.param > 0)
+                    return (date.day - 1) / 7 + 1 == rule.param;
+                return (daysInMonth(date.year, date.month) - date.day) / 7 + 1 == -rule.param;
+            }
+
+            case Calendar::EasterOffset:
+                return date.yday == easterDayOfYear(date.year) + rule.param;
+        }
+        return false;
+    }
+
+    // Holiday flag of each day from FIRST_YEAR on
+    std::vector<bool> expectedHolidays(const Content &content)
+    {
+        std::vector<bool> holidays;
+        for (time_t time = yearStart(FIRST_YEAR); time < yearStart(LAST_YEAR + 1); time += DAY_SEC)
+        {
+            Date date = dateOf(time);
+            bool holiday = false;
+            for (const Calendar::Year &year : content.years)
+            {
+                uint32_t word = year.dayBits[date.yday / 32];
+                if (year.year == date.year && (word >> (date.yday % 32)) & 1)
+                    holiday = true;
+            }
+            for (const Calendar::Rule &rule : content.rules)
+                holiday = holiday || matches(rule, date);
+            holidays.push_back(holiday);
+        }
+        return holidays;
+    }
+
+    // Day by day over the rest of the start year and the two following ones
+    int expectedDaysUntilAllowedDay(
+        const std::vector<bool> &holidays, int startIndex, uint8_t weekDayBits)
+    {
+        time_t start = yearStart(FIRST_YEAR) + startIndex * DAY_SEC;
+        int lastYear = dateOf(start).year + 2;
+        for (int days = 0; ; days++)
+        {
+            Date date = dateOf(start + days * DAY_SEC);
+            if (date.year > lastYear)
+                return -1;
+            if ((weekDayBits >> date.weekday) & 1 && !holidays[startIndex + days])
+                return days;
+        }
+    }
+
+    void checkCalendar(const Calendar &calendar, const std::vector<bool> &holidays)
+    {
+        // Every day, in order, then in a random order that defeats the cache of two years
+        std::mt19937 random(5);
+        int lastIndex = yearStart(LAST_YEAR - 3) / DAY_SEC - yearStart(FIRST_YEAR) / DAY_SEC;
+        std::uniform_int_distribution<int> dayIndex(0, lastIndex);
+        int failures = 0;
+        for (int i = 0; i < 2 * lastIndex && failures < 10; i++)
+        {
+            int index = i < lastIndex ? i : dayIndex(random);
+            Date date = dateOf(yearStart(FIRST_YEAR) + index * DAY_SEC);
+            if (calendar.isHoliday(date.year - 1900, date.yday) != holidays[index])
+            {
+                CHECK_EQUAL(calendar.isHoliday(date.year - 1900, date.yday), holidays[index]);
+                failures++;
+            }
+        }
+
+        std::uniform_int_distribution<int> weekDayBits(0, 0x7F);
+        for (int i = 0; i < 100000 && failures < 10; i++)
+        {
+            int index = dayIndex(random);
+            uint8_t bits = i < 1000 ? 1u << (i % 7) : weekDayBits(random);
+            time_t time = yearStart(FIRST_YEAR) + index * DAY_SEC;
+            tm start;
+            gmtime_r(&time, &start);
+
+            int expected = bits == 0 ? -1 : expectedDaysUntilAllowedDay(holidays, index, bits);
+            if (calendar.daysUntilAllowedDay(start, bits) != expected)
+            {
+                CHECK_EQUAL(calendar.daysUntilAllowedDay(start, bits), expected);
+                failures++;
+            }
+        }
+    }
+
+    void testEaster()
+    {
+        // Known dates, the reference of the other tests being computed differently
+        struct
+        {
+            int year, month, day;
+        } dates[] = {{2000, 4, 23}, {2008, 3, 23}, {2011, 4, 24}, {2019, 4, 21}, {2024, 3, 31},
+                     {2025, 4, 20}, {2038, 4, 25}};
+        Content content;
+        content.rules = {{Calendar::EasterOffset, 0, 0, 0}};
+        writeCalendar(content);
+        Calendar calendar;
+        for (auto &date : dates)
+        {
+            int yday = dateOf(dayTime(date.year, date.month, date.day)).yday;
+            CHECK_EQUAL(easterDayOfYear(date.year), yday);
+            CHECK(calendar.isHoliday(date.year - 1900, yday));
+            CHECK(!calendar.isHoliday(date.year - 1900, yday - 1));
+        }
+    }
+
+    void testCalendar()
+    {
+        Content content = sampleContent();
+        writeCalendar(content);
+        Calendar calendar;
+        CHECK(calendar.isPresent());
+        checkCalendar(calendar, expectedHolidays(content));
+    }
+
+    void testNoCalendar()
+    {
+        FlashSimulator::reset();
+        Calendar calendar;
+        CHECK(!calendar.isPresent());
+        checkCalendar(calendar, expectedHolidays(Content()));
+    }
+
+    void testCorruptedCalendar()
+    {
+        Content content = sampleContent();
+        writeCalendar(content);
+
+        // Clear a bit of the last rule, as a partial write would.
+        uint32_t offset = FlashLayout::HOLIDAYS_OFFSET + sizeof(Calendar::Header) +
+            content.years.size() * sizeof(Calendar::Year);
+        std::vector<uint8_t> page(
+            FlashLayout::content(offset - offset % FLASH_PAGE_SIZE),
+            FlashLayout::content(offset - offset % FLASH_PAGE_SIZE) + FLASH_PAGE_SIZE);
+        page[offset % FLASH_PAGE_SIZE] &= 0xFE;
+        flash_range_program(offset - offset % FLASH_PAGE_SIZE, page.data(), page.size());
+        CHECK(!Calendar().isPresent());
+    }
+}
+
+int main()
+{
+    testEaster();
+    testCalendar();
+    testNoCalendar();
+    testCorruptedCalendar();
+    return Check::result();
+}
@@ -0,0 +1,105 @@
+#include "Check.h"
+#include "RtcCalibrator.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+// Calibration of a simulated DS3231 whose crystal is off by a few ppm, measured against NTP every
+// hour with some noise, as Clock does.
+namespace
+{
+    const int SYNC_PERIOD_SEC = 60 * 60;
+    const double PPM_PER_AGING_STEP = 0.1; // Positive steps slow the oscillator down
+    const int64_t MEASUREMENT_NOISE_US = 5000;
+    const int DAYS = 120;
+
+    struct CrystalModel
+    {
+        double crystalPpm; // Drift with an aging offset of 0, positive if fast
+        int agingOffset = 0;
+        double offsetUs = 0; // Of the RTC, positive if ahead
+
+        double driftPpm() const
+        {
+            return crystalPpm - agingOffset * PPM_PER_AGING_STEP;
+        }
+    };
+
+    struct Outcome
+    {
+        Settings::RtcCalibration calibration;
+        double residualPpm;
+        int lateRtcWrites; // In the second half of the simulation
+    };
+
+    Outcome calibrate(double crystalPpm)
+    {
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int64_t> noise(-MEASUREMENT_NOISE_US, MEASUREMENT_NOISE_US);
+
+        CrystalModel rtc = {crystalPpm};
+        RtcCalibrator calibrator;
+        int lateRtcWrites = 0;
+        time_t time = 1700000000;
+        const int syncCount = DAYS * 24 * 60 * 60 / SYNC_PERIOD_SEC;
+        for (int sync = 0; sync < syncCount; sync++)
+        {
+            time += SYNC_PERIOD_SEC;
+            rtc.offsetUs += rtc.driftPpm() * SYNC_PERIOD_SEC;
+
+            RtcCalibrator::Result result =
+                calibrator.onOffsetMeasured(time, std::lround(rtc.offsetUs) + noise(random));
+            if (result.agingChanged)
+                rtc.agingOffset = calibrator.calibration().agingOffset;
+            if (result.writeTime)
+            {
+                // Set, then measured again to start a new period
+                rtc.offsetUs = 0;
+                if (sync >= syncCount / 2)
+                    lateRtcWrites++;
+                calibrator.onRtcWritten();
+                calibrator.onOffsetMeasured(time, noise(random));
+            }
+        }
+        return {calibrator.calibration(), rtc.driftPpm(), lateRtcWrites};
+    }
+
+    void testConverges(double crystalPpm)
+    {
+        Outcome outcome = calibrate(crystalPpm);
+        const Settings::RtcCalibration &calibration = outcome.calibration;
+
+        // A fast crystal is slowed down by a positive aging offset.
+        int expectedAging = std::lround(crystalPpm / PPM_PER_AGING_STEP);
+        CHECK(std::abs(calibration.agingOffset - expectedAging) <= 1);
+        CHECK(std::fabs(outcome.residualPpm) <= PPM_PER_AGING_STEP);
+
+        // Large steps first, limited for a single measurement, then small corrections
+        CHECK(calibration.adjustments >= 2);
+        CHECK(calibration.adjustments <= 4);
+        int first = calibration.adjustments - 1;
+        CHECK(std::fabs(calibration.driftHistory[first] - crystalPpm * 100) <=
+              std::fabs(crystalPpm * 100) * 0.1);
+        CHECK(std::abs(calibration.driftHistory[0]) < std::abs(calibration.driftHistory[first]));
+
+        // Once calibrated, the RTC takes weeks to get far enough off to be set.
+        CHECK(outcome.lateRtcWrites <= DAYS / 2 / 20);
+    }
+
+    void testAccurateCrystalNotAdjusted()
+    {
+        Outcome outcome = calibrate(0.02);
+        CHECK_EQUAL(outcome.calibration.agingOffset, 0);
+        CHECK_EQUAL(outcome.calibration.adjustments, 0);
+    }
+}
+
+int main()
+{
+    testConverges(5);
+    testConverges(-5);
+    testConverges(2.34);
+    testAccurateCrystalNotAdjusted();
+    return Check::result();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Host replacement of the Pico SDK header. A single channel can be claimed, and only its
+// transfers of bytes through the CRC sniffer are simulated, by Fakes/Dma.cpp.
+#include <cstdint>
+
+enum dma_channel_transfer_size
+{
+    DMA_SIZE_8,
+    DMA_SIZE_16,
+    DMA_SIZE_32
+};
+
+struct dma_channel_config
+{
+    dma_channel_transfer_size size;
+    bool readIncrement;
+    bool sniff;
+};
+
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC32R 0x1
+
+int dma_claim_unused_channel(bool required);
+
+inline dma_channel_config dma_channel_get_default_config(unsigned int channel)
+{
+    return {DMA_SIZE_32, true, false};
+}
+
+inline void channel_config_set_transfer_data_size(
+    dma_channel_config *c, dma_channel_transfer_size size)
+{
+    c->size = size;
+}
+inline void channel_config_set_read_increment(dma_channel_config *c, bool increment)
+{
+    c->readIncrement = increment;
+}
+inline void channel_config_set_write_increment(dma_channel_config *c, bool increment) {}
+inline void channel_config_set_sniff_enable(dma_channel_config *c, bool enable)
+{
+    c->sniff = enable;
+}
+
+// Done at once when triggered
+void dma_channel_configure(
+    unsigned int channel, const dma_channel_config *config, volatile void *write_addr,
+    const volatile void *read_addr, unsigned int transfer_count, bool trigger);
+inline void dma_channel_wait_for_finish_blocking(unsigned int channel) {}
+
+void dma_sniffer_enable(unsigned int channel, unsigned int mode, bool force);
+void dma_sniffer_disable();
+void dma_sniffer_set_output_reverse_enabled(bool enable);
+void dma_sniffer_set_output_invert_enabled(bool enable);
+void dma_sniffer_set_data_accumulator(uint32_t seed_value);
+uint32_t dma_sniffer_get_data_accumulator();
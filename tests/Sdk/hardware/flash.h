@@ -0,0 +1,15 @@
+#pragma once
+
+// Host replacement of the Pico SDK header, backed by the memory of FlashSimulator.
+#include "FlashSimulator.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#define XIP_BASE (FlashSimulator::base())
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
@@ -0,0 +1,14 @@
+#pragma once
+
+// Host replacement of the Pico SDK header. Disabling the interrupts is emulated by a global lock,
+// so that the code can be exercised from several threads as from interrupts.
+#include <atomic>
+#include <cstdint>
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+
+inline void __dmb()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
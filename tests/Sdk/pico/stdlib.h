@@ -0,0 +1,4 @@
+#pragma once
+
+// Host replacement of the Pico SDK header, only providing what the hardware independent code uses.
+#include <pico/time.h>
@@ -0,0 +1,13 @@
+#pragma once
+
+// Host replacement of the Pico SDK header, only providing what the hardware independent code uses.
+#include <cstdint>
+
+struct repeating_timer
+{
+    void *user_data;
+};
+typedef repeating_timer repeating_timer_t;
+
+// Simulated time, see Simulation.h
+uint64_t time_us_64();
@@ -0,0 +1,73 @@
+#include "Check.h"
+#include "Settings.h"
+
+#include <atomic>
+#include <thread>
+
+// Snapshots taken by one thread while another one keeps modifying the settings, standing for the
+// main loop and an interrupt on the device. The modifications keep some fields equal, which every
+// snapshot must see.
+namespace
+{
+    const int MODIFICATIONS = 200000;
+
+    // Between the writes of a modification, so that the snapshots often overlap them
+    void pause()
+    {
+        for (volatile int i = 0; i < 20; i++)
+        {
+        }
+    }
+
+    bool isConsistent(const Settings::Values &values)
+    {
+        return values.alarm1.min == values.alarm1.hour &&
+            values.countdownStartSec == values.alarm1.hour;
+    }
+
+    void testSnapshotsDuringModifications()
+    {
+        Settings settings;
+        {
+            Settings::Modification modification = settings.modify();
+            modification->alarm1.hour = 0;
+            modification->alarm1.min = 0;
+            modification->countdownStartSec = 0;
+        }
+
+        std::atomic<bool> done(false);
+        std::thread writer([&]
+        {
+            for (int i = 0; i < MODIFICATIONS; i++)
+            {
+                Settings::Modification modification = settings.modify();
+                modification->alarm1.hour = i % 24;
+                pause();
+                modification->alarm1.min = i % 24;
+                pause();
+                modification->countdownStartSec = i % 24;
+            }
+            done = true;
+        });
+
+        int snapshots = 0, inconsistent = 0;
+        while (!done)
+        {
+            if (!isConsistent(settings.snapshot()))
+                inconsistent++;
+            snapshots++;
+        }
+        writer.join();
+
+        CHECK_EQUAL(inconsistent, 0);
+        CHECK(snapshots > 0);
+        CHECK(isConsistent(settings.snapshot()));
+        CHECK_EQUAL(settings.get().alarm1.hour, (MODIFICATIONS - 1) % 24);
+    }
+}
+
+int main()
+{
+    testSnapshotsDuringModifications();
+    return Check::result();
+}
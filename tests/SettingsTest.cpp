@@ -0,0 +1,207 @@
+#include "Check.h"
+#include "Settings.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Encoding of the settings: round trip of valid values, fields out of their range, and decoding
+// of damaged encodings.
+namespace
+{
+    const int FUZZ_RUNS = 20000;
+
+    std::mt19937 g_random(1234);
+
+    int randomInt(int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(g_random);
+    }
+
+    Settings::Alarm randomAlarm()
+    {
+        Settings::Alarm alarm;
+        alarm.mode = Settings::AlarmMode(randomInt(0, int(Settings::AlarmMode::Count) - 1));
+        alarm.hour = randomInt(0, 23);
+        alarm.min = randomInt(0, 59);
+        alarm.weekDayBits = randomInt(0, 0x7F);
+        return alarm;
+    }
+
+    Settings::Values randomValues()
+    {
+        Settings::Values values;
+        values.function = randomInt(0, Settings::FUNCTION_COUNT - 1);
+        values.autoScroll = randomInt(0, 1);
+        values.useCelsius = randomInt(0, 1);
+        values.format24h = randomInt(0, 1);
+        values.hourlyChime =
+            Settings::HourlyChimeMode(randomInt(0, int(Settings::HourlyChimeMode::Count) - 1));
+        values.autoLight = randomInt(0, 1);
+        values.alarm1 = randomAlarm();
+        values.alarm2 = randomAlarm();
+        values.skipNextAlarm = randomInt(0, 1);
+        values.countdownStartMin = randomInt(0, 59);
+        values.countdownStartSec = randomInt(0, 59);
+        values.manualBrightness = randomInt(0, 100);
+        values.brightnessDark = randomInt(-100, 100);
+        values.brightnessDim = randomInt(-100, 100);
+        values.brightnessBright = randomInt(-100, 100);
+        values.rtcCalibration.agingOffset = randomInt(INT8_MIN, INT8_MAX);
+        values.rtcCalibration.adjustments = randomInt(0, UINT16_MAX);
+        values.rtcCalibration.lastAdjustmentTime = g_random();
+        for (int16_t &drift : values.rtcCalibration.driftHistory)
+            drift = randomInt(INT16_MIN, INT16_MAX);
+        return values;
+    }
+
+    bool isValid(const Settings::Alarm &alarm)
+    {
+        return int(alarm.mode) >= 0 && alarm.mode < Settings::AlarmMode::Count &&
+            alarm.hour >= 0 && alarm.hour <= 23 && alarm.min >= 0 && alarm.min <= 59 &&
+            alarm.weekDayBits <= 0x7F;
+    }
+
+    // Values that the user interface can handle
+    bool isValid(const Settings::Values &values)
+    {
+        return values.function >= 0 && values.function < Settings::FUNCTION_COUNT &&
+            values.hourlyChime < Settings::HourlyChimeMode::Count &&
+            isValid(values.alarm1) && isValid(values.alarm2) &&
+            values.countdownStartMin >= 0 && values.countdownStartMin <= 59 &&
+            values.countdownStartSec >= 0 && values.countdownStartSec <= 59 &&
+            values.manualBrightness >= 0 && values.manualBrightness <= 100 &&
+            values.brightnessDark >= -100 && values.brightnessDark <= 100 &&
+            values.brightnessDim >= -100 && values.brightnessDim <= 100 &&
+            values.brightnessBright >= -100 && values.brightnessBright <= 100;
+    }
+
+    // Bools are copied as bytes when decoded, any other value than 0 or 1 is invalid.
+    bool hasValidBools(const Settings::Values &values)
+    {
+        for (const bool *b : {&values.autoScroll, &values.useCelsius, &values.format24h,
+                              &values.autoLight, &values.skipNextAlarm})
+        {
+            uint8_t byte;
+            memcpy(&byte, b, 1);
+            if (byte > 1)
+                return false;
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> encode(const Settings::Values &values, const Flash::Wear &wear)
+    {
+        std::vector<uint8_t> encoded(Settings::MAX_ENCODED_SIZE);
+        encoded.resize(Settings::encode(values, wear, encoded.data()));
+        return encoded;
+    }
+
+    void testRoundTrip()
+    {
+        for (int run = 0; run < 1000; run++)
+        {
+            Settings::Values values = randomValues();
+            Flash::Wear wear = {uint32_t(g_random()), uint32_t(g_random()), uint32_t(g_random()),
+                                uint32_t(g_random())};
+            std::vector<uint8_t> encoded = encode(values, wear);
+
+            Settings::Values decoded;
+            Flash::Wear decodedWear = {};
+            CHECK(Settings::decode(encoded.data(), encoded.size(), decoded, decodedWear));
+            CHECK(encode(decoded, decodedWear) == encoded);
+            CHECK_EQUAL(decoded.alarm2.hour, values.alarm2.hour);
+            CHECK_EQUAL(decoded.brightnessDark, values.brightnessDark);
+            CHECK_EQUAL(
+                decoded.rtcCalibration.driftHistory[3], values.rtcCalibration.driftHistory[3]);
+            CHECK_EQUAL(decodedWear.blockedMs, wear.blockedMs);
+        }
+    }
+
+    void putVarint(std::vector<uint8_t> &encoded, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            encoded.push_back((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        encoded.push_back(value);
+    }
+
+    // Marker, key and zigzag value of a single field, written by hand
+    std::vector<uint8_t> encodeField(uint8_t id, int value)
+    {
+        std::vector<uint8_t> encoded = {0xFE};
+        putVarint(encoded, id << 3);
+        putVarint(encoded, (uint32_t(value) << 1) ^ (value >> 31));
+        return encoded;
+    }
+
+    void testOutOfRangeFieldsSkipped()
+    {
+        struct Case { uint8_t id; int value; } cases[] =
+        {
+            {1, Settings::FUNCTION_COUNT}, {2, 2}, {5, 3}, {7, 3}, {8, 24}, {9, 60}, {9, -1},
+            {10, 0x80}, {16, 60}, {18, 101}, {19, -101}, {21, 200}
+        };
+        for (const Case &c : cases)
+        {
+            std::vector<uint8_t> encoded = encodeField(c.id, c.value);
+            Settings::Values values;
+            Flash::Wear wear = {};
+            CHECK(Settings::decode(encoded.data(), encoded.size(), values, wear));
+            CHECK(encode(values, wear) == encode(Settings::Values(), wear));
+        }
+
+        // The limits themselves are valid.
+        std::vector<uint8_t> encoded = encodeField(8, 23);
+        Settings::Values values;
+        Flash::Wear wear = {};
+        CHECK(Settings::decode(encoded.data(), encoded.size(), values, wear));
+        CHECK_EQUAL(values.alarm1.hour, 23);
+    }
+
+    // Damaged encodings: random bytes, and valid encodings with flipped bits or truncated. The
+    // decoding must stay within the buffer and only produce valid values.
+    void testFuzz()
+    {
+        for (int run = 0; run < FUZZ_RUNS; run++)
+        {
+            std::vector<uint8_t> encoded;
+            if (run % 4 == 0)
+            {
+                encoded.resize(randomInt(0, Settings::MAX_ENCODED_SIZE));
+                for (uint8_t &byte : encoded)
+                    byte = g_random();
+                if (!encoded.empty())
+                    encoded[0] = 0xFE;
+            } else
+            {
+                encoded = encode(randomValues(), Flash::Wear());
+                for (int flips = randomInt(1, 4); flips > 0; flips--)
+                    encoded[randomInt(1, encoded.size() - 1)] ^= 1 << randomInt(0, 7);
+                if (run % 4 == 1)
+                    encoded.resize(randomInt(1, encoded.size()));
+            }
+
+            // Exactly sized copy, so that reading past the end is caught by sanitizers
+            std::vector<uint8_t> input(encoded);
+            input.shrink_to_fit();
+            Settings::Values values;
+            Flash::Wear wear = {};
+            Settings::decode(input.data(), input.size(), values, wear);
+            CHECK(isValid(values));
+            CHECK(hasValidBools(values));
+            if (Check::failures() > 0)
+                return;
+        }
+    }
+}
+
+int main()
+{
+    testRoundTrip();
+    testOutOfRangeFieldsSkipped();
+    testFuzz();
+    return Check::result();
+}
@@ -0,0 +1,135 @@
+#include "Check.h"
+#include "FlashSimulator.h"
+#include "Simulation.h"
+#include "TemperatureHistory.h"
+#include "PicoClockHw/FlashLayout.h"
+
+#include <cmath>
+#include <vector>
+
+// Summaries computed when the samples are added, against averages of the samples recomputed here,
+// and the checkpoint of the history in flash.
+namespace
+{
+    const time_t START_TIME = 1700000000 / 3600 * 3600;
+
+    int16_t sampleAt(int minute)
+    {
+        return 80 + std::lround(20 * std::sin(minute / 100.0));
+    }
+
+    // Average of the values into columns, as TemperatureHistory does
+    TemperatureHistory::Summary expectedSummary(const std::vector<int16_t> &values)
+    {
+        TemperatureHistory::Summary summary = {};
+        int count = values.size();
+        summary.columnCount = std::min(count, int(TemperatureHistory::COLUMN_COUNT));
+        std::vector<int32_t> sums(summary.columnCount), samples(summary.columnCount);
+        summary.min = INT16_MAX;
+        summary.max = INT16_MIN;
+        for (int i = 0; i < count; i++)
+        {
+            int column = static_cast<int64_t>(i) * summary.columnCount / count;
+            sums[column] += values[i];
+            samples[column]++;
+            summary.min = std::min(summary.min, values[i]);
+            summary.max = std::max(summary.max, values[i]);
+        }
+        for (int column = 0; column < summary.columnCount; column++)
+            summary.columns[column] = sums[column] / samples[column];
+        return summary;
+    }
+
+    void checkSummary(
+        const TemperatureHistory &history, TemperatureHistory::Range range,
+        const TemperatureHistory::Summary &expected)
+    {
+        TemperatureHistory::Summary summary;
+        CHECK_EQUAL(history.summary(range, summary), expected.columnCount > 0);
+        CHECK_EQUAL(summary.columnCount, expected.columnCount);
+        CHECK_EQUAL(summary.sequence, history.sequence());
+        if (summary.columnCount == 0)
+            return;
+
+        CHECK_EQUAL(summary.min, expected.min);
+        CHECK_EQUAL(summary.max, expected.max);
+        for (int column = 0; column < summary.columnCount; column++)
+            CHECK_EQUAL(summary.columns[column], expected.columns[column]);
+    }
+
+    void testSummaries()
+    {
+        FlashSimulator::reset();
+        Simulation::reset();
+        TemperatureHistory history;
+        checkSummary(history, TemperatureHistory::Day, {});
+        checkSummary(history, TemperatureHistory::Month, {});
+
+        std::vector<int16_t> minutes, hours;
+        int32_t hourSum = 0;
+        for (int minute = 0; minute < 3 * TemperatureHistory::MINUTE_COUNT + 30; minute++)
+        {
+            if (minute > 0 && minute % 60 == 0)
+            {
+                hours.push_back((hourSum + 30) / 60);
+                hourSum = 0;
+            }
+            minutes.push_back(sampleAt(minute));
+            hourSum += sampleAt(minute);
+
+            history.addMinuteSample(START_TIME + minute * 60, sampleAt(minute));
+            Simulation::runFor(60 * 1000000ull);
+
+            if (minute % 97 == 0 || minute % 60 == 0)
+            {
+                int first = std::max<int>(0, minutes.size() - TemperatureHistory::MINUTE_COUNT);
+                checkSummary(
+                    history, TemperatureHistory::Day,
+                    expectedSummary(std::vector<int16_t>(minutes.begin() + first, minutes.end())));
+                checkSummary(history, TemperatureHistory::Month, expectedSummary(hours));
+            }
+        }
+
+        // After a gap longer than the month, the history starts again.
+        time_t time = START_TIME + (minutes.size() + TemperatureHistory::HOUR_COUNT * 60) * 60;
+        history.addMinuteSample(time, 100);
+        checkSummary(history, TemperatureHistory::Day, expectedSummary({100}));
+        checkSummary(history, TemperatureHistory::Month, {});
+    }
+
+    void testCheckpoint()
+    {
+        FlashSimulator::reset();
+        Simulation::reset();
+        TemperatureHistory history;
+
+        // The checkpoint is taken when the 6th hour is complete, before the first minute of the
+        // next one is added.
+        TemperatureHistory::Summary day, month;
+        for (int minute = 0; minute < 7 * 60; minute++)
+        {
+            history.addMinuteSample(START_TIME + minute * 60, sampleAt(minute));
+            if (minute == 6 * 60 - 1)
+                history.summary(TemperatureHistory::Day, day);
+            if (minute == 6 * 60)
+                history.summary(TemperatureHistory::Month, month);
+            Simulation::runFor(60 * 1000000ull);
+        }
+
+        const uint32_t offset = FlashLayout::TEMPERATURE_HISTORY_OFFSET;
+        CHECK_EQUAL(FlashSimulator::eraseCount(offset), 1u);
+        CHECK(FlashSimulator::programCount(offset) > 0);
+        CHECK_EQUAL(FlashSimulator::violations(), 0u);
+
+        TemperatureHistory restored;
+        checkSummary(restored, TemperatureHistory::Day, day);
+        checkSummary(restored, TemperatureHistory::Month, month);
+    }
+}
+
+int main()
+{
+    testSummaries();
+    testCheckpoint();
+    return Check::result();
+}
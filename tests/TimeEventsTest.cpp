@@ -0,0 +1,116 @@
+#include "Check.h"
+#include "Simulation.h"
+#include "TimeEvents.h"
+
+#include <vector>
+
+// Event on each full minute of a clock that starts at 0 and can be stepped, driven by the
+// simulated hardware timer.
+namespace
+{
+    time_t g_clockOffset = 0; // Steps applied to the clock, in s
+    std::vector<time_t> g_reached;
+
+    time_t now()
+    {
+        return g_clockOffset + Simulation::timeUs() / 1000000;
+    }
+
+    time_t nextMinute(time_t now)
+    {
+        return (now / 60 + 1) * 60;
+    }
+
+    void runUntilClockTime(time_t time)
+    {
+        Simulation::runUntil((time - g_clockOffset) * 1000000);
+    }
+
+    // Step the clock as a sync would, at the current second.
+    void stepClock(TimeEvents &events, time_t seconds)
+    {
+        g_clockOffset += seconds;
+        uint64_t secondStartUs = Simulation::timeUs() / 1000000 * 1000000;
+        events.setReference(now(), secondStartUs);
+    }
+
+    TimeEvents &startEvents()
+    {
+        Simulation::reset();
+        g_clockOffset = 0;
+        g_reached.clear();
+
+        static TimeEvents *events = nullptr;
+        delete events;
+        events = new TimeEvents(now);
+        events->add(nextMinute, [](time_t deadline) { g_reached.push_back(deadline); });
+        events->setReference(now(), 0);
+        return *events;
+    }
+
+    void testDeadlinesFire()
+    {
+        startEvents();
+        runUntilClockTime(150);
+        CHECK_EQUAL(g_reached.size(), 2u);
+        CHECK_EQUAL(g_reached[0], 60);
+        CHECK_EQUAL(g_reached[1], 120);
+    }
+
+    // E.g. a drift correction or a sync at the second of the deadline, before the alarm fired
+    void testAdjustmentAtDeadlineSecond()
+    {
+        TimeEvents &events = startEvents();
+        Simulation::runUntil(119900000);
+        stepClock(events, 1);
+        CHECK_EQUAL(now(), 120);
+        Simulation::runFor(1000);
+        CHECK_EQUAL(g_reached.size(), 2u);
+        CHECK_EQUAL(g_reached.back(), 120);
+        CHECK_EQUAL(events.deadline(0), 180);
+    }
+
+    void testForwardStepOverDeadline()
+    {
+        TimeEvents &events = startEvents();
+        runUntilClockTime(150);
+        stepClock(events, 45);
+        Simulation::runFor(1000);
+        CHECK_EQUAL(g_reached.size(), 3u);
+        CHECK_EQUAL(g_reached.back(), 180);
+        CHECK_EQUAL(events.deadline(0), 240);
+    }
+
+    // E.g. the end of DST, the deadlines already reached must not be reached again.
+    void testBackwardStepAfterDeadline()
+    {
+        TimeEvents &events = startEvents();
+        runUntilClockTime(185);
+        CHECK_EQUAL(g_reached.size(), 3u);
+        stepClock(events, -10);
+        runUntilClockTime(200);
+        CHECK_EQUAL(g_reached.size(), 3u);
+        CHECK_EQUAL(events.deadline(0), 240);
+    }
+
+    // E.g. the time set for the first time
+    void testLongStepSkipsDeadlines()
+    {
+        TimeEvents &events = startEvents();
+        runUntilClockTime(30);
+        stepClock(events, 24 * 60 * 60);
+        Simulation::runFor(1000);
+        CHECK_EQUAL(g_reached.size(), 0u);
+        CHECK_EQUAL(events.deadline(0), nextMinute(now()));
+    }
+}
+
+int main()
+{
+    testDeadlinesFire();
+    testAdjustmentAtDeadlineSecond();
+    testForwardStepOverDeadline();
+    testBackwardStepAfterDeadline();
+    testLongStepSkipsDeadlines();
+    return Check::result();
+}
@@ -0,0 +1,152 @@
+#include "Check.h"
+#include "Simulation.h"
+#include "PicoClockHw/TimerWheel.h"
+
+#include <random>
+#include <vector>
+
+// The timing wheel of the device, driven by the simulated hardware alarm: delays across all the
+// levels and their cascading, rescheduling, cancelling, and timers added after an idle period.
+// The wheel keeps its state between the tests, as on the device, so the simulated time is never
+// reset.
+namespace
+{
+    const uint64_t MS_US = 1000;
+    const uint64_t HOUR_US = 60 * 60 * 1000 * MS_US;
+    const uint64_t MAX_DELAY_MS = (1ull << 24) - 1; // 6 bits per level, 4 levels
+
+    struct Expiry
+    {
+        uint64_t addedUs = 0;
+        uint64_t firedUs = 0;
+        int calls = 0;
+        int64_t reschedule = 0; // Returned by the callback
+    };
+
+    int64_t onTimer(TimerWheel::TimerId id, void *userData)
+    {
+        Expiry &expiry = *static_cast<Expiry *>(userData);
+        expiry.firedUs = Simulation::timeUs();
+        expiry.calls++;
+        return expiry.reschedule;
+    }
+
+    // Fires once, at least the delay after it was added, and within the resolution of 1 ms.
+    void checkFiredAfter(const Expiry &expiry, uint64_t delayMs)
+    {
+        CHECK_EQUAL(expiry.calls, 1);
+        CHECK(expiry.firedUs >= expiry.addedUs + delayMs * MS_US);
+        CHECK(expiry.firedUs <= expiry.addedUs + (delayMs + 1) * MS_US);
+    }
+
+    // A timer added after a long time without timer is not measured from the last one.
+    void testAfterIdle(uint64_t idleUs)
+    {
+        Simulation::runFor(idleUs + 123);
+        Expiry expiry;
+        expiry.addedUs = Simulation::timeUs();
+        CHECK(TimerWheel::addInMs(60 * 1000, onTimer, &expiry) != -1);
+        Simulation::runFor(2 * 60 * 1000 * MS_US);
+        checkFiredAfter(expiry, 60 * 1000);
+        CHECK_EQUAL(TimerWheel::stats().activeTimers, 0);
+    }
+
+    // Random delays spanning the levels, added at random times while others are pending
+    void testRandomDelays()
+    {
+        std::mt19937 random(3);
+        std::uniform_int_distribution<int> level(0, 3);
+        std::uniform_int_distribution<uint64_t> gapUs(0, 50 * MS_US);
+        const int COUNT = 12;
+        Expiry expiries[COUNT];
+        uint64_t delaysMs[COUNT];
+        for (int i = 0; i < COUNT; i++)
+        {
+            uint64_t maxDelayMs = (1ull << (6 * (level(random) + 1))) - 1;
+            delaysMs[i] = std::uniform_int_distribution<uint64_t>(0, maxDelayMs)(random);
+            Simulation::runFor(gapUs(random));
+            expiries[i].addedUs = Simulation::timeUs();
+            CHECK(TimerWheel::addInMs(delaysMs[i], onTimer, &expiries[i]) != -1);
+        }
+
+        Simulation::runFor(5 * HOUR_US);
+        for (int i = 0; i < COUNT; i++)
+            checkFiredAfter(expiries[i], delaysMs[i]);
+        CHECK_EQUAL(TimerWheel::stats().activeTimers, 0);
+    }
+
+    // Longer delays are cut to the range of the wheel.
+    void testMaxDelay()
+    {
+        Expiry expiry;
+        expiry.addedUs = Simulation::timeUs();
+        TimerWheel::addInMs(MAX_DELAY_MS + 60 * 1000, onTimer, &expiry);
+        Simulation::runFor(MAX_DELAY_MS * MS_US - 10 * MS_US);
+        CHECK_EQUAL(expiry.calls, 0);
+        Simulation::runFor(20 * MS_US);
+        CHECK_EQUAL(expiry.calls, 1);
+    }
+
+    void testReschedule()
+    {
+        // Negative values keep the period from the previous target, despite the latency.
+        Expiry periodic;
+        periodic.reschedule = -10 * MS_US;
+        periodic.addedUs = Simulation::timeUs();
+        TimerWheel::TimerId id = TimerWheel::addInMs(10, onTimer, &periodic);
+        Simulation::runFor(1005 * MS_US);
+        CHECK_EQUAL(periodic.calls, 100);
+
+        // Positive values count from the callback.
+        periodic.reschedule = 30 * MS_US;
+        uint64_t fromUs = periodic.firedUs;
+        Simulation::runFor(10 * MS_US);
+        CHECK_EQUAL(periodic.calls, 101);
+        Simulation::runFor(30 * MS_US);
+        CHECK_EQUAL(periodic.calls, 102);
+        CHECK_EQUAL(periodic.firedUs, fromUs + 40 * MS_US);
+
+        CHECK(TimerWheel::cancel(id));
+        CHECK(!TimerWheel::cancel(id));
+        Simulation::runFor(100 * MS_US);
+        CHECK_EQUAL(periodic.calls, 102);
+    }
+
+    void testCancelAndPool()
+    {
+        // Ids of freed timers are not valid anymore once the timer is allocated again.
+        std::vector<Expiry> expiries(16);
+        std::vector<TimerWheel::TimerId> ids;
+        for (Expiry &expiry : expiries)
+            ids.push_back(TimerWheel::addInMs(1000, onTimer, &expiry));
+        CHECK(ids.back() != -1);
+
+        Expiry extra;
+        CHECK_EQUAL(TimerWheel::addInMs(1000, onTimer, &extra), -1);
+
+        CHECK(TimerWheel::cancel(ids[3]));
+        TimerWheel::TimerId reused = TimerWheel::addInMs(1000, onTimer, &extra);
+        CHECK(reused != -1);
+        CHECK(reused != ids[3]);
+        CHECK(!TimerWheel::cancel(ids[3]));
+
+        Simulation::runFor(1001 * MS_US);
+        CHECK_EQUAL(expiries[3].calls, 0);
+        CHECK_EQUAL(expiries[4].calls, 1);
+        CHECK_EQUAL(extra.calls, 1);
+        CHECK_EQUAL(TimerWheel::stats().activeTimers, 0);
+    }
+}
+
+int main()
+{
+    testAfterIdle(HOUR_US);
+    testAfterIdle(5 * HOUR_US);
+    testAfterIdle(30 * HOUR_US);
+    testRandomDelays();
+    testMaxDelay();
+    testAfterIdle(5 * HOUR_US);
+    testReschedule();
+    testCancelAndPool();
+    return Check::result();
+}
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Project the remaining life of the settings sectors from the flash wear counters of the clock.
+
+The input is a capture of the USB console after sending 'w'. The counters are kept since the
+first use of the flash, so the write rate is computed from the last two "Flash wear" lines of
+the given captures, which should be taken days or weeks apart. With a single line, the time the
+clock has been in use must be given with --days.
+
+Examples:
+    flash_wear.py last_month.log today.log
+    flash_wear.py today.log --days 200
+"""
+
+import argparse
+import re
+import sys
+
+LINE = re.compile(
+    r"Flash wear: time (?P<time>-?\d+), sectors (?P<sectors>\d+), erases (?P<erases>\d+), "
+    r"page programs (?P<programs>\d+), skipped writes (?P<skipped>\d+), blocked (?P<blocked>\d+) ms")
+
+# Guaranteed erase cycles per sector of the flash chip of the Pico (W25Q16JV)
+DEFAULT_ENDURANCE = 100000
+
+SECONDS_PER_DAY = 24 * 60 * 60
+
+
+def read_samples(paths):
+    samples = []
+    for path in paths:
+        with open(path) if path != "-" else sys.stdin as f:
+            for match in LINE.finditer(f.read()):
+                samples.append({key: int(value) for key, value in match.groupdict().items()})
+    return samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("captures", nargs="+", help="console captures, '-' for standard input")
+    parser.add_argument("--days", type=float, help="days of use, if there is only one sample")
+    parser.add_argument("--endurance", type=int, default=DEFAULT_ENDURANCE,
+                        help="erase cycles per sector (default: %(default)s)")
+    args = parser.parse_args()
+
+    samples = read_samples(args.captures)
+    if not samples:
+        sys.exit("No 'Flash wear' line found")
+
+    last = samples[-1]
+    if len(samples) >= 2 and args.days is None:
+        first = samples[-2]
+        days = (last["time"] - first["time"]) / SECONDS_PER_DAY
+        if days <= 0:
+            sys.exit("The samples must be taken at different times")
+    elif args.days:
+        first = {key: 0 for key in last}
+        days = args.days
+    else:
+        sys.exit("Give a second capture or --days")
+
+    # The log rotates over the sectors, so they wear evenly.
+    erases_per_sector = last["erases"] / last["sectors"]
+    erase_rate = (last["erases"] - first["erases"]) / last["sectors"] / days
+    used = erases_per_sector / args.endurance
+
+    print("Erases per sector: %.0f of %d (%.3f%% of the endurance)" %
+          (erases_per_sector, args.endurance, used * 100))
+    print("Page programs: %d, writes skipped as unchanged: %d, interrupts blocked: %.1f s" %
+          (last["programs"], last["skipped"], last["blocked"] / 1000))
+    print("Observed rate: %.2f erases per sector and day over %.1f days" % (erase_rate, days))
+    if erase_rate > 0:
+        remaining_years = (args.endurance - erases_per_sector) / erase_rate / 365
+        print("Projected remaining life: %.0f years" % remaining_years)
+    else:
+        print("Projected remaining life: unlimited at the observed rate")
+
+
+if __name__ == "__main__":
+    main()
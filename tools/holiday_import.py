@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+"""Convert holiday lists to a UF2 file that writes the holiday calendar of the clock.
+
+The alarms do not ring on the imported days. Input files can be:
+
+- iCalendar files (.ics): all-day VEVENTs are imported. Multi-day events (DTEND) cover all their
+  days. Yearly recurring events (RRULE:FREQ=YEARLY) become recurring rules, with BYMONTH and
+  BYDAY=<n><weekday> for rules like "fourth Thursday of November".
+- CSV files: one entry per line, the first column being either a date (YYYY-MM-DD) or a rule:
+    fixed:MM-DD           every year on the given date
+    nth:MM:WD:N           the Nth weekday WD (0=SU..6=SA, or SU..SA) of month MM, N<0 from the end
+    easter:OFFSET         OFFSET days after Easter Sunday, e.g. easter:1 for Easter Monday
+  Further columns (e.g. a name) and lines starting with # are ignored.
+
+Copy the resulting file to the Pico in BOOTSEL mode, as for the firmware. The calendar sector is
+not touched by firmware updates, and vice versa.
+
+Example: holiday_import.py holidays.ics school.csv -o holidays.uf2
+"""
+
+import argparse
+import csv
+import datetime
+import re
+import struct
+import sys
+
+# Must match FlashLayout.h and HolidayCalendar.h
+FLASH_SIZE = 2 * 1024 * 1024
+SECTOR_SIZE = 4096
+SETTINGS_SECTOR_COUNT = 4
+HOLIDAYS_OFFSET = FLASH_SIZE - (SETTINGS_SECTOR_COUNT + 1) * SECTOR_SIZE
+XIP_BASE = 0x10000000
+MAGIC = 0x494C4F48
+VERSION = 1
+WORDS_PER_YEAR = 12
+
+FIXED_DATE = 1
+NTH_WEEKDAY = 2
+EASTER_OFFSET = 3
+
+UF2_MAGIC_START0 = 0x0A324655
+UF2_MAGIC_START1 = 0x9E5D5157
+UF2_MAGIC_END = 0x0AB16F30
+UF2_FLAG_FAMILY_ID_PRESENT = 0x00002000
+RP2040_FAMILY_ID = 0xE48BFF56
+UF2_PAYLOAD_SIZE = 256
+
+WEEKDAYS = ["SU", "MO", "TU", "WE", "TH", "FR", "SA"]
+
+
+class Calendar:
+    def __init__(self):
+        self.days = set()  # datetime.date
+        self.rules = set()  # (type, month, day, param)
+
+    def add_range(self, start, end):
+        """Add the days from start (included) to end (excluded)."""
+        day = start
+        while day < end:
+            self.days.add(day)
+            day += datetime.timedelta(days=1)
+
+
+def parse_weekday(text):
+    text = text.strip().upper()
+    if text.isdigit():
+        return int(text)
+    return WEEKDAYS.index(text[:2])
+
+
+def parse_csv(path, calendar):
+    with open(path, newline="") as f:
+        for row in csv.reader(f):
+            if not row or not row[0].strip() or row[0].lstrip().startswith("#"):
+                continue
+            entry = row[0].strip()
+            kind, _, arg = entry.partition(":")
+            kind = kind.lower()
+            if kind == "fixed":
+                month, day = (int(x) for x in arg.split("-"))
+                calendar.rules.add((FIXED_DATE, month, day, 0))
+            elif kind == "nth":
+                month, weekday, n = arg.split(":")
+                calendar.rules.add((NTH_WEEKDAY, int(month), parse_weekday(weekday), int(n)))
+            elif kind == "easter":
+                calendar.rules.add((EASTER_OFFSET, 0, 0, int(arg)))
+            else:
+                day = datetime.date.fromisoformat(entry)
+                calendar.days.add(day)
+
+
+def unfold_ics_lines(text):
+    lines = []
+    for line in text.splitlines():
+        if line.startswith((" ", "\t")) and lines:
+            lines[-1] += line[1:]
+        else:
+            lines.append(line)
+    return lines
+
+
+def parse_ics_date(value):
+    return datetime.date(int(value[0:4]), int(value[4:6]), int(value[6:8]))
+
+
+def parse_ics(path, calendar):
+    with open(path, encoding="utf-8") as f:
+        lines = unfold_ics_lines(f.read())
+
+    event = None
+    for line in lines:
+        name, _, value = line.partition(":")
+        name = name.split(";")[0].upper()
+        if name == "BEGIN" and value.upper() == "VEVENT":
+            event = {}
+        elif name == "END" and value.upper() == "VEVENT" and event is not None:
+            add_ics_event(event, calendar, path)
+            event = None
+        elif event is not None and name in ("DTSTART", "DTEND", "RRULE"):
+            event[name] = value.strip()
+
+
+def add_ics_event(event, calendar, path):
+    if "DTSTART" not in event:
+        return
+    start = parse_ics_date(event["DTSTART"])
+    end = parse_ics_date(event["DTEND"]) if "DTEND" in event else start + datetime.timedelta(days=1)
+    end = max(end, start + datetime.timedelta(days=1))
+
+    rrule = event.get("RRULE")
+    if rrule is None:
+        calendar.add_range(start, end)
+        return
+
+    parts = dict(p.split("=", 1) for p in rrule.upper().split(";") if "=" in p)
+    if parts.get("FREQ") != "YEARLY" or "UNTIL" in parts or "COUNT" in parts:
+        print(f"{path}: unsupported RRULE {rrule}, importing first occurrence only",
+              file=sys.stderr)
+        calendar.add_range(start, end)
+        return
+
+    month = int(parts.get("BYMONTH", start.month))
+    byday = parts.get("BYDAY")
+    if byday:
+        match = re.fullmatch(r"([+-]?\d+)([A-Z]{2})", byday)
+        if not match:
+            print(f"{path}: unsupported BYDAY {byday}, skipped", file=sys.stderr)
+            return
+        calendar.rules.add((NTH_WEEKDAY, month, WEEKDAYS.index(match.group(2)),
+                            int(match.group(1))))
+    else:
+        day = int(parts.get("BYMONTHDAY", start.day))
+        calendar.rules.add((FIXED_DATE, month, day, 0))
+
+
+def djb2(data):
+    h = 5381
+    for b in data:
+        h = (h * 33 + b) & 0xFFFFFFFF
+    return h
+
+
+def build_sector(calendar):
+    years = {}
+    for day in calendar.days:
+        bits = years.setdefault(day.year, [0] * WORDS_PER_YEAR)
+        yday = day.timetuple().tm_yday - 1
+        bits[yday // 32] |= 1 << (yday % 32)
+
+    body = b""
+    for year in sorted(years):
+        body += struct.pack("<HH", year, 0) + struct.pack(f"<{WORDS_PER_YEAR}I", *years[year])
+    for rule in sorted(calendar.rules):
+        body += struct.pack("<BBBb", *rule)
+
+    header = struct.pack("<IHHHHI", MAGIC, VERSION, len(years), len(calendar.rules), 0,
+                         djb2(body))
+    data = header + body
+    if len(data) > SECTOR_SIZE:
+        sys.exit(f"Calendar too big: {len(data)} bytes, at most {SECTOR_SIZE} supported")
+    return data + b"\xff" * (SECTOR_SIZE - len(data))
+
+
+def to_uf2(data, address):
+    block_count = len(data) // UF2_PAYLOAD_SIZE
+    blocks = b""
+    for i in range(block_count):
+        payload = data[i * UF2_PAYLOAD_SIZE:(i + 1) * UF2_PAYLOAD_SIZE]
+        block = struct.pack("<8I", UF2_MAGIC_START0, UF2_MAGIC_START1, UF2_FLAG_FAMILY_ID_PRESENT,
+                            address + i * UF2_PAYLOAD_SIZE, UF2_PAYLOAD_SIZE, i, block_count,
+                            RP2040_FAMILY_ID)
+        block += payload + b"\x00" * (476 - len(payload)) + struct.pack("<I", UF2_MAGIC_END)
+        blocks += block
+    return blocks
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("inputs", nargs="+", help=".ics or .csv files")
+    parser.add_argument("-o", "--output", required=True, help="output .uf2 file")
+    parser.add_argument("--bin", action="store_true",
+                        help="write the raw sector content instead of a UF2 file")
+    args = parser.parse_args()
+
+    calendar = Calendar()
+    for path in args.inputs:
+        if path.lower().endswith(".ics"):
+            parse_ics(path, calendar)
+        else:
+            parse_csv(path, calendar)
+
+    sector = build_sector(calendar)
+    with open(args.output, "wb") as f:
+        f.write(sector if args.bin else to_uf2(sector, XIP_BASE + HOLIDAYS_OFFSET))
+    print(f"{len(calendar.days)} days and {len(calendar.rules)} rules written to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
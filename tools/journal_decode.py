@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Decode the event journal of the clock.
+
+The input is either a capture of the USB console after sending 'j' (lines starting with "J "
+followed by the record in hex, other lines are ignored), or with --binary a dump of the journal
+sectors, e.g. made with:
+
+    picotool save -r 0x101F9000 0x101FB000 journal.bin
+
+Records are printed oldest first. Times are local, as displayed by the clock.
+
+Example: journal_decode.py console.log
+"""
+
+import argparse
+import datetime
+import re
+import struct
+import sys
+
+# Must match EventJournal.h
+RECORD = struct.Struct("<IIiBBBB")
+ERASED_SEQUENCE = 0xFFFFFFFF
+
+NTP_STATES = {4: "DNS failed", 5: "invalid response", 6: "timeout"}
+RTC_OPERATIONS = {0: "read", 1: "write", 2: "temperature"}
+
+
+def describe(event_type, arg, value):
+    if event_type == 1:
+        return "Boot" + (" (time kept across reset)" if arg else "")
+    if event_type == 2:
+        return "NTP sync, clock corrected by %+d ms" % value
+    if event_type == 3:
+        return "NTP failed: " + NTP_STATES.get(arg, str(arg))
+    if event_type == 4:
+        return "RTC %s failed" % RTC_OPERATIONS.get(arg, str(arg))
+    if event_type == 5:
+        return "Alarm %d %s" % (arg + 1, "skipped" if value else "rang")
+    if event_type == 6:
+        return "Time set, clock corrected by %+d s" % value
+    if event_type == 7:
+        return "I2C bus recovered" + (", SDA was held low" if arg else "")
+    return "Unknown event %d (arg %d, value %d)" % (event_type, arg, value)
+
+
+def is_valid(data):
+    return (~sum(data[:-1])) & 0xFF == data[-1]
+
+
+def records_from_console(text):
+    for match in re.finditer(r"^J ([0-9a-fA-F]{%d})\s*$" % (RECORD.size * 2), text, re.MULTILINE):
+        yield bytes.fromhex(match.group(1))
+
+
+def records_from_binary(data):
+    for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        yield data[offset:offset + RECORD.size]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input", nargs="?", help="input file, standard input if omitted")
+    parser.add_argument("--binary", action="store_true", help="input is a dump of the sectors")
+    args = parser.parse_args()
+
+    if args.binary:
+        with open(args.input, "rb") if args.input else sys.stdin.buffer as f:
+            raw_records = records_from_binary(f.read())
+    else:
+        with open(args.input) if args.input else sys.stdin as f:
+            raw_records = records_from_console(f.read())
+
+    records = []
+    for data in raw_records:
+        sequence, time, value, event_type, arg, _, _ = RECORD.unpack(data)
+        if sequence == ERASED_SEQUENCE or not is_valid(data):
+            continue
+        records.append((sequence, time, event_type, arg, value))
+
+    # A dump of the sectors is in ring order, not in chronological order.
+    records.sort(key=lambda record: record[0])
+
+    for sequence, time, event_type, arg, value in records:
+        if time == 0:
+            when = "time unknown       "
+        else:
+            when = datetime.datetime.fromtimestamp(time, datetime.timezone.utc).strftime("%Y-%m-%d %H:%M:%S")
+        print("%6d  %s  %s" % (sequence, when, describe(event_type, arg, value)))
+
+
+if __name__ == "__main__":
+    main()